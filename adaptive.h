@@ -0,0 +1,268 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+// Adaptive ray subdivision.
+//
+// DrawRays with most columns never marched. Every AdaptiveRayStride-th
+// column and the last one are marched as usual. Between two marched columns
+// that entered the same tile face, every ray crosses that face's plane too,
+// so the sample the march would stop at is solved for directly and checked
+// with the march's own arithmetic: the sample has to be in a wall and the
+// one before it in the open tile in front of the face. Spans that hit
+// different faces, miss, or are wide enough at their depth for a whole tile
+// to hide between the two rays are split at their middle column, which is
+// marched, until they are interpolable or have no columns left.
+//
+// Interpolated columns get the same hit and trail as marched ones, the
+// samples are only computed instead of looked up.
+//
+// Columns are marched one at a time in scalar code, so this only pays off
+// against the scalar DrawRays, which it beats on every generated map. The
+// SIMD kernels DrawRays dispatches to march all columns faster than this
+// marches a fraction of them, except in wide open maps at long view
+// distances, where it is about even.
+
+const int AdaptiveRayStride = 8;
+
+// What a marched column hit, enough to compare it with its neighbours.
+struct ColumnHit
+{
+    bool wasHit;
+    int sample;
+    int tileX;
+    int tileY;
+    // Step from the tile before the hit into it, (1, 0) for a ray that went
+    // through the face on the left of the tile. Zero when it went through a
+    // corner or started in the wall.
+    int faceX;
+    int faceY;
+};
+
+struct AdaptiveRays
+{
+    MinimapTrail trail;
+    int rayCount;
+    ColumnHit columns[MaxRayCount];
+};
+
+// Columns rendered and rays marched for them, for the benchmarks.
+struct AdaptiveRayCounts
+{
+    Uint64 columns;
+    Uint64 marched;
+};
+
+AdaptiveRayCounts adaptiveRayCounts;
+
+template<typename Geometry>
+void MarchColumn(ScreenBuffer buffer, Texture texture, RayHits *hits, AdaptiveRays *rays, int rayIndex)
+{
+    float angle, cos, sin;
+    GetColumnRay(rayIndex, rays->rayCount, &angle, &cos, &sin);
+
+    ColumnHit *column = &rays->columns[rayIndex];
+    *column = ColumnHit {};
+    int previousTileX = 0;
+    int previousTileY = 0;
+
+    for (int i = 0; i < viewDistance; i += 2)
+    {
+        Vec2 rayPixelPosition = GetRaySample(&rays->trail, cos, sin, i);
+        int pixelX = FloorToInt(rayPixelPosition.x);
+        int pixelY = FloorToInt(rayPixelPosition.y);
+        int tileX = player.position.tileX + Geometry::FloorPixelToTileX(pixelX);
+        int tileY = player.position.tileY + Geometry::FloorPixelToTileY(pixelY);
+        TileType tile = Geometry::GetTile(tileX, tileY);
+
+        if (tile == _)
+        {
+            int minimapX = rays->trail.baseX + pixelX;
+            int minimapY = rays->trail.baseY + pixelY;
+            if (minimapX >= 0 && minimapY >= 0 && minimapX < rays->trail.width && minimapY < rays->trail.height)
+            {
+                SetPixelColor(buffer, minimapX, minimapY, White);
+            }
+            previousTileX = tileX;
+            previousTileY = tileY;
+        }
+        else
+        {
+            SetRayHit(hits, rayIndex, angle, Distance(Vec2(rays->trail.eyeX, rays->trail.eyeY), rayPixelPosition), tile, texture);
+            column->wasHit = true;
+            column->sample = i;
+            column->tileX = tileX;
+            column->tileY = tileY;
+            // Samples are much closer than a tile, so they step at most one
+            // tile along each axis.
+            int stepX = tileX - previousTileX;
+            int stepY = tileY - previousTileY;
+            if (i > 0 && abs(stepX) + abs(stepY) == 1)
+            {
+                column->faceX = stepX;
+                column->faceY = stepY;
+            }
+            break;
+        }
+    }
+    ++adaptiveRayCounts.marched;
+}
+
+// True when two marched columns went through the same face plane, next to
+// each other, close enough that no tile fits between their rays.
+inline bool IsSpanInterpolable(const ColumnHit *left, const ColumnHit *right, int columns, int rayCount, int tileSize)
+{
+    if (!left->wasHit || !right->wasHit || (left->faceX == 0 && left->faceY == 0) ||
+        left->faceX != right->faceX || left->faceY != right->faceY)
+    {
+        return false;
+    }
+    bool samePlane = left->faceX ? (left->tileX == right->tileX && abs(left->tileY - right->tileY) <= 1) :
+                                   (left->tileY == right->tileY && abs(left->tileX - right->tileX) <= 1);
+    float spanWidth = SDL_max(left->sample, right->sample) * (player.fov * AngleToRadian) * columns / rayCount;
+    return samePlane && spanWidth < tileSize / 2;
+}
+
+// Whether sample i is in or past the face plane's tile row or column, with
+// the same arithmetic as the march.
+template<typename Geometry>
+inline bool IsSamplePastPlane(bool acrossX, float eye, float direction, int i, int playerTile, int planeTile, int step)
+{
+    int pixel = FloorToInt(eye + direction * i);
+    int tile = playerTile + (acrossX ? Geometry::FloorPixelToTileX(pixel) : Geometry::FloorPixelToTileY(pixel));
+    return (tile - planeTile) * step >= 0;
+}
+
+// Fills rayIndex from the face its neighbour hit, false when the march would
+// not have stopped at that face.
+template<typename Geometry>
+bool InterpolateColumn(ScreenBuffer buffer, Texture texture, RayHits *hits, const AdaptiveRays *rays, int rayIndex, const ColumnHit *face)
+{
+    float angle, cos, sin;
+    GetColumnRay(rayIndex, rays->rayCount, &angle, &cos, &sin);
+
+    // The plane in pixels from the player's tile, and the axis it is across.
+    bool acrossX = face->faceX != 0;
+    int step = acrossX ? face->faceX : face->faceY;
+    float direction = acrossX ? cos : sin;
+    float eye = acrossX ? rays->trail.eyeX : rays->trail.eyeY;
+    int tileSize = acrossX ? Geometry::TileWidthInPixels : Geometry::TileHeightInPixels;
+    int planeTile = acrossX ? face->tileX : face->tileY;
+    int playerTile = acrossX ? player.position.tileX : player.position.tileY;
+    if (direction * step <= 0)
+    {
+        return false;
+    }
+    float plane = (float)((planeTile - playerTile + (step < 0)) * tileSize);
+
+    // First sample past the plane, estimated and then settled sample by
+    // sample.
+    float estimate = (plane - eye) / direction;
+    if (!(estimate < viewDistance))
+    {
+        return false;
+    }
+    int sample = estimate > 0 ? (int)estimate & ~1 : 0;
+    while (sample < viewDistance && !IsSamplePastPlane<Geometry>(acrossX, eye, direction, sample, playerTile, planeTile, step))
+    {
+        sample += 2;
+    }
+    while (sample >= 2 && IsSamplePastPlane<Geometry>(acrossX, eye, direction, sample - 2, playerTile, planeTile, step))
+    {
+        sample -= 2;
+    }
+    if (sample == 0 || !(sample < viewDistance))
+    {
+        return false;
+    }
+
+    // The hit has to be a wall entered through this face from an open tile.
+    Vec2 rayPixelPosition = GetRaySample(&rays->trail, cos, sin, sample);
+    Vec2 previousPosition = GetRaySample(&rays->trail, cos, sin, sample - 2);
+    int tileX = player.position.tileX + Geometry::FloorPixelToTileX(FloorToInt(rayPixelPosition.x));
+    int tileY = player.position.tileY + Geometry::FloorPixelToTileY(FloorToInt(rayPixelPosition.y));
+    int previousTileX = player.position.tileX + Geometry::FloorPixelToTileX(FloorToInt(previousPosition.x));
+    int previousTileY = player.position.tileY + Geometry::FloorPixelToTileY(FloorToInt(previousPosition.y));
+    if (tileX - previousTileX != face->faceX || tileY - previousTileY != face->faceY)
+    {
+        return false;
+    }
+    TileType tile = Geometry::GetTile(tileX, tileY);
+    if (tile == _ || Geometry::GetTile(previousTileX, previousTileY) != _)
+    {
+        return false;
+    }
+
+    SetRayHit(hits, rayIndex, angle, Distance(Vec2(rays->trail.eyeX, rays->trail.eyeY), rayPixelPosition), tile, texture);
+    DrawRayTrail(buffer, &rays->trail, cos, sin, sample);
+    return true;
+}
+
+// Renders the columns strictly between two marched ones.
+template<typename Geometry>
+void RefineSpan(ScreenBuffer buffer, Texture texture, RayHits *hits, AdaptiveRays *rays, int left, int right)
+{
+    if (right - left <= 1)
+    {
+        return;
+    }
+
+    const int tileSize = SDL_min(Geometry::TileWidthInPixels, Geometry::TileHeightInPixels);
+    const ColumnHit *leftHit = &rays->columns[left];
+    if (IsSpanInterpolable(leftHit, &rays->columns[right], right - left, rays->rayCount, tileSize))
+    {
+        for (int rayIndex = left + 1; rayIndex < right; ++rayIndex)
+        {
+            if (!InterpolateColumn<Geometry>(buffer, texture, hits, rays, rayIndex, leftHit))
+            {
+                MarchColumn<Geometry>(buffer, texture, hits, rays, rayIndex);
+            }
+        }
+        return;
+    }
+
+    int middle = left + (right - left) / 2;
+    MarchColumn<Geometry>(buffer, texture, hits, rays, middle);
+    RefineSpan<Geometry>(buffer, texture, hits, rays, left, middle);
+    RefineSpan<Geometry>(buffer, texture, hits, rays, middle, right);
+}
+
+template<typename Geometry>
+void DrawRaysAdaptiveKernel(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    static AdaptiveRays rays;
+    rays.rayCount = Geometry::ColumnCount(hits);
+    if (rays.rayCount <= 0)
+    {
+        return;
+    }
+
+    rays.trail = GetMinimapTrail(buffer);
+
+    int last = rays.rayCount - 1;
+    MarchColumn<Geometry>(buffer, texture, hits, &rays, 0);
+    for (int left = 0; left < last; left += AdaptiveRayStride)
+    {
+        int right = SDL_min(left + AdaptiveRayStride, last);
+        MarchColumn<Geometry>(buffer, texture, hits, &rays, right);
+        RefineSpan<Geometry>(buffer, texture, hits, &rays, left, right);
+    }
+    adaptiveRayCounts.columns += rays.rayCount;
+}
+
+void DrawRaysAdaptive(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    switch (SelectGeometry(hits))
+    {
+    case Geometry_BuiltIn:
+        DrawRaysAdaptiveKernel<BuiltInGeometry>(buffer, texture, hits);
+        break;
+    case Geometry_Bricked:
+        DrawRaysAdaptiveKernel<BrickedGeometry>(buffer, texture, hits);
+        break;
+    default:
+        DrawRaysAdaptiveKernel<DynamicGeometry>(buffer, texture, hits);
+        break;
+    }
+}
+
+#endif
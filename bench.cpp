@@ -0,0 +1,275 @@
+#define RAYCASTER_NO_MAIN
+#include "raycaster.cpp"
+#include "benchutil.h"
+
+// Kernel level microbenchmarks for the renderer hot paths.
+//
+// Every kernel runs over inputs generated from --seed, so two builds measured
+// with the same options time exactly the same work. Results are written as
+// JSON to stdout or to --out.
+
+const int BenchInputCount = 1024;
+
+typedef void RayCastFunction(ScreenBuffer buffer, Texture texture, RayHits *hits);
+
+struct KernelContext
+{
+    ScreenBuffer buffer;
+    Texture texture;
+    RayHits hits;
+    RayCastFunction *cast;
+    bool turnInPlace;
+
+    Player poses[BenchInputCount];
+    Vec2 points[BenchInputCount];
+    Vec2 otherPoints[BenchInputCount];
+    Vec2 tiles[BenchInputCount];
+    Vec2 rectDims[BenchInputCount];
+};
+
+volatile float BenchSink;
+
+Player RandomPose(BenchRng *rng)
+{
+    Player pose = player;
+    Vec2 tile(0, 0);
+    do
+    {
+        tile = Vec2(RandomInt(rng, 0, MapDimsInTiles.x), RandomInt(rng, 0, MapDimsInTiles.y));
+    } while (GetTileValue(tile) != _);
+
+    Vec2 offset(RandomFloat(rng, 0, TileDimsInPixels.x), RandomFloat(rng, 0, TileDimsInPixels.y));
+    pose.position = MakeWorldPosition(tile.x, tile.y, offset);
+    pose.facingAngle = RandomFloat(rng, 0, 360);
+    return pose;
+}
+
+// The caster of the entry being measured. Turning in place keeps one
+// position and changes the facing angle every op, which is what the cached
+// caster is built for.
+void BenchCastRays(void *data, int ops)
+{
+    KernelContext *context = (KernelContext *) data;
+    for (int op = 0; op < ops; ++op)
+    {
+        player = context->poses[context->turnInPlace ? 0 : op % BenchInputCount];
+        player.facingAngle = context->poses[op % BenchInputCount].facingAngle;
+        ClearHits(&context->hits, FpsViewDimsInPixels.x);
+        context->cast(context->buffer, context->texture, &context->hits);
+    }
+}
+
+void BenchDrawFpsView(void *data, int ops)
+{
+    KernelContext *context = (KernelContext *) data;
+    for (int op = 0; op < ops; ++op)
+    {
+        DrawFpsView(context->buffer, &context->hits);
+    }
+}
+
+void BenchDrawMap(void *data, int ops)
+{
+    KernelContext *context = (KernelContext *) data;
+    for (int op = 0; op < ops; ++op)
+    {
+        DrawMap(context->buffer, context->texture);
+    }
+}
+
+void BenchFillTileWithColor(void *data, int ops)
+{
+    KernelContext *context = (KernelContext *) data;
+    for (int op = 0; op < ops; ++op)
+    {
+        Vec2 tile = context->tiles[op % BenchInputCount];
+        FillTileWithColor(context->buffer, tile.x, tile.y, TileDimsInPixels.x, TileDimsInPixels.y, Blue);
+    }
+}
+
+void BenchDrawRect(void *data, int ops)
+{
+    KernelContext *context = (KernelContext *) data;
+    for (int op = 0; op < ops; ++op)
+    {
+        int index = op % BenchInputCount;
+        DrawRect(context->buffer, context->points[index], context->rectDims[index], Green);
+    }
+}
+
+void BenchGetTileValue(void *data, int ops)
+{
+    KernelContext *context = (KernelContext *) data;
+    int sum = 0;
+    for (int op = 0; op < ops; ++op)
+    {
+        sum += GetTileValue(context->tiles[op % BenchInputCount]);
+    }
+    BenchSink = sum;
+}
+
+void BenchDistance(void *data, int ops)
+{
+    KernelContext *context = (KernelContext *) data;
+    float sum = 0;
+    for (int op = 0; op < ops; ++op)
+    {
+        int index = op % BenchInputCount;
+        sum += Distance(context->points[index], context->otherPoints[index]);
+    }
+    BenchSink = sum;
+}
+
+void BenchNormalize(void *data, int ops)
+{
+    KernelContext *context = (KernelContext *) data;
+    float sum = 0;
+    for (int op = 0; op < ops; ++op)
+    {
+        sum += Normalize(context->points[op % BenchInputCount]).x;
+    }
+    BenchSink = sum;
+}
+
+void BenchAngle(void *data, int ops)
+{
+    KernelContext *context = (KernelContext *) data;
+    float sum = 0;
+    for (int op = 0; op < ops; ++op)
+    {
+        int index = op % BenchInputCount;
+        sum += Angle(context->points[index], context->otherPoints[index]);
+    }
+    BenchSink = sum;
+}
+
+struct KernelEntry
+{
+    const char *name;
+    BenchKernel *kernel;
+    int opsPerRep;
+    // For BenchCastRays.
+    RayCastFunction *cast;
+    bool turnInPlace;
+};
+
+const KernelEntry Kernels[] =
+{
+    { "DrawRays", BenchCastRays, 16, DrawRays, false },
+    { "DrawRaysFixed", BenchCastRays, 16, DrawRaysFixed, false },
+    { "DrawRaysCached", BenchCastRays, 16, DrawRaysCached, true },
+    { "DrawRaysDistanceField", BenchCastRays, 16, DrawRaysDistanceField, false },
+    { "DrawRaysPortal", BenchCastRays, 16, DrawRaysPortal, false },
+    { "DrawRaysAdaptive", BenchCastRays, 16, DrawRaysAdaptive, false },
+    { "DrawRaysSegments", BenchCastRays, 16, DrawRaysSegments, false },
+    { "DrawRaysBsp", BenchCastRays, 16, DrawRaysBsp, false },
+    { "DrawFpsView", BenchDrawFpsView, 16, NULL, false },
+    { "DrawMap", BenchDrawMap, 16, NULL, false },
+    { "FillTileWithColor", BenchFillTileWithColor, 1024, NULL, false },
+    { "DrawRect", BenchDrawRect, 1024, NULL, false },
+    { "GetTileValue", BenchGetTileValue, 1 << 16, NULL, false },
+    { "Distance", BenchDistance, 1 << 16, NULL, false },
+    { "Normalize", BenchNormalize, 1 << 16, NULL, false },
+    { "Angle", BenchAngle, 1 << 16, NULL, false },
+};
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options = {0};
+    options.seed = 1;
+    options.warmupReps = 3;
+    options.reps = 15;
+
+    const char *filter = NULL;
+    SimdLevel simdLevel = Simd_Count;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc)
+        {
+            if (!ParseSimdLevel(argv[++i], &simdLevel))
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown SIMD level : %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!ParseBenchOption(argc, argv, &i, &options))
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown argument : %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    bool pinned = PinToCpu(options.cpu);
+    InitRenderKernels(simdLevel);
+
+    KernelContext *context = (KernelContext *) calloc(1, sizeof(KernelContext));
+    context->buffer = CreateScreenBuffer(NULL, WindowSize.x, WindowSize.y);
+    context->texture = LoadTexture("walltext.png");
+    if (!context->texture.data)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "walltext.png not found, run from the repository root\n");
+        return 1;
+    }
+
+    BenchRng rng = { options.seed * 0x9E3779B97F4A7C15ULL + 1 };
+    for (int i = 0; i < BenchInputCount; ++i)
+    {
+        context->poses[i] = RandomPose(&rng);
+        context->points[i] = Vec2(RandomFloat(&rng, 0, MapDimsInPixels.x - 50), RandomFloat(&rng, 0, MapDimsInPixels.y - 50));
+        context->otherPoints[i] = Vec2(RandomFloat(&rng, 0, MapDimsInPixels.x), RandomFloat(&rng, 0, MapDimsInPixels.y));
+        context->tiles[i] = Vec2(RandomInt(&rng, 0, MapDimsInTiles.x), RandomInt(&rng, 0, MapDimsInTiles.y));
+        context->rectDims[i] = Vec2(RandomInt(&rng, 1, 50), RandomInt(&rng, 1, 50));
+    }
+
+    // The BSP caster draws from a level compiled from the map's faces.
+    WallSegment *faces = NULL;
+    int faceCount = 0;
+    int faceCapacity = 0;
+    AppendTileFaces(world, &faces, &faceCount, &faceCapacity);
+    BuildBsp(&bsp, faces, faceCount);
+    free(faces);
+
+    // DrawFpsView consumes the hits of a representative frame.
+    DrawMap(context->buffer, context->texture);
+    player = context->poses[0];
+    ClearHits(&context->hits, FpsViewDimsInPixels.x);
+    DrawRays(context->buffer, context->texture, &context->hits);
+
+    FILE *output = OpenBenchOutput(options);
+    if (!output)
+    {
+        return 1;
+    }
+
+    WriteBenchHeader(output, "kernels", options, pinned);
+    fprintf(output, "  \"simd\": \"%s\",\n", SimdLevelNames[kernels.level]);
+    fprintf(output, "  \"results\": [\n");
+
+    int selected[ArrayCount(Kernels)];
+    int selectedCount = 0;
+    for (int i = 0; i < ArrayCount(Kernels); ++i)
+    {
+        if (!filter || strstr(Kernels[i].name, filter))
+        {
+            selected[selectedCount++] = i;
+        }
+    }
+
+    for (int i = 0; i < selectedCount; ++i)
+    {
+        const KernelEntry *entry = &Kernels[selected[i]];
+        context->cast = entry->cast;
+        context->turnInPlace = entry->turnInPlace;
+        BenchResult result = MeasureKernel(entry->name, entry->kernel, context, entry->opsPerRep, options);
+        WriteBenchResult(output, result, i == selectedCount - 1);
+    }
+
+    fprintf(output, "  ]\n}\n");
+    CloseBenchOutput(output);
+    FreeBsp(&bsp);
+    return 0;
+}
@@ -0,0 +1,237 @@
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <stdio.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Shared helpers for the benchmark executables: seeded random inputs,
+// CPU pinning, repeated timing, cache miss counting and JSON output.
+
+struct BenchRng
+{
+    Uint64 state;
+};
+
+inline Uint32 NextRandom(BenchRng *rng)
+{
+    // xorshift64*, deterministic for a given seed on every platform.
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return (Uint32)((rng->state * 2685821657736338717ULL) >> 32);
+}
+
+inline float RandomFloat(BenchRng *rng, float min, float max)
+{
+    float t = (float)(NextRandom(rng) >> 8) / (float)(1 << 24);
+    return min + t * (max - min);
+}
+
+inline int RandomInt(BenchRng *rng, int min, int maxExclusive)
+{
+    return min + (int)(NextRandom(rng) % (Uint32)(maxExclusive - min));
+}
+
+// Pins the calling thread to one CPU. Only supported on Linux; elsewhere
+// the request is ignored and false is returned.
+bool PinToCpu(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Last level cache misses of the calling thread, from the Linux perf
+// counters. Unavailable elsewhere, or when the kernel or a virtual machine
+// does not expose the hardware counter; fd is -1 then and reads return 0.
+struct CacheMissCounter
+{
+    int fd;
+};
+
+CacheMissCounter OpenCacheMissCounter()
+{
+    CacheMissCounter counter = { -1 };
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    counter.fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    return counter;
+}
+
+inline bool IsCacheMissCounterOpen(CacheMissCounter counter)
+{
+    return counter.fd >= 0;
+}
+
+inline Uint64 ReadCacheMisses(CacheMissCounter counter)
+{
+    Uint64 value = 0;
+#ifdef __linux__
+    if (counter.fd >= 0 && read(counter.fd, &value, sizeof(value)) != sizeof(value))
+    {
+        value = 0;
+    }
+#endif
+    return value;
+}
+
+void CloseCacheMissCounter(CacheMissCounter *counter)
+{
+#ifdef __linux__
+    if (counter->fd >= 0)
+    {
+        close(counter->fd);
+    }
+#endif
+    counter->fd = -1;
+}
+
+inline double CounterToNs(Uint64 counter)
+{
+    return (double)counter * 1e9 / (double)SDL_GetPerformanceFrequency();
+}
+
+struct BenchOptions
+{
+    Uint64 seed;
+    int warmupReps;
+    int reps;
+    int cpu;
+    const char *outputPath;
+};
+
+struct BenchResult
+{
+    const char *name;
+    int opsPerRep;
+    int reps;
+    double minNsPerOp;
+    double medianNsPerOp;
+    double meanNsPerOp;
+};
+
+typedef void BenchKernel(void *context, int ops);
+
+// Runs the kernel for warmupReps untimed repetitions, then times reps
+// repetitions of opsPerRep operations each.
+BenchResult MeasureKernel(const char *name, BenchKernel *kernel, void *context, int opsPerRep, BenchOptions options)
+{
+    for (int rep = 0; rep < options.warmupReps; ++rep)
+    {
+        kernel(context, opsPerRep);
+    }
+
+    double *samples = (double *) malloc(options.reps * sizeof(double));
+    double total = 0;
+    for (int rep = 0; rep < options.reps; ++rep)
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        kernel(context, opsPerRep);
+        Uint64 end = SDL_GetPerformanceCounter();
+
+        samples[rep] = CounterToNs(end - start) / opsPerRep;
+        total += samples[rep];
+    }
+    std::sort(samples, samples + options.reps);
+
+    BenchResult result = {0};
+    result.name = name;
+    result.opsPerRep = opsPerRep;
+    result.reps = options.reps;
+    result.minNsPerOp = samples[0];
+    result.medianNsPerOp = samples[options.reps / 2];
+    result.meanNsPerOp = total / options.reps;
+
+    free(samples);
+    return result;
+}
+
+bool ParseBenchOption(int argc, char *argv[], int *index, BenchOptions *options)
+{
+    int i = *index;
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--seed") == 0 && hasValue)
+    {
+        options->seed = strtoull(argv[++i], NULL, 10);
+    }
+    else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+    {
+        options->warmupReps = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--reps") == 0 && hasValue)
+    {
+        int reps = atoi(argv[++i]);
+        options->reps = SDL_max(1, reps);
+    }
+    else if (strcmp(argv[i], "--cpu") == 0 && hasValue)
+    {
+        options->cpu = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--out") == 0 && hasValue)
+    {
+        options->outputPath = argv[++i];
+    }
+    else
+    {
+        return false;
+    }
+    *index = i;
+    return true;
+}
+
+FILE *OpenBenchOutput(BenchOptions options)
+{
+    if (!options.outputPath)
+    {
+        return stdout;
+    }
+    FILE *file = fopen(options.outputPath, "w");
+    if (!file)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Output fail : %s\n", options.outputPath);
+    }
+    return file;
+}
+
+void CloseBenchOutput(FILE *file)
+{
+    if (file && file != stdout)
+    {
+        fclose(file);
+    }
+}
+
+void WriteBenchHeader(FILE *file, const char *suite, BenchOptions options, bool pinned)
+{
+    fprintf(file, "{\n  \"suite\": \"%s\",\n  \"seed\": %llu,\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"cpu\": %d,\n  \"pinned\": %s,\n",
+            suite, (unsigned long long)options.seed, options.warmupReps, options.reps, options.cpu, pinned ? "true" : "false");
+}
+
+void WriteBenchResult(FILE *file, BenchResult result, bool last)
+{
+    fprintf(file, "    {\"name\": \"%s\", \"ops_per_rep\": %d, \"reps\": %d, \"min_ns_per_op\": %.3f, \"median_ns_per_op\": %.3f, \"mean_ns_per_op\": %.3f}%s\n",
+            result.name, result.opsPerRep, result.reps, result.minNsPerOp, result.medianNsPerOp, result.meanNsPerOp, last ? "" : ",");
+}
+
+#endif
@@ -0,0 +1,254 @@
+#define RAYCASTER_NO_MAIN
+#include "raycaster.cpp"
+#include "benchutil.h"
+#include "mapgen.h"
+
+// Offline BSP level compiler.
+//
+// Turns the wall faces of a generated map, or the built-in one, into
+// segments, adds the walls of a --walls file and --random-walls random ones,
+// builds the tree and writes it with --out, checking that the file loads
+// back to the same tree. Then renders random views from open tiles with the
+// tree and checks every column against tracing the same segments per ray
+// through the walls BVH, timing both. Results are written as JSON.
+
+Vec2 RandomOpenPosition(BenchRng *rng)
+{
+    int x, y;
+    do
+    {
+        x = RandomInt(rng, 0, world.width);
+        y = RandomInt(rng, 0, world.height);
+    } while (world.tiles[TileIndex(world, x, y)] != _);
+
+    return Vec2(x, y);
+}
+
+bool IsSameBsp(const BspTree *a, const BspTree *b)
+{
+    return a->nodeCount == b->nodeCount && a->segCount == b->segCount && a->depth == b->depth &&
+           memcmp(a->nodes, b->nodes, a->nodeCount * sizeof(BspNode)) == 0 &&
+           memcmp(a->segs, b->segs, a->segCount * sizeof(BspSeg)) == 0;
+}
+
+// Same hit and ray distance within a hundredth of a pixel.
+bool IsSameHit(const RayHits::Data *a, const RayHits::Data *b)
+{
+    return a->wasHit == b->wasHit && (!a->wasHit || fabsf(a->distanceFromPlayer - b->distanceFromPlayer) < 0.01f);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options = {0};
+    options.seed = 1;
+    options.warmupReps = 1;
+    options.reps = 5;
+
+    int mapKind = MapKind_Maze;
+    bool builtInMap = false;
+    int size = 256;
+    int randomWallCount = 0;
+    int viewCount = 256;
+    int rayCount = 480;
+    const char *wallsPath = NULL;
+    const char *outPath = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--map") == 0 && hasValue)
+        {
+            const char *name = argv[++i];
+            builtInMap = strcmp(name, "builtin") == 0;
+            mapKind = MapKind_Count;
+            for (int kind = 0; kind < MapKind_Count; ++kind)
+            {
+                if (strcmp(name, MapKindNames[kind]) == 0)
+                {
+                    mapKind = kind;
+                }
+            }
+            if (!builtInMap && mapKind == MapKind_Count)
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown map : %s\n", name);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--size") == 0 && hasValue)
+        {
+            size = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--view-distance") == 0 && hasValue)
+        {
+            viewDistance = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--walls") == 0 && hasValue)
+        {
+            wallsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--random-walls") == 0 && hasValue)
+        {
+            int count = atoi(argv[++i]);
+            randomWallCount = SDL_max(0, count);
+        }
+        else if (strcmp(argv[i], "--views") == 0 && hasValue)
+        {
+            int count = atoi(argv[++i]);
+            viewCount = SDL_max(1, count);
+        }
+        else if (strcmp(argv[i], "--rays") == 0 && hasValue)
+        {
+            int count = atoi(argv[++i]);
+            rayCount = SDL_min(SDL_max(1, count), MaxRayCount);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && hasValue)
+        {
+            outPath = argv[++i];
+        }
+        else if (!ParseBenchOption(argc, argv, &i, &options))
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown argument : %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    bool pinned = PinToCpu(options.cpu);
+
+    GeneratedMap generated = {0};
+    if (!builtInMap)
+    {
+        generated = GenerateMap((MapKind)mapKind, size, options.seed, 2);
+        SetWorld(generated.map);
+    }
+
+    WallSegment *segments = NULL;
+    int segmentCount = 0;
+    int segmentCapacity = 0;
+    AppendTileFaces(world, &segments, &segmentCount, &segmentCapacity);
+    int faceCount = segmentCount;
+    if (wallsPath && !ReadWallSegments(wallsPath, &segments, &segmentCount, &segmentCapacity))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Walls load fail : %s\n", wallsPath);
+        return 1;
+    }
+    if (randomWallCount)
+    {
+        WallSegment *random = GenerateWalls(&world, randomWallCount, options.seed);
+        for (int i = 0; i < randomWallCount; ++i)
+        {
+            AppendWallSegment(&segments, &segmentCount, &segmentCapacity, random[i]);
+        }
+        free(random);
+    }
+
+    Uint64 buildStart = SDL_GetPerformanceCounter();
+    BuildBsp(&bsp, segments, segmentCount);
+    double buildMs = CounterToNs(SDL_GetPerformanceCounter() - buildStart) * 1e-6;
+    size_t bytes = sizeof(BspMagic) + sizeof(BspVersion) + 2 * sizeof(Sint32) +
+                   bsp.nodeCount * sizeof(BspNode) + bsp.segCount * sizeof(BspSeg);
+
+    if (outPath)
+    {
+        BspTree loaded = {0};
+        if (!SaveBsp(&bsp, outPath))
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "BSP save fail : %s\n", outPath);
+            return 1;
+        }
+        if (!LoadBsp(&loaded, outPath) || !IsSameBsp(&bsp, &loaded))
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "BSP load mismatch : %s\n", outPath);
+            return 1;
+        }
+        FreeBsp(&loaded);
+    }
+
+    // The reference traces every ray through the same segments.
+    BuildWalls(segments, segmentCount);
+    free(segments);
+
+    Texture texture = LoadTexture("walltext.png");
+    ScreenBuffer buffer = CreateScreenBuffer(NULL, MapDimsInPixels.x + rayCount, 1);
+    RayHits *bspHits = (RayHits *) calloc(1, sizeof(RayHits));
+    RayHits *wallHits = (RayHits *) calloc(1, sizeof(RayHits));
+
+    BenchRng rng = { options.seed * 0x9E3779B97F4A7C15ULL + 1 };
+    WorldPosition *positions = (WorldPosition *) malloc(viewCount * sizeof(WorldPosition));
+    float *angles = (float *) malloc(viewCount * sizeof(float));
+    for (int view = 0; view < viewCount; ++view)
+    {
+        Vec2 tile = RandomOpenPosition(&rng);
+        Vec2 offset(RandomFloat(&rng, 0, TileDimsInPixels.x), RandomFloat(&rng, 0, TileDimsInPixels.y));
+        positions[view] = MakeWorldPosition((int)tile.x, (int)tile.y, offset);
+        angles[view] = RandomFloat(&rng, 0, 360);
+    }
+
+    int mismatches = 0;
+    double bspNs = 0;
+    double wallsNs = 0;
+    for (int rep = 0; rep < options.warmupReps + options.reps; ++rep)
+    {
+        bool measured = rep >= options.warmupReps;
+        if (rep == options.warmupReps)
+        {
+            bspCounts = BspCounts {};
+        }
+        for (int view = 0; view < viewCount; ++view)
+        {
+            player.position = positions[view];
+            player.facingAngle = angles[view];
+
+            Uint64 bspStart = SDL_GetPerformanceCounter();
+            ClearHits(bspHits, rayCount);
+            DrawRaysBsp(buffer, texture, bspHits);
+            Uint64 wallsStart = SDL_GetPerformanceCounter();
+            ClearHits(wallHits, rayCount);
+            CastWalls(buffer, texture, wallHits);
+            Uint64 wallsEnd = SDL_GetPerformanceCounter();
+
+            if (measured)
+            {
+                bspNs += CounterToNs(wallsStart - bspStart);
+                wallsNs += CounterToNs(wallsEnd - wallsStart);
+            }
+            if (rep == 0)
+            {
+                for (int column = 0; column < rayCount; ++column)
+                {
+                    mismatches += !IsSameHit(&bspHits->data[column], &wallHits->data[column]);
+                }
+            }
+        }
+    }
+
+    FILE *output = OpenBenchOutput(options);
+    if (!output)
+    {
+        return 1;
+    }
+
+    double frames = (double)options.reps * viewCount;
+    WriteBenchHeader(output, "bsp", options, pinned);
+    fprintf(output, "  \"map\": \"%s\",\n  \"tiles\": %d,\n  \"view_distance\": %d,\n  \"rays\": %d,\n  \"views\": %d,\n",
+            builtInMap ? "builtin" : MapKindNames[mapKind], world.width, (int)viewDistance, rayCount, viewCount);
+    fprintf(output, "  \"faces\": %d,\n  \"segments\": %d,\n  \"bsp_segments\": %d,\n  \"nodes\": %d,\n  \"depth\": %d,\n  \"build_ms\": %.3f,\n  \"bytes\": %zu,\n",
+            faceCount, segmentCount, bsp.segCount, bsp.nodeCount, bsp.depth, buildMs, bytes);
+    fprintf(output, "  \"nodes_per_frame\": %.1f,\n  \"segments_drawn_per_frame\": %.1f,\n  \"mismatched_columns\": %d,\n",
+            bspCounts.nodes / frames, bspCounts.segs / frames, mismatches);
+    fprintf(output, "  \"bsp_ms_per_frame\": %.4f,\n  \"walls_ms_per_frame\": %.4f\n}\n", bspNs * 1e-6 / frames, wallsNs * 1e-6 / frames);
+    CloseBenchOutput(output);
+
+    free(angles);
+    free(positions);
+    free(wallHits);
+    free(bspHits);
+    free(buffer.memory);
+    FreeWalls();
+    FreeBsp(&bsp);
+    if (!builtInMap)
+    {
+        SetWorld(TileMap { (int)MapDimsInTiles.x, (int)MapDimsInTiles.y, Map });
+        FreeGeneratedMap(&generated);
+    }
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,834 @@
+#ifndef BSP_H
+#define BSP_H
+
+#include <limits.h>
+#include <stdio.h>
+
+// Binary space partition renderer for segment levels.
+//
+// BuildBsp splits a level's wall segments into a tree. Every node picks one
+// of its segments' lines as the partition. The segments on that line stay in
+// the node, the ones in front and behind go to the two children, and the
+// ones crossing it are cut in two. bsp.cpp builds levels offline and saves
+// them with SaveBsp, the --bsp option loads one with LoadBsp.
+//
+// The renderer walks the tree front to back. At each node, the child on the
+// eye's side comes first, then the node's own segments, then the other child.
+// The columns a segment covers are filled only where no nearer segment
+// filled them already, and closed after. Closed columns are kept as a sorted
+// list of ranges like Doom's solid segs. So every column is written exactly
+// once, with its nearest segment. Children whose box is out of view, past
+// the view distance or behind closed columns are skipped, so the cost
+// depends on what is visible rather than on the size of the level.
+//
+// Segments are walls seen from both sides. The level replaces the tile world
+// in the FPS view, the minimap keeps the tiles and draws the segments drawn
+// on top. Tile maps become segment levels through AppendTileFaces, which
+// merges the faces of every wall run into one segment.
+
+const char BspMagic[4] = {'R', 'C', 'B', 'S'};
+const Uint32 BspVersion = 1;
+
+// Segment ends closer than this to a partition line count as on it.
+const float BspEpsilon = 1.0f / 64.0f;
+// Segments tried as the partition of every node, and what one cut costs
+// against the difference in size of the two sides.
+const int BspCandidates = 16;
+const int BspSplitCost = 8;
+// Segments are clipped this far in front of the eye before projecting.
+const float BspNearPixels = 0.01f;
+
+struct BspSeg
+{
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+    Uint32 tile;
+};
+
+struct BspNode
+{
+    // Partition line through x, y along the unit vector dx, dy. Front is to
+    // the left of it, where the cross product with dx, dy is positive.
+    float x;
+    float y;
+    float dx;
+    float dy;
+    // Boxes of the front and back subtrees, min x, min y, max x, max y.
+    float bounds[2][4];
+    // Front and back child, -1 for none. Always after the node itself.
+    Sint32 children[2];
+    // Segments on the partition line, pointing along it and sorted by where
+    // they start, and the length of the longest one.
+    Uint32 firstSeg;
+    Uint32 segCount;
+    float longestSeg;
+};
+
+struct BspTree
+{
+    int nodeCount;
+    int segCount;
+    int depth;
+    BspNode *nodes;
+    BspSeg *segs;
+};
+
+BspTree bsp;
+
+void FreeBsp(BspTree *tree)
+{
+    free(tree->nodes);
+    free(tree->segs);
+    *tree = BspTree {};
+}
+
+inline TileType GetMapTile(TileMap map, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= map.width || y >= map.height)
+    {
+        return A;
+    }
+    return map.tiles[TileIndex(map, x, y)];
+}
+
+// Adds the faces between open tiles and walls, in pixels, merging runs of
+// faces along the same line that belong to the same kind of wall.
+void AppendTileFaces(TileMap map, WallSegment **segments, int *count, int *capacity)
+{
+    const float tileWidth = TileDimsInPixels.x;
+    const float tileHeight = TileDimsInPixels.y;
+
+    // Faces across y first, then across x; side -1 is the wall before the
+    // open tile, 1 the one after it.
+    for (int acrossX = 0; acrossX < 2; ++acrossX)
+    {
+        int lines = acrossX ? map.width : map.height;
+        int along = acrossX ? map.height : map.width;
+        for (int line = 0; line < lines; ++line)
+        {
+            for (int side = -1; side <= 1; side += 2)
+            {
+                int runStart = 0;
+                TileType runTile = _;
+                for (int i = 0; i <= along; ++i)
+                {
+                    TileType tile = _;
+                    if (i < along)
+                    {
+                        int x = acrossX ? line : i;
+                        int y = acrossX ? i : line;
+                        if (GetMapTile(map, x, y) == _)
+                        {
+                            tile = acrossX ? GetMapTile(map, x + side, y) : GetMapTile(map, x, y + side);
+                        }
+                    }
+                    if (tile == runTile)
+                    {
+                        continue;
+                    }
+                    if (runTile != _)
+                    {
+                        float plane = (float)(side < 0 ? line : line + 1);
+                        WallSegment segment;
+                        if (acrossX)
+                        {
+                            segment = WallSegment { plane * tileWidth, runStart * tileHeight, plane * tileWidth, i * tileHeight, runTile };
+                        }
+                        else
+                        {
+                            segment = WallSegment { runStart * tileWidth, plane * tileHeight, i * tileWidth, plane * tileHeight, runTile };
+                        }
+                        AppendWallSegment(segments, count, capacity, segment);
+                    }
+                    runStart = i;
+                    runTile = tile;
+                }
+            }
+        }
+    }
+}
+
+struct BspBuilder
+{
+    BspNode *nodes;
+    int nodeCount;
+    int nodeCapacity;
+    BspSeg *segs;
+    int segCount;
+    int segCapacity;
+    int depth;
+};
+
+// Distance of a point from the line, positive in front.
+inline float BspSide(float lineX, float lineY, float dx, float dy, float x, float y)
+{
+    return dx * (y - lineY) - dy * (x - lineX);
+}
+
+inline int ClassifySide(float side)
+{
+    return side > BspEpsilon ? 1 : (side < -BspEpsilon ? -1 : 0);
+}
+
+inline float GetSegmentLength(const WallSegment *segment)
+{
+    return sqrtf((segment->x1 - segment->x0) * (segment->x1 - segment->x0) + (segment->y1 - segment->y0) * (segment->y1 - segment->y0));
+}
+
+void GetSegmentBounds(const WallSegment *segments, int count, float *bounds)
+{
+    bounds[0] = bounds[1] = INFINITY;
+    bounds[2] = bounds[3] = -INFINITY;
+    for (int i = 0; i < count; ++i)
+    {
+        bounds[0] = SDL_min(bounds[0], SDL_min(segments[i].x0, segments[i].x1));
+        bounds[1] = SDL_min(bounds[1], SDL_min(segments[i].y0, segments[i].y1));
+        bounds[2] = SDL_max(bounds[2], SDL_max(segments[i].x0, segments[i].x1));
+        bounds[3] = SDL_max(bounds[3], SDL_max(segments[i].y0, segments[i].y1));
+    }
+}
+
+// Index of the candidate with the fewest cuts and the most even sides.
+int ChooseBspPartition(const WallSegment *segments, int count)
+{
+    int best = 0;
+    int bestScore = INT_MAX;
+    int step = SDL_max(1, count / BspCandidates);
+    for (int candidate = 0; candidate < count; candidate += step)
+    {
+        const WallSegment *line = &segments[candidate];
+        float length = GetSegmentLength(line);
+        float dx = (line->x1 - line->x0) / length;
+        float dy = (line->y1 - line->y0) / length;
+
+        int front = 0;
+        int back = 0;
+        int cuts = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            int sideA = ClassifySide(BspSide(line->x0, line->y0, dx, dy, segments[i].x0, segments[i].y0));
+            int sideB = ClassifySide(BspSide(line->x0, line->y0, dx, dy, segments[i].x1, segments[i].y1));
+            if (sideA * sideB < 0)
+            {
+                ++cuts;
+            }
+            else if (sideA + sideB > 0)
+            {
+                ++front;
+            }
+            else if (sideA + sideB < 0)
+            {
+                ++back;
+            }
+        }
+        int score = cuts * BspSplitCost + abs(front - back);
+        if (score < bestScore)
+        {
+            bestScore = score;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+// Where the segment starts along the node's line.
+inline float GetBspSegStart(const BspNode *node, const BspSeg *seg)
+{
+    return (seg->x0 - node->x) * node->dx + (seg->y0 - node->y) * node->dy;
+}
+
+int CompareBspSegStarts(const void *a, const void *b)
+{
+    float startA = *(const float *)a;
+    float startB = *(const float *)b;
+    return (startA > startB) - (startA < startB);
+}
+
+// Points the node's segments along its line and sorts them by their start.
+void SortBspSegs(BspBuilder *builder, BspNode *node)
+{
+    struct SortEntry
+    {
+        float start;
+        BspSeg seg;
+    };
+    SortEntry *entries = (SortEntry *) malloc(SDL_max(node->segCount, 1u) * sizeof(SortEntry));
+    BspSeg *segs = builder->segs + node->firstSeg;
+    for (Uint32 i = 0; i < node->segCount; ++i)
+    {
+        BspSeg seg = segs[i];
+        if ((seg.x1 - seg.x0) * node->dx + (seg.y1 - seg.y0) * node->dy < 0)
+        {
+            seg = BspSeg { seg.x1, seg.y1, seg.x0, seg.y0, seg.tile };
+        }
+        entries[i].start = GetBspSegStart(node, &seg);
+        entries[i].seg = seg;
+        node->longestSeg = SDL_max(node->longestSeg, (seg.x1 - seg.x0) * node->dx + (seg.y1 - seg.y0) * node->dy);
+    }
+    qsort(entries, node->segCount, sizeof(SortEntry), CompareBspSegStarts);
+    for (Uint32 i = 0; i < node->segCount; ++i)
+    {
+        segs[i] = entries[i].seg;
+    }
+    free(entries);
+}
+
+// Builds the subtree of the given segments, which it frees, and returns its
+// node. Every node keeps at least its partition segment, so this ends.
+Sint32 BuildBspNode(BspBuilder *builder, WallSegment *segments, int count, int depth)
+{
+    const WallSegment line = segments[ChooseBspPartition(segments, count)];
+    float length = GetSegmentLength(&line);
+
+    if (builder->nodeCount == builder->nodeCapacity)
+    {
+        builder->nodeCapacity = SDL_max(64, builder->nodeCapacity * 2);
+        builder->nodes = (BspNode *) realloc(builder->nodes, builder->nodeCapacity * sizeof(BspNode));
+    }
+    Sint32 nodeIndex = builder->nodeCount++;
+    builder->depth = SDL_max(builder->depth, depth + 1);
+
+    BspNode node = {};
+    node.x = line.x0;
+    node.y = line.y0;
+    node.dx = (line.x1 - line.x0) / length;
+    node.dy = (line.y1 - line.y0) / length;
+    node.firstSeg = builder->segCount;
+
+    WallSegment *sides[2];
+    int sideCounts[2] = { 0, 0 };
+    int sideCapacity[2] = { 0, 0 };
+    sides[0] = sides[1] = NULL;
+    for (int i = 0; i < count; ++i)
+    {
+        const WallSegment *segment = &segments[i];
+        float sideA = BspSide(node.x, node.y, node.dx, node.dy, segment->x0, segment->y0);
+        float sideB = BspSide(node.x, node.y, node.dx, node.dy, segment->x1, segment->y1);
+        int classA = ClassifySide(sideA);
+        int classB = ClassifySide(sideB);
+
+        if (classA == 0 && classB == 0)
+        {
+            if (builder->segCount == builder->segCapacity)
+            {
+                builder->segCapacity = SDL_max(64, builder->segCapacity * 2);
+                builder->segs = (BspSeg *) realloc(builder->segs, builder->segCapacity * sizeof(BspSeg));
+            }
+            builder->segs[builder->segCount++] = BspSeg { segment->x0, segment->y0, segment->x1, segment->y1, segment->tile };
+        }
+        else if (classA * classB < 0)
+        {
+            // Cut where it crosses the line, each half to its side.
+            float along = sideA / (sideA - sideB);
+            float cutX = segment->x0 + (segment->x1 - segment->x0) * along;
+            float cutY = segment->y0 + (segment->y1 - segment->y0) * along;
+            WallSegment first = { segment->x0, segment->y0, cutX, cutY, segment->tile };
+            WallSegment second = { cutX, cutY, segment->x1, segment->y1, segment->tile };
+            int firstSide = classA > 0 ? 0 : 1;
+            AppendWallSegment(&sides[firstSide], &sideCounts[firstSide], &sideCapacity[firstSide], first);
+            AppendWallSegment(&sides[1 - firstSide], &sideCounts[1 - firstSide], &sideCapacity[1 - firstSide], second);
+        }
+        else
+        {
+            int side = classA + classB > 0 ? 0 : 1;
+            AppendWallSegment(&sides[side], &sideCounts[side], &sideCapacity[side], *segment);
+        }
+    }
+    free(segments);
+    node.segCount = builder->segCount - node.firstSeg;
+    SortBspSegs(builder, &node);
+
+    for (int side = 0; side < 2; ++side)
+    {
+        GetSegmentBounds(sides[side], sideCounts[side], node.bounds[side]);
+        node.children[side] = sideCounts[side] ? BuildBspNode(builder, sides[side], sideCounts[side], depth + 1) : -1;
+    }
+    builder->nodes[nodeIndex] = node;
+    return nodeIndex;
+}
+
+// Replaces tree with one built from the segments that have a length.
+void BuildBsp(BspTree *tree, const WallSegment *segments, int count)
+{
+    FreeBsp(tree);
+    WallSegment *copy = (WallSegment *) malloc((size_t)SDL_max(count, 1) * sizeof(WallSegment));
+    int copyCount = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (GetSegmentLength(&segments[i]) > 0)
+        {
+            copy[copyCount++] = segments[i];
+        }
+    }
+    if (!copyCount)
+    {
+        free(copy);
+        return;
+    }
+
+    BspBuilder builder = {0};
+    BuildBspNode(&builder, copy, copyCount, 0);
+
+    tree->nodeCount = builder.nodeCount;
+    tree->segCount = builder.segCount;
+    tree->depth = builder.depth;
+    tree->nodes = builder.nodes;
+    tree->segs = builder.segs;
+}
+
+bool SaveBsp(const BspTree *tree, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    Sint32 header[2] = { tree->nodeCount, tree->segCount };
+    bool written =
+        fwrite(BspMagic, sizeof(BspMagic), 1, file) == 1 &&
+        fwrite(&BspVersion, sizeof(BspVersion), 1, file) == 1 &&
+        fwrite(header, sizeof(header), 1, file) == 1 &&
+        fwrite(tree->nodes, sizeof(BspNode), tree->nodeCount, file) == (size_t)tree->nodeCount &&
+        fwrite(tree->segs, sizeof(BspSeg), tree->segCount, file) == (size_t)tree->segCount;
+    return fclose(file) == 0 && written;
+}
+
+bool LoadBsp(BspTree *result, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    char magic[4];
+    Uint32 version;
+    Sint32 header[2];
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        fread(header, sizeof(header), 1, file) != 1 ||
+        memcmp(magic, BspMagic, sizeof(magic)) != 0 ||
+        version != BspVersion ||
+        header[0] < 0 || header[1] < 0)
+    {
+        fclose(file);
+        return false;
+    }
+
+    BspTree loaded = {0};
+    loaded.nodeCount = header[0];
+    loaded.segCount = header[1];
+    loaded.nodes = (BspNode *) malloc(SDL_max(loaded.nodeCount, 1) * sizeof(BspNode));
+    loaded.segs = (BspSeg *) malloc(SDL_max(loaded.segCount, 1) * sizeof(BspSeg));
+    bool valid =
+        fread(loaded.nodes, sizeof(BspNode), loaded.nodeCount, file) == (size_t)loaded.nodeCount &&
+        fread(loaded.segs, sizeof(BspSeg), loaded.segCount, file) == (size_t)loaded.segCount;
+    fclose(file);
+
+    // Children come after their parent and have only that one, so one pass
+    // in order finds the depth, and a broken file can neither loop nor
+    // reach a node twice and grow deeper than the stack sized from it.
+    int *depths = (int *) calloc(SDL_max(loaded.nodeCount, 1), sizeof(int));
+    for (int i = 0; valid && i < loaded.nodeCount; ++i)
+    {
+        const BspNode *node = &loaded.nodes[i];
+        depths[i] = SDL_max(depths[i], 1);
+        loaded.depth = SDL_max(loaded.depth, depths[i]);
+        valid = (Uint64)node->firstSeg + node->segCount <= (Uint64)loaded.segCount;
+        for (int side = 0; valid && side < 2; ++side)
+        {
+            Sint32 child = node->children[side];
+            valid = child == -1 || (child > i && child < loaded.nodeCount && depths[child] == 0);
+            if (valid && child != -1)
+            {
+                depths[child] = depths[i] + 1;
+            }
+        }
+    }
+    for (int i = 0; valid && i < loaded.segCount; ++i)
+    {
+        valid = loaded.segs[i].tile > _ && loaded.segs[i].tile <= C;
+    }
+    free(depths);
+
+    if (!valid)
+    {
+        FreeBsp(&loaded);
+        return false;
+    }
+
+    FreeBsp(result);
+    *result = loaded;
+    return true;
+}
+
+// Nodes visited and segments drawn, for the benchmarks.
+struct BspCounts
+{
+    Uint64 frames;
+    Uint64 nodes;
+    Uint64 segs;
+};
+
+BspCounts bspCounts;
+
+struct BspColumnRange
+{
+    int first;
+    int last;
+};
+
+struct BspFrame
+{
+    ScreenBuffer buffer;
+    Texture texture;
+    RayHits *hits;
+    // World pixels the minimap shows.
+    float minimapX;
+    float minimapY;
+    float minimapWidth;
+    float minimapHeight;
+    float eyeX;
+    float eyeY;
+    float forwardX;
+    float forwardY;
+    int rayCount;
+    float angle[MaxRayCount];
+    float cos[MaxRayCount];
+    float sin[MaxRayCount];
+    // Closed columns, sorted and apart, between two sentinels outside the
+    // view. A single range is left once every column is closed.
+    BspColumnRange closed[MaxRayCount + 2];
+    int closedCount;
+    // Traversal stack, node index times two plus one for drawing its
+    // segments rather than visiting it.
+    Sint32 *stack;
+    int stackCapacity;
+};
+
+BspFrame bspFrame;
+
+// First closed range that ends at or after column.
+inline int FindClosedRange(const BspFrame *frame, int column)
+{
+    int low = 0;
+    int high = frame->closedCount - 1;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (frame->closed[middle].last < column)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+inline bool IsRangeClosed(const BspFrame *frame, int first, int last)
+{
+    const BspColumnRange *range = &frame->closed[FindClosedRange(frame, first)];
+    return range->first <= first && range->last >= last;
+}
+
+// Angle of a point relative to the facing angle, in [-180, 180).
+inline float GetViewAngle(float x, float y)
+{
+    float angle = atan2f(y, x) / AngleToRadian - player.facingAngle;
+    return angle - 360.0f * floorf((angle + 180.0f) / 360.0f);
+}
+
+// Columns whose rays are between the two angles, widened by two columns on
+// each side. False when none are.
+bool GetColumnsBetween(const BspFrame *frame, float low, float high, int *first, int *last)
+{
+    float columnsPerDegree = frame->rayCount / player.fov;
+    *first = SDL_max(0, FloorToInt((low + player.fov * 0.5f) * columnsPerDegree) - 2);
+    *last = SDL_min(frame->rayCount - 1, FloorToInt((high + player.fov * 0.5f) * columnsPerDegree) + 3);
+    return *first <= *last;
+}
+
+// Whether the column's ray passes between the two points, relative to the
+// eye and in front of it. Segments sharing an end point agree on its columns.
+inline bool IsRayBetween(const BspFrame *frame, int column, float ax, float ay, float bx, float by)
+{
+    float crossA = frame->cos[column] * ay - frame->sin[column] * ax;
+    float crossB = frame->cos[column] * by - frame->sin[column] * bx;
+    return crossA * crossB <= 0;
+}
+
+// Whether anything in the box could still show in an open column.
+bool IsBspBoxVisible(const BspFrame *frame, const float *bounds)
+{
+    float dx = SDL_max(0.0f, SDL_max(bounds[0] - frame->eyeX, frame->eyeX - bounds[2]));
+    float dy = SDL_max(0.0f, SDL_max(bounds[1] - frame->eyeY, frame->eyeY - bounds[3]));
+    if (!(dx * dx + dy * dy < viewDistance * viewDistance))
+    {
+        return false;
+    }
+    if (dx == 0 && dy == 0)
+    {
+        return frame->closedCount > 1;
+    }
+
+    float cornersX[4] = { bounds[0], bounds[2], bounds[0], bounds[2] };
+    float cornersY[4] = { bounds[1], bounds[1], bounds[3], bounds[3] };
+    float low = 180.0f;
+    float high = -180.0f;
+    int behind = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        float x = cornersX[i] - frame->eyeX;
+        float y = cornersY[i] - frame->eyeY;
+        if (x * frame->forwardX + y * frame->forwardY <= BspNearPixels)
+        {
+            ++behind;
+            continue;
+        }
+        float angle = GetViewAngle(x, y);
+        low = SDL_min(low, angle);
+        high = SDL_max(high, angle);
+    }
+    if (behind == 4)
+    {
+        return false;
+    }
+
+    // A box reaching behind the eye can cover any column.
+    int first = 0;
+    int last = frame->rayCount - 1;
+    if (!behind && !GetColumnsBetween(frame, low, high, &first, &last))
+    {
+        return false;
+    }
+    return !IsRangeClosed(frame, first, last);
+}
+
+void DrawBspColumns(BspFrame *frame, const BspSeg *seg, int first, int last)
+{
+    float wx = seg->x0 - frame->eyeX;
+    float wy = seg->y0 - frame->eyeY;
+    float ex = seg->x1 - seg->x0;
+    float ey = seg->y1 - seg->y0;
+    float cross = wx * ey - wy * ex;
+    for (int column = first; column <= last; ++column)
+    {
+        float distance = cross / (frame->cos[column] * ey - frame->sin[column] * ex);
+        // Seen edge on there is nothing to draw, but nothing behind it
+        // shows either.
+        if (distance > 0 && distance < viewDistance)
+        {
+            SetRayHit(frame->hits, column, frame->angle[column], distance, (TileType)seg->tile, frame->texture);
+        }
+    }
+}
+
+// Draws the open columns in [first, last] and closes all of them.
+void ClipSolidRange(BspFrame *frame, const BspSeg *seg, int first, int last)
+{
+    int column = first;
+    for (int i = FindClosedRange(frame, first); column <= last; ++i)
+    {
+        if (frame->closed[i].first > column)
+        {
+            DrawBspColumns(frame, seg, column, SDL_min(last, frame->closed[i].first - 1));
+        }
+        column = frame->closed[i].last + 1;
+    }
+
+    // Every range touching [first, last] merges into one.
+    int start = FindClosedRange(frame, first - 1);
+    int end = start;
+    while (end < frame->closedCount && frame->closed[end].first <= last + 1)
+    {
+        ++end;
+    }
+    BspColumnRange merged = { first, last };
+    if (end > start)
+    {
+        merged.first = SDL_min(first, frame->closed[start].first);
+        merged.last = SDL_max(last, frame->closed[end - 1].last);
+    }
+    int removed = end - start;
+    memmove(&frame->closed[start + 1], &frame->closed[end], (frame->closedCount - end) * sizeof(BspColumnRange));
+    frame->closed[start] = merged;
+    frame->closedCount += 1 - removed;
+}
+
+void DrawBspSeg(BspFrame *frame, const BspSeg *seg)
+{
+    float ax = seg->x0 - frame->eyeX;
+    float ay = seg->y0 - frame->eyeY;
+    float bx = seg->x1 - frame->eyeX;
+    float by = seg->y1 - frame->eyeY;
+    float forwardA = ax * frame->forwardX + ay * frame->forwardY;
+    float forwardB = bx * frame->forwardX + by * frame->forwardY;
+    if (forwardA <= BspNearPixels && forwardB <= BspNearPixels)
+    {
+        return;
+    }
+
+    // Only the part in front of the eye projects onto columns.
+    if (forwardA <= BspNearPixels || forwardB <= BspNearPixels)
+    {
+        float along = (BspNearPixels - forwardA) / (forwardB - forwardA);
+        float x = ax + (bx - ax) * along;
+        float y = ay + (by - ay) * along;
+        if (forwardA <= BspNearPixels)
+        {
+            ax = x;
+            ay = y;
+        }
+        else
+        {
+            bx = x;
+            by = y;
+        }
+    }
+
+    float angleA = GetViewAngle(ax, ay);
+    float angleB = GetViewAngle(bx, by);
+    int first, last;
+    if (!GetColumnsBetween(frame, SDL_min(angleA, angleB), SDL_max(angleA, angleB), &first, &last))
+    {
+        return;
+    }
+    while (first <= last && !IsRayBetween(frame, first, ax, ay, bx, by))
+    {
+        ++first;
+    }
+    while (last >= first && !IsRayBetween(frame, last, ax, ay, bx, by))
+    {
+        --last;
+    }
+    if (first > last)
+    {
+        return;
+    }
+
+    ClipSolidRange(frame, seg, first, last);
+    ++bspCounts.segs;
+    DrawMinimapSegment(frame->buffer, frame->minimapX, frame->minimapY, frame->minimapWidth, frame->minimapHeight,
+                       seg->x0, seg->y0, seg->x1 - seg->x0, seg->y1 - seg->y0, GetTileColor((TileType)seg->tile, frame->texture));
+}
+
+// Draws the node's segments within view distance, found from where they
+// start along its line.
+void DrawBspNodeSegs(BspFrame *frame, const BspNode *node)
+{
+    float offset = BspSide(node->x, node->y, node->dx, node->dy, frame->eyeX, frame->eyeY);
+    if (!(fabsf(offset) < viewDistance))
+    {
+        return;
+    }
+    float center = (frame->eyeX - node->x) * node->dx + (frame->eyeY - node->y) * node->dy;
+    float reach = sqrtf(viewDistance * viewDistance - offset * offset);
+    float from = center - reach - node->longestSeg;
+    float to = center + reach;
+
+    const BspSeg *segs = bsp.segs + node->firstSeg;
+    int low = 0;
+    int high = (int)node->segCount;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (GetBspSegStart(node, &segs[middle]) < from)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    for (int i = low; i < (int)node->segCount && GetBspSegStart(node, &segs[i]) <= to; ++i)
+    {
+        DrawBspSeg(frame, &segs[i]);
+    }
+}
+
+// LoadBsp bounds the depth, a full stack drops the entry rather than
+// writing past it.
+inline void PushBspEntry(BspFrame *frame, int *top, Sint32 entry)
+{
+    if (*top < frame->stackCapacity)
+    {
+        frame->stack[(*top)++] = entry;
+    }
+}
+
+// Fills the hits from the loaded tree, the minimap shows the segments drawn.
+void DrawRaysBsp(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    BspFrame *frame = &bspFrame;
+    frame->rayCount = hits->count;
+    if (!bsp.nodeCount || frame->rayCount <= 0)
+    {
+        return;
+    }
+
+    frame->buffer = buffer;
+    frame->texture = texture;
+    frame->hits = hits;
+    Vec2 minimapOrigin = TileToPixelPosition(GetMinimapOriginTile(buffer), TileDimsInPixels);
+    Vec2 minimapDims = TileToPixelPosition(GetMinimapDimsInTiles(buffer), TileDimsInPixels);
+    frame->minimapX = minimapOrigin.x;
+    frame->minimapY = minimapOrigin.y;
+    frame->minimapWidth = minimapDims.x;
+    frame->minimapHeight = minimapDims.y;
+    frame->eyeX = (float)TileOriginPixelX(player.position) + player.position.offset.x;
+    frame->eyeY = (float)TileOriginPixelY(player.position) + player.position.offset.y;
+    frame->forwardX = cosf(player.facingAngle * AngleToRadian);
+    frame->forwardY = sinf(player.facingAngle * AngleToRadian);
+    for (int column = 0; column < frame->rayCount; ++column)
+    {
+        GetColumnRay(column, frame->rayCount, &frame->angle[column], &frame->cos[column], &frame->sin[column]);
+    }
+    frame->closed[0] = BspColumnRange { -2, -1 };
+    frame->closed[1] = BspColumnRange { frame->rayCount, frame->rayCount + 1 };
+    frame->closedCount = 2;
+
+    // At most two entries per level are waiting at once.
+    int capacity = 2 * bsp.depth + 2;
+    if (frame->stackCapacity < capacity)
+    {
+        free(frame->stack);
+        frame->stack = (Sint32 *) malloc(capacity * sizeof(Sint32));
+        frame->stackCapacity = capacity;
+    }
+
+    int top = 0;
+    PushBspEntry(frame, &top, 0);
+    while (top > 0 && frame->closedCount > 1)
+    {
+        Sint32 entry = frame->stack[--top];
+        const BspNode *node = &bsp.nodes[entry >> 1];
+        if (entry & 1)
+        {
+            DrawBspNodeSegs(frame, node);
+            continue;
+        }
+
+        ++bspCounts.nodes;
+        int nearSide = BspSide(node->x, node->y, node->dx, node->dy, frame->eyeX, frame->eyeY) >= 0 ? 0 : 1;
+        int farSide = 1 - nearSide;
+        if (node->children[farSide] >= 0 && IsBspBoxVisible(frame, node->bounds[farSide]))
+        {
+            PushBspEntry(frame, &top, node->children[farSide] << 1);
+        }
+        PushBspEntry(frame, &top, entry | 1);
+        if (node->children[nearSide] >= 0 && IsBspBoxVisible(frame, node->bounds[nearSide]))
+        {
+            PushBspEntry(frame, &top, node->children[nearSide] << 1);
+        }
+    }
+    ++bspCounts.frames;
+}
+
+#endif
@@ -1,3 +1,11 @@
 #!/bin/bash
 
-c++ raycaster.cpp -o raycaster.o -lSDL2 -std=c++11 
\ No newline at end of file
+c++ raycaster.cpp -o raycaster.o -lSDL2 -std=c++11
+c++ bench.cpp -o bench.o -lSDL2 -std=c++11 -O2
+c++ flythrough.cpp -o flythrough.o -lSDL2 -std=c++11 -O2
+c++ pvs.cpp -o pvs.o -lSDL2 -std=c++11 -O2
+c++ bsp.cpp -o bsp.o -lSDL2 -std=c++11 -O2
+
+# Regression check against the stored reference images.
+./raycaster.o --golden golden
+./raycaster.o --heights golden/heights.txt --golden golden/heights
@@ -0,0 +1,459 @@
+#ifndef CHUNKS_H
+#define CHUNKS_H
+
+#include <stdio.h>
+
+// Chunked world streaming.
+//
+// Worlds too large to keep in memory are stored on disk as square chunks of
+// tiles and streamed through a fixed number of cache slots. A world is
+// streamed while world.tiles is NULL: GetTile then looks the tile up through
+// the chunk directory, and tiles of chunks that are not loaded yet read as
+// walls, so rays stop at the edge of what is resident.
+//
+// UpdateChunkStream runs once per frame on the main thread. It asks for the
+// chunks within the view distance of the player, nearest first, then for
+// the ones around a point a chunk ahead along the facing direction. A
+// background thread reads requested chunks into their slots; when every slot
+// is taken the least recently wanted chunk is evicted. Slots are only handed
+// to the loader and reused by the main thread, the loader only publishes a
+// filled slot, so lookups take no locks.
+//
+// Streaming makes frames depend on load timing. Call WaitForChunkLoads after
+// UpdateChunkStream where frames have to be reproducible. A renderer that
+// only draws on change can wait on readyWake and compare published counts.
+//
+// File layout: magic, version, width, height and chunk size in tiles, then
+// every chunk in row major order, chunkSize^2 tiles each. Tiles past the
+// map edge in the last row and column of chunks are stored as walls.
+
+const char ChunkMagic[4] = {'R', 'C', 'C', 'K'};
+const Uint32 ChunkVersion = 1;
+const int DefaultChunkSize = 64;
+
+enum ChunkSlotState
+{
+    ChunkSlot_Free,
+    ChunkSlot_Loading,
+    ChunkSlot_Ready
+};
+
+struct ChunkSlot
+{
+    TileType *tiles;
+    int chunk;
+    // ChunkSlotState, written by the loader once the tiles are in.
+    SDL_atomic_t state;
+    Uint32 lastWanted;
+};
+
+struct ChunkStream
+{
+    FILE *file;
+    Sint64 dataOffset;
+    int width;
+    int height;
+    int chunkShift;
+    int chunksX;
+    int chunksY;
+
+    // Slot per chunk, -1 when not resident.
+    Sint32 *slotOfChunk;
+    ChunkSlot *slots;
+    int slotCount;
+    Uint32 frame;
+
+    // Slots waiting for the loader, oldest first.
+    SDL_mutex *lock;
+    SDL_cond *wake;
+    SDL_cond *idle;
+    int *queue;
+    int queueHead;
+    int queueCount;
+    bool loading;
+    bool quit;
+    SDL_Thread *thread;
+    // Chunks the loader marked ready so far. readyWake, when set, is posted
+    // after each, under lock so it can be cleared safely.
+    SDL_atomic_t published;
+    SDL_sem *readyWake;
+
+    int loads;
+    int evictions;
+};
+
+ChunkStream chunkStream;
+
+inline bool IsWorldStreamed()
+{
+    return world.tiles == NULL && chunkStream.slots != NULL;
+}
+
+inline TileType GetStreamedTile(int tileX, int tileY)
+{
+    if ((unsigned)tileX >= (unsigned)chunkStream.width || (unsigned)tileY >= (unsigned)chunkStream.height)
+    {
+        return A;
+    }
+
+    int shift = chunkStream.chunkShift;
+    int slot = chunkStream.slotOfChunk[(tileX >> shift) + (tileY >> shift) * chunkStream.chunksX];
+    if (slot < 0 || SDL_AtomicGet(&chunkStream.slots[slot].state) != ChunkSlot_Ready)
+    {
+        return A;
+    }
+
+    int mask = (1 << shift) - 1;
+    return chunkStream.slots[slot].tiles[(tileX & mask) + ((tileY & mask) << shift)];
+}
+
+// Dynamic geometry reading tiles through the chunk directory.
+struct StreamedGeometry : DynamicGeometry
+{
+    static inline TileType GetTile(int tileX, int tileY)
+    {
+        return GetStreamedTile(tileX, tileY);
+    }
+};
+
+// Writes map as a chunk file. chunkSize has to be a power of two.
+bool SaveChunkedMap(TileMap map, const char *path, int chunkSize)
+{
+    if (!IsPowerOfTwo(chunkSize))
+    {
+        return false;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    Sint32 header[3] = { map.width, map.height, chunkSize };
+    bool written =
+        fwrite(ChunkMagic, sizeof(ChunkMagic), 1, file) == 1 &&
+        fwrite(&ChunkVersion, sizeof(ChunkVersion), 1, file) == 1 &&
+        fwrite(header, sizeof(header), 1, file) == 1;
+
+    int chunksX = (map.width + chunkSize - 1) / chunkSize;
+    int chunksY = (map.height + chunkSize - 1) / chunkSize;
+    TileType *row = (TileType *) malloc(chunkSize * sizeof(TileType));
+    for (int chunkY = 0; written && chunkY < chunksY; ++chunkY)
+    {
+        for (int chunkX = 0; written && chunkX < chunksX; ++chunkX)
+        {
+            for (int y = chunkY * chunkSize; written && y < (chunkY + 1) * chunkSize; ++y)
+            {
+                for (int i = 0; i < chunkSize; ++i)
+                {
+                    int x = chunkX * chunkSize + i;
+                    row[i] = (x < map.width && y < map.height) ? map.tiles[TileIndex(map, x, y)] : A;
+                }
+                written = fwrite(row, sizeof(TileType), chunkSize, file) == (size_t)chunkSize;
+            }
+        }
+    }
+    free(row);
+
+    return fclose(file) == 0 && written;
+}
+
+// Chunk files of large worlds pass 2GB, past what fseek takes everywhere.
+inline int SeekChunkFile(FILE *file, Sint64 offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+int SDLCALL ChunkLoader(void *data)
+{
+    ChunkStream *stream = (ChunkStream *) data;
+    int chunkSize = 1 << stream->chunkShift;
+    size_t chunkTiles = (size_t)chunkSize * chunkSize;
+
+    SDL_LockMutex(stream->lock);
+    for (;;)
+    {
+        while (!stream->quit && stream->queueCount == 0)
+        {
+            stream->loading = false;
+            SDL_CondBroadcast(stream->idle);
+            SDL_CondWait(stream->wake, stream->lock);
+        }
+        if (stream->quit)
+        {
+            break;
+        }
+
+        int slotIndex = stream->queue[stream->queueHead];
+        stream->queueHead = (stream->queueHead + 1) % stream->slotCount;
+        --stream->queueCount;
+        stream->loading = true;
+        SDL_UnlockMutex(stream->lock);
+
+        // The slot belongs to the loader until it is marked ready.
+        ChunkSlot *slot = &stream->slots[slotIndex];
+        Sint64 offset = stream->dataOffset + (Sint64)slot->chunk * chunkTiles * sizeof(TileType);
+        if (SeekChunkFile(stream->file, offset) != 0 ||
+            fread(slot->tiles, sizeof(TileType), chunkTiles, stream->file) != chunkTiles)
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Chunk read fail : %d\n", slot->chunk);
+            memset(slot->tiles, A, chunkTiles * sizeof(TileType));
+        }
+        SDL_AtomicSet(&slot->state, ChunkSlot_Ready);
+        SDL_AtomicAdd(&stream->published, 1);
+
+        SDL_LockMutex(stream->lock);
+        if (stream->readyWake)
+        {
+            SDL_SemPost(stream->readyWake);
+        }
+    }
+    SDL_UnlockMutex(stream->lock);
+    return 0;
+}
+
+void CloseChunkStream()
+{
+    ChunkStream *stream = &chunkStream;
+    if (stream->thread)
+    {
+        SDL_LockMutex(stream->lock);
+        stream->quit = true;
+        SDL_CondSignal(stream->wake);
+        SDL_UnlockMutex(stream->lock);
+        SDL_WaitThread(stream->thread, NULL);
+    }
+    if (stream->file)
+    {
+        fclose(stream->file);
+    }
+    for (int i = 0; stream->slots && i < stream->slotCount; ++i)
+    {
+        free(stream->slots[i].tiles);
+    }
+    free(stream->slots);
+    free(stream->slotOfChunk);
+    free(stream->queue);
+    SDL_DestroyCond(stream->wake);
+    SDL_DestroyCond(stream->idle);
+    SDL_DestroyMutex(stream->lock);
+    *stream = ChunkStream {0};
+}
+
+// Opens a chunk file and starts the loader. The cache gets as many slots as
+// fit in budgetBytes, at least one. On success the world is switched to the
+// stream.
+bool OpenChunkStream(const char *path, size_t budgetBytes)
+{
+    CloseChunkStream();
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    char magic[4];
+    Uint32 version;
+    Sint32 header[3];
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        fread(header, sizeof(header), 1, file) != 1 ||
+        memcmp(magic, ChunkMagic, sizeof(magic)) != 0 ||
+        version != ChunkVersion ||
+        header[0] <= 0 || header[1] <= 0 || !IsPowerOfTwo(header[2]))
+    {
+        fclose(file);
+        return false;
+    }
+
+    ChunkStream *stream = &chunkStream;
+    stream->file = file;
+    stream->dataOffset = ftell(file);
+    stream->width = header[0];
+    stream->height = header[1];
+    stream->chunkShift = Log2(header[2]);
+    stream->chunksX = (stream->width + header[2] - 1) / header[2];
+    stream->chunksY = (stream->height + header[2] - 1) / header[2];
+
+    size_t chunkCount = (size_t)stream->chunksX * stream->chunksY;
+    size_t chunkBytes = (size_t)header[2] * header[2] * sizeof(TileType);
+    stream->slotCount = (int)SDL_max((size_t)1, SDL_min(budgetBytes / chunkBytes, chunkCount));
+
+    stream->slotOfChunk = (Sint32 *) malloc(chunkCount * sizeof(Sint32));
+    memset(stream->slotOfChunk, 0xFF, chunkCount * sizeof(Sint32));
+    stream->slots = (ChunkSlot *) calloc(stream->slotCount, sizeof(ChunkSlot));
+    for (int i = 0; i < stream->slotCount; ++i)
+    {
+        stream->slots[i].tiles = (TileType *) malloc(chunkBytes);
+        stream->slots[i].chunk = -1;
+    }
+    stream->queue = (int *) malloc(stream->slotCount * sizeof(int));
+
+    stream->lock = SDL_CreateMutex();
+    stream->wake = SDL_CreateCond();
+    stream->idle = SDL_CreateCond();
+    stream->thread = SDL_CreateThread(ChunkLoader, "chunks", stream);
+    if (!stream->lock || !stream->wake || !stream->idle || !stream->thread)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Chunk loader fail : %s\n", SDL_GetError());
+        CloseChunkStream();
+        return false;
+    }
+
+    SetWorld(TileMap { stream->width, stream->height, NULL });
+    return true;
+}
+
+// Picks the slot wanted longest ago, never one still loading or wanted this
+// frame. -1 when there is none.
+int FindChunkVictim(ChunkStream *stream)
+{
+    int victim = -1;
+    for (int i = 0; i < stream->slotCount; ++i)
+    {
+        ChunkSlot *slot = &stream->slots[i];
+        if (slot->lastWanted == stream->frame || SDL_AtomicGet(&slot->state) == ChunkSlot_Loading)
+        {
+            continue;
+        }
+        if (victim < 0 || slot->lastWanted < stream->slots[victim].lastWanted)
+        {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+void WantChunk(ChunkStream *stream, int chunkX, int chunkY)
+{
+    if ((unsigned)chunkX >= (unsigned)stream->chunksX || (unsigned)chunkY >= (unsigned)stream->chunksY)
+    {
+        return;
+    }
+
+    int chunk = chunkX + chunkY * stream->chunksX;
+    int slotIndex = stream->slotOfChunk[chunk];
+    if (slotIndex >= 0)
+    {
+        stream->slots[slotIndex].lastWanted = stream->frame;
+        return;
+    }
+
+    slotIndex = FindChunkVictim(stream);
+    if (slotIndex < 0)
+    {
+        return;
+    }
+
+    ChunkSlot *slot = &stream->slots[slotIndex];
+    if (slot->chunk >= 0)
+    {
+        stream->slotOfChunk[slot->chunk] = -1;
+        ++stream->evictions;
+    }
+    slot->chunk = chunk;
+    slot->lastWanted = stream->frame;
+    SDL_AtomicSet(&slot->state, ChunkSlot_Loading);
+    stream->slotOfChunk[chunk] = slotIndex;
+    ++stream->loads;
+
+    // A slot is queued at most once, so the queue never overflows.
+    SDL_LockMutex(stream->lock);
+    stream->queue[(stream->queueHead + stream->queueCount) % stream->slotCount] = slotIndex;
+    ++stream->queueCount;
+    SDL_CondSignal(stream->wake);
+    SDL_UnlockMutex(stream->lock);
+}
+
+// Wants every chunk overlapping the square of radius pixels around center,
+// in rings of growing distance from it.
+void WantChunksAround(ChunkStream *stream, WorldPosition center, float radius)
+{
+    int chunkWidth = (int)TileDimsInPixels.x << stream->chunkShift;
+    int chunkHeight = (int)TileDimsInPixels.y << stream->chunkShift;
+    int originX = TileOriginPixelX(center);
+    int originY = TileOriginPixelY(center);
+    int centerX = FloorDiv(originX + (int)center.offset.x, chunkWidth);
+    int centerY = FloorDiv(originY + (int)center.offset.y, chunkHeight);
+    int minX = FloorDiv(originX + (int)floorf(center.offset.x - radius), chunkWidth);
+    int minY = FloorDiv(originY + (int)floorf(center.offset.y - radius), chunkHeight);
+    int maxX = FloorDiv(originX + (int)floorf(center.offset.x + radius), chunkWidth);
+    int maxY = FloorDiv(originY + (int)floorf(center.offset.y + radius), chunkHeight);
+    int rings = SDL_max(SDL_max(centerX - minX, maxX - centerX), SDL_max(centerY - minY, maxY - centerY));
+
+    for (int ring = 0; ring <= rings; ++ring)
+    {
+        for (int y = centerY - ring; y <= centerY + ring; ++y)
+        {
+            for (int x = centerX - ring; x <= centerX + ring; ++x)
+            {
+                bool onRing = x == centerX - ring || x == centerX + ring || y == centerY - ring || y == centerY + ring;
+                if (onRing && x >= minX && x <= maxX && y >= minY && y <= maxY)
+                {
+                    WantChunk(stream, x, y);
+                }
+            }
+        }
+    }
+}
+
+void UpdateChunkStream()
+{
+    ChunkStream *stream = &chunkStream;
+    if (!IsWorldStreamed())
+    {
+        return;
+    }
+
+    ++stream->frame;
+    WantChunksAround(stream, player.position, viewDistance);
+
+    float ahead = TileDimsInPixels.x * (1 << stream->chunkShift);
+    Vec2 heading(cosf(player.facingAngle * AngleToRadian), sinf(player.facingAngle * AngleToRadian));
+    WantChunksAround(stream, MoveWorldPosition(player.position, heading * ahead), viewDistance);
+}
+
+// Sets the semaphore the loader posts after publishing a chunk, NULL for
+// none.
+void SetChunkReadyWake(SDL_sem *wake)
+{
+    ChunkStream *stream = &chunkStream;
+    if (!stream->thread)
+    {
+        return;
+    }
+
+    SDL_LockMutex(stream->lock);
+    stream->readyWake = wake;
+    SDL_UnlockMutex(stream->lock);
+}
+
+inline int GetPublishedChunks()
+{
+    return SDL_AtomicGet(&chunkStream.published);
+}
+
+// Blocks until the loader has emptied its queue.
+void WaitForChunkLoads()
+{
+    ChunkStream *stream = &chunkStream;
+    if (!stream->thread)
+    {
+        return;
+    }
+
+    SDL_LockMutex(stream->lock);
+    while (stream->queueCount > 0 || stream->loading)
+    {
+        SDL_CondWait(stream->idle, stream->lock);
+    }
+    SDL_UnlockMutex(stream->lock);
+}
+
+#endif
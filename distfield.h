@@ -0,0 +1,164 @@
+#ifndef DISTFIELD_H
+#define DISTFIELD_H
+
+// Chessboard distance field over the world tiles.
+//
+// Every tile stores the Chebyshev distance in tiles to the nearest wall,
+// clamped to a byte: 0 for walls, 1 next to one. Tiles outside the map count
+// as walls, like GetTile. A tile at distance d is the centre of a
+// (2d - 1) tile wide square with no walls in it, so a ray can skip
+// (d - 1) * tile size pixels without looking at any tile.
+//
+// The field is built with two raster passes, linear in the tile count, the
+// first time it is used for a map.
+
+const int DistanceFieldMax = 255;
+
+struct DistanceField
+{
+    // worldGeneration the field was built for.
+    Uint32 generation;
+    int width;
+    int height;
+    Uint8 *distance;
+};
+
+DistanceField distanceField;
+
+inline int DistanceAt(int tileX, int tileY)
+{
+    if ((unsigned)tileX >= (unsigned)distanceField.width || (unsigned)tileY >= (unsigned)distanceField.height)
+    {
+        return 0;
+    }
+    return distanceField.distance[tileX + tileY * distanceField.width];
+}
+
+inline void RelaxDistance(int *value, int tileX, int tileY)
+{
+    *value = SDL_min(*value, DistanceAt(tileX, tileY) + 1);
+}
+
+void SweepDistanceField()
+{
+    for (int y = 0; y < world.height; ++y)
+    {
+        for (int x = 0; x < world.width; ++x)
+        {
+            int value = world.tiles[TileIndex(world, x, y)] == _ ? DistanceFieldMax : 0;
+            if (value)
+            {
+                RelaxDistance(&value, x - 1, y);
+                RelaxDistance(&value, x - 1, y - 1);
+                RelaxDistance(&value, x, y - 1);
+                RelaxDistance(&value, x + 1, y - 1);
+            }
+            distanceField.distance[x + y * distanceField.width] = value;
+        }
+    }
+
+    for (int y = world.height - 1; y >= 0; --y)
+    {
+        for (int x = world.width - 1; x >= 0; --x)
+        {
+            int value = distanceField.distance[x + y * distanceField.width];
+            if (value)
+            {
+                RelaxDistance(&value, x + 1, y);
+                RelaxDistance(&value, x + 1, y + 1);
+                RelaxDistance(&value, x, y + 1);
+                RelaxDistance(&value, x - 1, y + 1);
+            }
+            distanceField.distance[x + y * distanceField.width] = value;
+        }
+    }
+}
+
+void BuildDistanceField()
+{
+    size_t tileCount = (size_t)world.width * world.height;
+    if (tileCount > (size_t)distanceField.width * distanceField.height)
+    {
+        distanceField.distance = (Uint8 *) realloc(distanceField.distance, tileCount);
+    }
+    distanceField.generation = worldGeneration;
+    distanceField.width = world.width;
+    distanceField.height = world.height;
+    SweepDistanceField();
+}
+
+// The field follows the world: rebuilt when the map is swapped.
+void UpdateDistanceField()
+{
+    if (distanceField.generation != worldGeneration)
+    {
+        BuildDistanceField();
+    }
+}
+
+// DrawRays with the empty samples inside the wall-free square around the ray
+// skipped. Samples are taken at the same steps, so the hits are identical.
+// The field doubles as the wall test, walls and outside tiles are 0.
+//
+// It only beats the dispatched DrawRays when rays cross wide open space. In
+// the flythrough over a 256 tile arena at view distance 4800 it takes 1.7 ms
+// against 2.5 ms. On the built-in map the skips are short, and it is about
+// 2x slower in bench (156 against 87 us per frame), as it is in corridors.
+template<typename Geometry>
+void DrawRaysDistanceFieldKernel(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    const int skipPerTile = SDL_min(Geometry::TileWidthInPixels, Geometry::TileHeightInPixels);
+    const int sampleEnd = ceilf(viewDistance);
+    int rayCount = Geometry::ColumnCount(hits);
+    MinimapTrail trail = GetMinimapTrail(buffer);
+
+    for (int rayIndex = 0; rayIndex < rayCount; ++rayIndex)
+    {
+        float angle, cos, sin;
+        GetColumnRay(rayIndex, rayCount, &angle, &cos, &sin);
+
+        int i = 0;
+        for (; i < sampleEnd; i += 2)
+        {
+            Vec2 rayPixelPosition = GetRaySample(&trail, cos, sin, i);
+            int tileX = player.position.tileX + Geometry::FloorPixelToTileX(FloorToInt(rayPixelPosition.x));
+            int tileY = player.position.tileY + Geometry::FloorPixelToTileY(FloorToInt(rayPixelPosition.y));
+            int clearance = DistanceAt(tileX, tileY);
+
+            if (clearance == 0)
+            {
+                SetRayHit(hits, rayIndex, angle, Distance(Vec2(trail.eyeX, trail.eyeY), rayPixelPosition),
+                          Geometry::GetTile(tileX, tileY), texture);
+                break;
+            }
+
+            // The skip stops a pixel short of the square's edge, a sample's
+            // rounded position can be that far ahead of the exact ray.
+            if (clearance > 1)
+            {
+                i += (((clearance - 1) * skipPerTile - 1) & ~1) - 2;
+            }
+        }
+        DrawRayTrail(buffer, &trail, cos, sin, SDL_min(i, sampleEnd));
+    }
+}
+
+void DrawRaysDistanceField(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    UpdateDistanceField();
+
+    switch (SelectGeometry(hits))
+    {
+    case Geometry_BuiltIn:
+        DrawRaysDistanceFieldKernel<BuiltInGeometry>(buffer, texture, hits);
+        break;
+    case Geometry_Bricked:
+        DrawRaysDistanceFieldKernel<BrickedGeometry>(buffer, texture, hits);
+        break;
+    default:
+        DrawRaysDistanceFieldKernel<DynamicGeometry>(buffer, texture, hits);
+        break;
+    }
+}
+
+#endif
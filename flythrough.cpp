@@ -0,0 +1,362 @@
+#define RAYCASTER_NO_MAIN
+#include "raycaster.cpp"
+#include "benchutil.h"
+#include "mapgen.h"
+
+// End to end flythrough benchmark.
+//
+// For every map kind and size a camera follows the generated path at a fixed
+// speed while whole frames are rendered. Frame, DrawMap and DrawRays times are
+// reported per map size, view distance and resolution as JSON. With --stream
+// every map is written to the given chunk file first and streamed from it
+// within --chunk-budget megabytes. --layout bricked stores the maps in 8x8
+// tile bricks instead of rows; where the hardware counter is available the
+// last level cache misses of DrawRays are reported per frame too. --walls
+// scatters that many line segment walls over every map. --raycaster bsp
+// compiles every map's faces and walls into a BSP tree and renders that.
+
+const float CameraSpeed = 4.0f;
+const float CameraSweepDegrees = 30.0f;
+
+struct Camera
+{
+    const GeneratedMap *map;
+    int segment;
+    float segmentProgress;
+    Uint32 frame;
+};
+
+// Advances along the path and places the player on it. The view sweeps
+// around the direction of travel so rays are not only axis aligned.
+void StepCamera(Camera *camera)
+{
+    const Vec2 *path = camera->map->path;
+    int segmentCount = camera->map->pathLength - 1;
+
+    Vec2 from = TileToPixelPosition(path[camera->segment], TileDimsInPixels, TileDimsInPixels * 0.5f);
+    Vec2 to = TileToPixelPosition(path[camera->segment + 1], TileDimsInPixels, TileDimsInPixels * 0.5f);
+    float length = Distance(from, to);
+
+    camera->segmentProgress += CameraSpeed;
+    while (camera->segmentProgress >= length)
+    {
+        camera->segmentProgress -= length;
+        camera->segment = (camera->segment + 1) % segmentCount;
+        from = TileToPixelPosition(path[camera->segment], TileDimsInPixels, TileDimsInPixels * 0.5f);
+        to = TileToPixelPosition(path[camera->segment + 1], TileDimsInPixels, TileDimsInPixels * 0.5f);
+        length = Distance(from, to);
+    }
+
+    // The path is followed from its tile centre, never in absolute pixels.
+    Vec2 direction = Normalize(to - from);
+    Vec2 start = path[camera->segment];
+    player.position = MakeWorldPosition(start.x, start.y, TileDimsInPixels * 0.5f + direction * camera->segmentProgress);
+    player.facingAngle = atan2f(direction.y, direction.x) * RadianToAngle +
+                         CameraSweepDegrees * sinf(camera->frame * 0.05f);
+    ++camera->frame;
+}
+
+struct FrameTimes
+{
+    double *frame;
+    double *map;
+    double *rays;
+    double *rayMisses;
+};
+
+double Mean(const double *samples, int count)
+{
+    double total = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        total += samples[i];
+    }
+    return total / count;
+}
+
+double Percentile(double *samples, int count, float percentile)
+{
+    std::sort(samples, samples + count);
+    int index = SDL_min(count - 1, (int)(percentile * count));
+    return samples[index];
+}
+
+// Parses a comma separated list of integers, returns the number parsed.
+int ParseIntList(const char *text, int *values, int maxCount)
+{
+    int count = 0;
+    while (*text && count < maxCount)
+    {
+        char *end;
+        values[count++] = strtol(text, &end, 10);
+        text = (*end == ',') ? end + 1 : end;
+        if (end == text && *end != '\0')
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options = {0};
+    options.seed = 1;
+    options.warmupReps = 10;
+    options.reps = 60;
+
+    int sizes[16] = { 16, 64, 256, 1024, 4096, 8192 };
+    int sizeCount = 6;
+    int distances[16] = { 300, 1200, 4800 };
+    int distanceCount = 3;
+    int resolutions[32] = { 240, 240, 480, 480, 960, 540 };
+    int resolutionCount = 3;
+    int kindMask = (1 << MapKind_Count) - 1;
+    SimdLevel simdLevel = Simd_Count;
+    const char *streamPath = NULL;
+    int chunkBudgetMb = 16;
+    TileLayout layout = TileLayout_RowMajor;
+    int wallCount = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--sizes") == 0 && hasValue)
+        {
+            sizeCount = ParseIntList(argv[++i], sizes, ArrayCount(sizes));
+        }
+        else if (strcmp(argv[i], "--distances") == 0 && hasValue)
+        {
+            distanceCount = ParseIntList(argv[++i], distances, ArrayCount(distances));
+        }
+        else if (strcmp(argv[i], "--resolutions") == 0 && hasValue)
+        {
+            // Pairs of FPS view width,height.
+            resolutionCount = ParseIntList(argv[++i], resolutions, ArrayCount(resolutions)) / 2;
+        }
+        else if (strcmp(argv[i], "--maps") == 0 && hasValue)
+        {
+            const char *names = argv[++i];
+            kindMask = 0;
+            for (int kind = 0; kind < MapKind_Count; ++kind)
+            {
+                if (strstr(names, MapKindNames[kind]))
+                {
+                    kindMask |= 1 << kind;
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--raycaster") == 0 && hasValue)
+        {
+            if (!ParseRayCaster(argv[++i], &rayCaster))
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown ray caster : %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--stream") == 0 && hasValue)
+        {
+            streamPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--chunk-budget") == 0 && hasValue)
+        {
+            int budget = atoi(argv[++i]);
+            chunkBudgetMb = SDL_max(1, budget);
+        }
+        else if (strcmp(argv[i], "--layout") == 0 && hasValue)
+        {
+            if (!ParseTileLayout(argv[++i], &layout))
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown tile layout : %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--walls") == 0 && hasValue)
+        {
+            int count = atoi(argv[++i]);
+            wallCount = SDL_max(0, count);
+        }
+        else if (strcmp(argv[i], "--simd") == 0 && hasValue)
+        {
+            if (!ParseSimdLevel(argv[++i], &simdLevel))
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown SIMD level : %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!ParseBenchOption(argc, argv, &i, &options))
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown argument : %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    bool pinned = PinToCpu(options.cpu);
+    InitRenderKernels(simdLevel);
+
+    Texture texture = LoadTexture("walltext.png");
+    if (!texture.data)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "walltext.png not found, run from the repository root\n");
+        return 1;
+    }
+
+    FILE *output = OpenBenchOutput(options);
+    if (!output)
+    {
+        return 1;
+    }
+
+    WriteBenchHeader(output, "flythrough", options, pinned);
+    fprintf(output, "  \"raycaster\": \"%s\",\n", RayCasterNames[rayCaster]);
+    fprintf(output, "  \"simd\": \"%s\",\n", SimdLevelNames[kernels.level]);
+    fprintf(output, "  \"layout\": \"%s\",\n", layout == TileLayout_Bricked ? "bricked" : "rowmajor");
+    fprintf(output, "  \"walls\": %d,\n", wallCount);
+    fprintf(output, "  \"results\": [\n");
+
+    RayHits *hits = (RayHits *) calloc(1, sizeof(RayHits));
+    FrameTimes times;
+    times.frame = (double *) malloc(options.reps * sizeof(double));
+    times.map = (double *) malloc(options.reps * sizeof(double));
+    times.rays = (double *) malloc(options.reps * sizeof(double));
+    times.rayMisses = (double *) malloc(options.reps * sizeof(double));
+    CacheMissCounter missCounter = OpenCacheMissCounter();
+
+    // Long enough for the camera to never wrap around within a run.
+    int targetPathCells = (int)((options.warmupReps + options.reps) * CameraSpeed / TileDimsInPixels.x) + 2;
+
+    bool first = true;
+    for (int kind = 0; kind < MapKind_Count; ++kind)
+    {
+        if (!(kindMask & (1 << kind)))
+        {
+            continue;
+        }
+
+        for (int sizeIndex = 0; sizeIndex < sizeCount; ++sizeIndex)
+        {
+            GeneratedMap generated = GenerateMap((MapKind)kind, sizes[sizeIndex], options.seed, targetPathCells);
+            if (generated.pathLength < 2)
+            {
+                FreeGeneratedMap(&generated);
+                continue;
+            }
+            TileMap converted = {0};
+            if (layout != TileLayout_RowMajor)
+            {
+                converted = ConvertTileLayout(generated.map, layout);
+            }
+            SetWorld(converted.tiles ? converted : generated.map);
+            if (streamPath && (!SaveChunkedMap(generated.map, streamPath, DefaultChunkSize) ||
+                               !OpenChunkStream(streamPath, (size_t)chunkBudgetMb << 20)))
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Stream fail : %s\n", streamPath);
+                return 1;
+            }
+            if (rayCaster == RayCaster_Bsp)
+            {
+                // The map's faces and the walls all go into the tree.
+                WallSegment *segments = NULL;
+                int segmentCount = 0;
+                int segmentCapacity = 0;
+                AppendTileFaces(generated.map, &segments, &segmentCount, &segmentCapacity);
+                WallSegment *random = GenerateWalls(&generated.map, wallCount, options.seed);
+                for (int i = 0; i < wallCount; ++i)
+                {
+                    AppendWallSegment(&segments, &segmentCount, &segmentCapacity, random[i]);
+                }
+                free(random);
+                BuildBsp(&bsp, segments, segmentCount);
+                free(segments);
+            }
+            else if (wallCount)
+            {
+                WallSegment *segments = GenerateWalls(&generated.map, wallCount, options.seed);
+                BuildWalls(segments, wallCount);
+                free(segments);
+            }
+
+            for (int resolutionIndex = 0; resolutionIndex < resolutionCount; ++resolutionIndex)
+            {
+                int columns = SDL_min(resolutions[2 * resolutionIndex], MaxRayCount);
+                int rows = resolutions[2 * resolutionIndex + 1];
+                ScreenBuffer buffer = CreateScreenBuffer(NULL, MapDimsInPixels.x + columns, rows);
+
+                for (int distanceIndex = 0; distanceIndex < distanceCount; ++distanceIndex)
+                {
+                    viewDistance = distances[distanceIndex];
+                    Camera camera = { &generated, 0, 0, 0 };
+                    adaptiveRayCounts = AdaptiveRayCounts {};
+                    bspCounts = BspCounts {};
+
+                    for (int frame = 0; frame < options.warmupReps + options.reps; ++frame)
+                    {
+                        StepCamera(&camera);
+
+                        Uint64 frameStart = SDL_GetPerformanceCounter();
+                        UpdateChunkStream();
+                        DrawMap(buffer, texture);
+                        Uint64 mapEnd = SDL_GetPerformanceCounter();
+                        ClearHits(hits, columns);
+                        Uint64 missesStart = ReadCacheMisses(missCounter);
+                        CastRays(buffer, texture, hits);
+                        Uint64 missesEnd = ReadCacheMisses(missCounter);
+                        Uint64 raysEnd = SDL_GetPerformanceCounter();
+                        DrawPlayer(buffer);
+                        DrawFpsView(buffer, hits);
+                        Uint64 frameEnd = SDL_GetPerformanceCounter();
+
+                        int sample = frame - options.warmupReps;
+                        if (sample >= 0)
+                        {
+                            times.frame[sample] = CounterToNs(frameEnd - frameStart) * 1e-6;
+                            times.map[sample] = CounterToNs(mapEnd - frameStart) * 1e-6;
+                            times.rays[sample] = CounterToNs(raysEnd - mapEnd) * 1e-6;
+                            times.rayMisses[sample] = (double)(missesEnd - missesStart);
+                        }
+                    }
+
+                    fprintf(output, "%s    {\"map\": \"%s\", \"tiles\": %d, \"width\": %d, \"height\": %d, \"view_distance\": %d, \"frames\": %d, "
+                            "\"frame_ms_mean\": %.4f, \"frame_ms_p50\": %.4f, \"frame_ms_p95\": %.4f, \"map_ms_mean\": %.4f, \"rays_ms_mean\": %.4f",
+                            first ? "" : ",\n", MapKindNames[kind], generated.map.width, columns, rows, distances[distanceIndex], options.reps,
+                            Mean(times.frame, options.reps), Percentile(times.frame, options.reps, 0.5f), Percentile(times.frame, options.reps, 0.95f),
+                            Mean(times.map, options.reps), Mean(times.rays, options.reps));
+                    if (IsCacheMissCounterOpen(missCounter))
+                    {
+                        fprintf(output, ", \"rays_cache_misses_mean\": %.1f", Mean(times.rayMisses, options.reps));
+                    }
+                    if (adaptiveRayCounts.columns)
+                    {
+                        fprintf(output, ", \"rays_marched_fraction\": %.4f", (double)adaptiveRayCounts.marched / adaptiveRayCounts.columns);
+                    }
+                    if (bspCounts.frames)
+                    {
+                        fprintf(output, ", \"bsp_nodes_per_frame\": %.1f", (double)bspCounts.nodes / bspCounts.frames);
+                    }
+                    if (IsWorldStreamed())
+                    {
+                        fprintf(output, ", \"chunk_slots\": %d, \"chunk_loads\": %d, \"chunk_evictions\": %d",
+                                chunkStream.slotCount, chunkStream.loads, chunkStream.evictions);
+                    }
+                    fprintf(output, "}");
+                    fflush(output);
+                    first = false;
+                }
+
+                free(buffer.memory);
+            }
+
+            CloseChunkStream();
+            FreeWalls();
+            FreeBsp(&bsp);
+            SetWorld(TileMap { (int)MapDimsInTiles.x, (int)MapDimsInTiles.y, Map });
+            FreeTiles(converted.tiles);
+            FreeGeneratedMap(&generated);
+        }
+    }
+
+    fprintf(output, "\n  ]\n}\n");
+    CloseBenchOutput(output);
+    CloseCacheMissCounter(&missCounter);
+    return 0;
+}
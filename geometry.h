@@ -0,0 +1,114 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+// Compile time render geometry.
+//
+// The ray kernels are templated on a RenderGeometry so tile sizes, map
+// dimensions and column counts known at compile time become constants in
+// the inner loops: power of two tile sizes turn into shifts, other tile sizes
+// into multiplies, and fixed column counts give the compiler a constant trip
+// count to unroll. A zero map or column size means "read it at runtime".
+// The tile layout is a parameter too, so row major kernels keep their plain
+// index. SelectGeometry picks the instantiation matching the current world
+// and view.
+
+inline int FloorDiv(int value, int divisor)
+{
+    return value >= 0 ? value / divisor : -1 - (-1 - value) / divisor;
+}
+
+constexpr bool IsPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+constexpr int Log2(int value)
+{
+    return value <= 1 ? 0 : 1 + Log2(value / 2);
+}
+
+template<int TileWidth, int TileHeight, int MapWidth, int MapHeight, int Columns,
+         TileLayout Layout = TileLayout_RowMajor>
+struct RenderGeometry
+{
+    static const int TileWidthInPixels = TileWidth;
+    static const int TileHeightInPixels = TileHeight;
+
+    static inline int FloorPixelToTileX(int pixel)
+    {
+        return IsPowerOfTwo(TileWidth) ? pixel >> Log2(TileWidth) : FloorDiv(pixel, TileWidth);
+    }
+
+    static inline int FloorPixelToTileY(int pixel)
+    {
+        return IsPowerOfTwo(TileHeight) ? pixel >> Log2(TileHeight) : FloorDiv(pixel, TileHeight);
+    }
+
+    static inline int Width()
+    {
+        return MapWidth ? MapWidth : world.width;
+    }
+
+    static inline int Height()
+    {
+        return MapHeight ? MapHeight : world.height;
+    }
+
+    static inline TileType GetTile(int tileX, int tileY)
+    {
+        if ((unsigned)tileX >= (unsigned)Width() || (unsigned)tileY >= (unsigned)Height())
+        {
+            return A;
+        }
+        if (Layout == TileLayout_Bricked)
+        {
+            return world.tiles[BrickedTileIndex(tileX, tileY, Width())];
+        }
+        return world.tiles[tileX + tileY * Width()];
+    }
+
+    static inline int ColumnCount(RayHits *hits)
+    {
+        return Columns ? Columns : hits->count;
+    }
+};
+
+// The configuration the game ships with: the built-in Map and one ray per
+// column of the default FPS view.
+typedef RenderGeometry<(int)TileDimsInPixels.x, (int)TileDimsInPixels.y,
+                       (int)MapDimsInTiles.x, (int)MapDimsInTiles.y,
+                       (int)FpsViewDimsInPixels.x> BuiltInGeometry;
+
+typedef RenderGeometry<(int)TileDimsInPixels.x, (int)TileDimsInPixels.y, 0, 0, 0> DynamicGeometry;
+
+typedef RenderGeometry<(int)TileDimsInPixels.x, (int)TileDimsInPixels.y, 0, 0, 0, TileLayout_Bricked> BrickedGeometry;
+
+enum GeometryKind
+{
+    Geometry_BuiltIn,
+    Geometry_Dynamic,
+    // Any map stored in bricks, see tilelayout.h.
+    Geometry_Bricked,
+    // A world streamed from chunks, see chunks.h.
+    Geometry_Streamed
+};
+
+inline GeometryKind SelectGeometry(RayHits *hits)
+{
+    if (!world.tiles)
+    {
+        return Geometry_Streamed;
+    }
+    if (world.layout == TileLayout_Bricked)
+    {
+        return Geometry_Bricked;
+    }
+    bool builtInMap = world.tiles == Map && world.width == MapDimsInTiles.x && world.height == MapDimsInTiles.y;
+    if (builtInMap && hits->count == FpsViewDimsInPixels.x)
+    {
+        return Geometry_BuiltIn;
+    }
+    return Geometry_Dynamic;
+}
+
+#endif
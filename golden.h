@@ -0,0 +1,184 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+// Golden image regression check.
+//
+// Renders a fixed set of poses over the built-in Map through RenderFrame, so
+// whatever renderer options are active get validated against a reference run.
+// "--golden-update <dir>" stores a hash and a PNG image for every pose,
+// "--golden <dir>" compares against them. A pose whose hash differs still
+// passes when no channel is off by more than the configured tolerance.
+// Failing poses leave <pose>_actual.png and <pose>_diff.png in the directory.
+//
+// golden/ holds the reference of the scalar float caster,
+// "--simd scalar --raycaster float --golden-update golden", which build.sh
+// checks against. golden/demo.rcin is the replay ray caster changes compare
+// sequence hashes on, "--headless --replay golden/demo.rcin", where the float
+// caster gives 6f50e632a0fe9458.
+//
+// golden/heights holds the same poses drawn by the layered renderer with
+// "--heights golden/heights.txt", which steps, short walls and a low ceiling
+// show up in. Its demo replay hash is 7b5c9c52704a84f1.
+
+struct GoldenPose
+{
+    Vec2 tile;
+    float facingAngle;
+    float pitch;
+};
+
+const GoldenPose GoldenPoses[] =
+{
+    { Vec2(2, 2), 90.0f },
+    { Vec2(2, 2), 0.0f },
+    { Vec2(6, 2), 180.0f },
+    { Vec2(8, 8), 225.0f },
+    { Vec2(3, 6), 45.0f },
+    { Vec2(6, 7), 300.0f },
+    { Vec2(1, 1), 45.0f },
+    { Vec2(8, 1), 135.0f },
+    // Looking fully up and down, the horizon at the edges of the view.
+    { Vec2(6, 2), 180.0f, MaxPitch },
+    { Vec2(3, 6), 45.0f, -MaxPitch },
+};
+
+struct GoldenDiff
+{
+    int mismatchedPixels;
+    int maxChannelDelta;
+};
+
+// Compares the buffer against an RGB reference image and paints the
+// mismatching pixels red into diff.
+GoldenDiff DiffAgainstReference(ScreenBuffer buffer, const Uint8 *reference, ScreenBuffer diff, int tolerance)
+{
+    GoldenDiff result = {0};
+    for (int y = 0; y < buffer.height; ++y)
+    {
+        for (int x = 0; x < buffer.width; ++x)
+        {
+            Uint8 alpha, blue, green, red;
+            UnpackColorABGR(GetPixelColorAt(buffer, Vec2(x, y)), &alpha, &blue, &green, &red);
+            const Uint8 *expected = reference + (x + y * buffer.width) * 3;
+
+            int delta = abs(red - expected[0]);
+            delta = SDL_max(delta, abs(green - expected[1]));
+            delta = SDL_max(delta, abs(blue - expected[2]));
+            result.maxChannelDelta = SDL_max(result.maxChannelDelta, delta);
+
+            if (delta > tolerance)
+            {
+                ++result.mismatchedPixels;
+                SetPixelColor(diff, x, y, Red);
+            }
+            else
+            {
+                SetPixelColor(diff, x, y, PackColorABGR(255, blue / 4, green / 4, red / 4));
+            }
+        }
+    }
+    return result;
+}
+
+// Returns the number of failing poses, so the result can be used as exit code.
+int RunGoldenImages(ScreenBuffer buffer, Texture texture, const char *directory, bool update, int tolerance)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/hashes.txt", directory);
+
+    Uint64 expectedHashes[ArrayCount(GoldenPoses)] = {0};
+    FILE *hashFile = NULL;
+    if (update)
+    {
+        mkdir(directory, 0755);
+        hashFile = fopen(path, "w");
+    }
+    else
+    {
+        hashFile = fopen(path, "r");
+        for (int poseIndex = 0; hashFile && poseIndex < ArrayCount(GoldenPoses); ++poseIndex)
+        {
+            unsigned long long hash = 0;
+            if (fscanf(hashFile, "%*s %llx", &hash) == 1)
+            {
+                expectedHashes[poseIndex] = hash;
+            }
+        }
+    }
+    if (!hashFile)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Golden hash file fail : %s\n", path);
+        return ArrayCount(GoldenPoses);
+    }
+
+    ScreenBuffer diff = buffer;
+    diff.memory = (Uint8 *) malloc(buffer.height * buffer.pitch);
+
+    Player savedPlayer = player;
+    RayHits hits = {0};
+    int failures = 0;
+
+    for (int poseIndex = 0; poseIndex < ArrayCount(GoldenPoses); ++poseIndex)
+    {
+        const GoldenPose pose = GoldenPoses[poseIndex];
+        player = savedPlayer;
+        player.position = MakeWorldPosition(pose.tile.x, pose.tile.y, TileDimsInPixels * 0.5f);
+        player.facingAngle = pose.facingAngle;
+        player.pitch = pose.pitch;
+
+        RenderFrame(buffer, texture, &hits);
+        Uint64 hash = HashScreenBuffer(buffer);
+
+        if (update)
+        {
+            fprintf(hashFile, "pose_%02d %016llx\n", poseIndex, (unsigned long long)hash);
+            snprintf(path, sizeof(path), "%s/pose_%02d.png", directory, poseIndex);
+            WritePNG(path, buffer);
+            continue;
+        }
+
+        if (hash == expectedHashes[poseIndex])
+        {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "pose_%02d: ok", poseIndex);
+            continue;
+        }
+
+        int width, height, comps;
+        snprintf(path, sizeof(path), "%s/pose_%02d.png", directory, poseIndex);
+        Uint8 *reference = stbi_load(path, &width, &height, &comps, STBI_rgb);
+        if (!reference || width != buffer.width || height != buffer.height)
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "pose_%02d: hash mismatch and no usable reference image\n", poseIndex);
+            stbi_image_free(reference);
+            ++failures;
+            continue;
+        }
+
+        GoldenDiff result = DiffAgainstReference(buffer, reference, diff, tolerance);
+        stbi_image_free(reference);
+
+        if (result.mismatchedPixels == 0)
+        {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "pose_%02d: ok within tolerance (max delta %d)", poseIndex, result.maxChannelDelta);
+            continue;
+        }
+
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "pose_%02d: %d pixels differ, max delta %d\n",
+                     poseIndex, result.mismatchedPixels, result.maxChannelDelta);
+        snprintf(path, sizeof(path), "%s/pose_%02d_actual.png", directory, poseIndex);
+        WritePNG(path, buffer);
+        snprintf(path, sizeof(path), "%s/pose_%02d_diff.png", directory, poseIndex);
+        WritePNG(path, diff);
+        ++failures;
+    }
+
+    fclose(hashFile);
+    free(diff.memory);
+    player = savedPlayer;
+    return failures;
+}
+
+#endif
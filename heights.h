@@ -0,0 +1,466 @@
+#ifndef HEIGHTS_H
+#define HEIGHTS_H
+
+#include <stdio.h>
+
+// Per tile floor and ceiling heights and the layered column renderer.
+//
+// Heights are in wall heights. Open tiles default to a floor at 0 and a
+// ceiling at 1, wall tiles to a floor and ceiling at 1, which makes them
+// solid. A wall tile with a lower floor is a short wall the view continues
+// over, an open tile with a raised floor or lowered ceiling a step. The eye
+// is EyeHeight above the floor of the player's tile.
+//
+// DrawRaysLayered walks every column's ray tile by tile past anything that
+// does not close it. Each column keeps the rows still open as a window
+// between a top and a bottom clip row. Floors, the fronts of steps and short
+// walls cover rows from the bottom of the window up, ceilings and lintels
+// from the top down, and the window shrinks to what is left. So a column's
+// spans are stacked from both screen edges and no pixel is written twice.
+// The walk ends when the window closes, at a solid tile, at view distance or
+// after MaxLayerSpans spans, which bounds the cost of a column.
+// DrawFpsViewLayered then writes the spans and fills what is left open.
+//
+// Heights project with the same falloff with distance as DrawFpsView, so a
+// map without steps or short walls draws walls of the same size, up to a
+// pixel of rounding.
+
+const float EyeHeight = 0.5f;
+const float MaxTileHeight = 4.0f;
+const int MaxLayerSpans = 16;
+const Uint32 StepColor = PackColorABGR(255, 96, 96, 96);
+
+struct TileHeights
+{
+    int width;
+    int height;
+    float *floor;
+    float *ceiling;
+};
+
+TileHeights tileHeights;
+
+void FreeTileHeights()
+{
+    free(tileHeights.floor);
+    free(tileHeights.ceiling);
+    tileHeights = TileHeights {};
+}
+
+// Defaults for every tile of the map.
+void InitTileHeights(TileMap map)
+{
+    FreeTileHeights();
+    size_t tileCount = (size_t)map.width * map.height;
+    tileHeights.width = map.width;
+    tileHeights.height = map.height;
+    tileHeights.floor = (float *) malloc(tileCount * sizeof(float));
+    tileHeights.ceiling = (float *) malloc(tileCount * sizeof(float));
+    for (int y = 0; y < map.height; ++y)
+    {
+        for (int x = 0; x < map.width; ++x)
+        {
+            size_t i = (size_t)x + (size_t)y * map.width;
+            tileHeights.floor[i] = map.tiles[TileIndex(map, x, y)] == _ ? 0.0f : 1.0f;
+            tileHeights.ceiling[i] = 1.0f;
+        }
+    }
+}
+
+// One tile per line as "x y floor ceiling", heights in wall heights. Lines
+// starting with # are skipped, tiles not listed keep their defaults.
+bool LoadTileHeights(const char *path)
+{
+    if (!world.tiles)
+    {
+        return false;
+    }
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+
+    InitTileHeights(world);
+    bool valid = true;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        int x, y;
+        float floor, ceiling;
+        char *start = line + strspn(line, " \t\r\n");
+        if (*start == '\0' || *start == '#')
+        {
+            continue;
+        }
+        if (sscanf(start, "%d %d %f %f", &x, &y, &floor, &ceiling) != 4 ||
+            x < 0 || y < 0 || x >= world.width || y >= world.height ||
+            !(floor >= -MaxTileHeight && floor <= ceiling && ceiling <= MaxTileHeight))
+        {
+            valid = false;
+            break;
+        }
+        tileHeights.floor[x + y * world.width] = floor;
+        tileHeights.ceiling[x + y * world.width] = ceiling;
+    }
+    fclose(file);
+
+    if (!valid)
+    {
+        FreeTileHeights();
+    }
+    return valid;
+}
+
+// Outside the heights every tile is solid.
+inline void GetTileHeights(int tileX, int tileY, float *floor, float *ceiling)
+{
+    if (tileX < 0 || tileY < 0 || tileX >= tileHeights.width || tileY >= tileHeights.height)
+    {
+        *floor = 1.0f;
+        *ceiling = 1.0f;
+        return;
+    }
+    size_t i = (size_t)tileX + (size_t)tileY * tileHeights.width;
+    *floor = tileHeights.floor[i];
+    *ceiling = tileHeights.ceiling[i];
+}
+
+// Half as bright, for the tops of short walls.
+inline Uint32 ShadeColor(Uint32 color)
+{
+    return (color & 0xFF000000) | ((color >> 1) & 0x007F7F7F);
+}
+
+struct LayerSpan
+{
+    int top;
+    int bottom;
+    Uint32 color;
+};
+
+// Spans of one column, rows [0, top) and [bottom, viewHeight) covered.
+// The last spans added above and below the window, -1 for none, grow
+// instead of adding one of the same colour.
+struct LayeredColumn
+{
+    int top;
+    int bottom;
+    int lastAbove;
+    int lastBelow;
+    int spanCount;
+    LayerSpan spans[MaxLayerSpans];
+};
+
+struct LayeredColumns
+{
+    int count;
+    int viewHeight;
+    LayeredColumn columns[MaxRayCount];
+};
+
+LayeredColumns layeredColumns;
+
+// Covers the open rows from row down to the bottom of the window.
+inline void CoverBelow(LayeredColumn *column, int row, Uint32 color)
+{
+    row = SDL_max(row, column->top);
+    if (row >= column->bottom)
+    {
+        return;
+    }
+    if (column->lastBelow >= 0 && column->spans[column->lastBelow].color == color)
+    {
+        column->spans[column->lastBelow].top = row;
+    }
+    else
+    {
+        column->lastBelow = column->spanCount;
+        column->spans[column->spanCount++] = LayerSpan { row, column->bottom, color };
+    }
+    column->bottom = row;
+}
+
+// Covers the open rows from the top of the window down to row.
+inline void CoverAbove(LayeredColumn *column, int row, Uint32 color)
+{
+    row = SDL_min(row, column->bottom);
+    if (row <= column->top)
+    {
+        return;
+    }
+    if (column->lastAbove >= 0 && column->spans[column->lastAbove].color == color)
+    {
+        column->spans[column->lastAbove].bottom = row;
+    }
+    else
+    {
+        column->lastAbove = column->spanCount;
+        column->spans[column->spanCount++] = LayerSpan { column->top, row, color };
+    }
+    column->top = row;
+}
+
+// Whether the column can take no more spans.
+inline bool IsLayerDone(const LayeredColumn *column)
+{
+    return column->top >= column->bottom || column->spanCount > MaxLayerSpans - 2;
+}
+
+// First row below the given height at a perpendicular distance, the eye
+// projects to the horizon row.
+inline int ProjectHeight(float height, float eye, float depth, float horizon, float halfHeight)
+{
+    float scale = 2.0f * (1.0f - depth / viewDistance) * halfHeight;
+    return (int)ceilf(horizon - (height - eye) * scale - 0.5f);
+}
+
+template<typename Geometry>
+void DrawRaysLayeredKernel(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    LayeredColumns *layers = &layeredColumns;
+    int rayCount = Geometry::ColumnCount(hits);
+    layers->count = rayCount;
+    layers->viewHeight = buffer.viewHeight;
+    float halfHeight = (float)(buffer.viewHeight / 2);
+    float horizon = (float)GetHorizonRow(buffer);
+
+    const int tileWidth = Geometry::TileWidthInPixels;
+    const int tileHeight = Geometry::TileHeightInPixels;
+    int playerTileX = player.position.tileX;
+    int playerTileY = player.position.tileY;
+    float playerFloor, playerCeiling;
+    GetTileHeights(playerTileX, playerTileY, &playerFloor, &playerCeiling);
+    float eye = playerFloor + EyeHeight;
+    TileType playerTile = Geometry::GetTile(playerTileX, playerTileY);
+
+    MinimapTrail trail = GetMinimapTrail(buffer);
+    int trailStride = SDL_max(1, rayCount / (int)FpsViewDimsInPixels.x);
+    for (int columnIndex = 0; columnIndex < rayCount; ++columnIndex)
+    {
+        LayeredColumn *column = &layers->columns[columnIndex];
+        column->top = 0;
+        column->bottom = buffer.viewHeight;
+        column->lastAbove = -1;
+        column->lastBelow = -1;
+        column->spanCount = 0;
+
+        float angle, cos, sin;
+        GetColumnRay(columnIndex, rayCount, &angle, &cos, &sin);
+        float perpendicular = cosf(angle * AngleToRadian);
+
+        int stepX = cos > 0 ? 1 : -1;
+        int stepY = sin > 0 ? 1 : -1;
+        float deltaX = cos != 0 ? tileWidth / fabsf(cos) : INFINITY;
+        float deltaY = sin != 0 ? tileHeight / fabsf(sin) : INFINITY;
+        float nextX = cos != 0 ? (cos > 0 ? tileWidth - trail.eyeX : trail.eyeX) / fabsf(cos) : INFINITY;
+        float nextY = sin != 0 ? (sin > 0 ? tileHeight - trail.eyeY : trail.eyeY) / fabsf(sin) : INFINITY;
+
+        int tileX = playerTileX;
+        int tileY = playerTileY;
+        TileType tile = playerTile;
+        float floor = playerFloor;
+        float ceiling = playerCeiling;
+        float maxDistance = viewDistance / perpendicular;
+        float exit = 0;
+
+        // Standing inside a solid tile sees only its walls.
+        if (floor >= ceiling)
+        {
+            CoverBelow(column, 0, GetTileColor(tile, texture));
+        }
+
+        while (!IsLayerDone(column))
+        {
+            bool acrossX = nextX < nextY;
+            exit = SDL_min(acrossX ? nextX : nextY, maxDistance);
+            float depth = exit * perpendicular;
+
+            // The top of a short wall shows, open floors and ceilings are
+            // left as background like beyond the walls.
+            Uint32 floorColor = tile == _ ? Grey : ShadeColor(GetTileColor(tile, texture));
+            CoverBelow(column, ProjectHeight(floor, eye, depth, horizon, halfHeight), floorColor);
+            CoverAbove(column, ProjectHeight(ceiling, eye, depth, horizon, halfHeight), Grey);
+            if (exit >= maxDistance || IsLayerDone(column))
+            {
+                break;
+            }
+
+            if (acrossX)
+            {
+                tileX += stepX;
+                nextX += deltaX;
+            }
+            else
+            {
+                tileY += stepY;
+                nextY += deltaY;
+            }
+            tile = Geometry::GetTile(tileX, tileY);
+            float nextFloor, nextCeiling;
+            GetTileHeights(tileX, tileY, &nextFloor, &nextCeiling);
+
+            // The fronts of what rises from the floor and hangs from the
+            // ceiling at the boundary, a solid tile fills all that is open.
+            Uint32 faceColor = tile == _ ? StepColor : GetTileColor(tile, texture);
+            if (nextFloor >= nextCeiling)
+            {
+                CoverBelow(column, column->top, faceColor);
+                break;
+            }
+            if (nextFloor > floor)
+            {
+                CoverBelow(column, ProjectHeight(nextFloor, eye, depth, horizon, halfHeight), faceColor);
+            }
+            if (nextCeiling < ceiling)
+            {
+                CoverAbove(column, ProjectHeight(nextCeiling, eye, depth, horizon, halfHeight), faceColor);
+            }
+            floor = nextFloor;
+            ceiling = nextCeiling;
+        }
+
+        if (columnIndex % trailStride == 0)
+        {
+            DrawRayTrail(buffer, &trail, cos, sin, (int)ceilf(exit));
+        }
+    }
+}
+
+void DrawRaysLayered(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    switch (SelectGeometry(hits))
+    {
+    case Geometry_BuiltIn:
+        DrawRaysLayeredKernel<BuiltInGeometry>(buffer, texture, hits);
+        break;
+    case Geometry_Bricked:
+        DrawRaysLayeredKernel<BrickedGeometry>(buffer, texture, hits);
+        break;
+    default:
+        DrawRaysLayeredKernel<DynamicGeometry>(buffer, texture, hits);
+        break;
+    }
+}
+
+// A span starting on a row, bucketed by row when the rows are written.
+struct LayerEvent
+{
+    int column;
+    Uint32 color;
+};
+
+struct LayerRows
+{
+    // Offsets of each row's events, rowCapacity + 1 of them.
+    int *rowStarts;
+    int rowCapacity;
+    LayerEvent *events;
+    int eventCapacity;
+    // The row being written.
+    Uint32 colors[MaxRayCount];
+};
+
+LayerRows layerRows;
+
+// Spans above the window were added top down and those below bottom up.
+int OrderLayerSpans(const LayeredColumn *column, LayerSpan *ordered)
+{
+    int count = 0;
+    for (int i = 0; i < column->spanCount; ++i)
+    {
+        if (column->spans[i].bottom <= column->top)
+        {
+            ordered[count++] = column->spans[i];
+        }
+    }
+    if (column->top < column->bottom)
+    {
+        ordered[count++] = LayerSpan { column->top, column->bottom, Grey };
+    }
+    for (int i = column->spanCount - 1; i >= 0; --i)
+    {
+        if (column->spans[i].top >= column->bottom)
+        {
+            ordered[count++] = column->spans[i];
+        }
+    }
+    return count;
+}
+
+// Writes every column's spans and the rows left open between them. A row
+// differs from the one above only where a span starts, so the starts are
+// bucketed by row, applied to a row of colours and every row is copied out
+// whole through the copy kernel, rather than writing a column at a time.
+void DrawFpsViewLayered(ScreenBuffer buffer)
+{
+    const LayeredColumns *layers = &layeredColumns;
+    LayerRows *rows = &layerRows;
+    int count = SDL_min(layers->count, buffer.viewWidth);
+    int height = SDL_min(layers->viewHeight, buffer.viewHeight);
+    if (count <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    if (rows->rowCapacity < height)
+    {
+        free(rows->rowStarts);
+        rows->rowStarts = (int *) malloc((height + 1) * sizeof(int));
+        rows->rowCapacity = height;
+    }
+    int eventCapacity = count * (MaxLayerSpans + 1);
+    if (rows->eventCapacity < eventCapacity)
+    {
+        free(rows->events);
+        rows->events = (LayerEvent *) malloc(eventCapacity * sizeof(LayerEvent));
+        rows->eventCapacity = eventCapacity;
+    }
+
+    // Counting sort of the span starts by row, spans past the bottom drop.
+    LayerSpan ordered[MaxLayerSpans + 1];
+    memset(rows->rowStarts, 0, (height + 1) * sizeof(int));
+    for (int x = 0; x < count; ++x)
+    {
+        int spanCount = OrderLayerSpans(&layers->columns[x], ordered);
+        for (int i = 0; i < spanCount; ++i)
+        {
+            if (ordered[i].top < ordered[i].bottom && ordered[i].top < height)
+            {
+                ++rows->rowStarts[SDL_max(ordered[i].top, 0) + 1];
+            }
+        }
+    }
+    for (int y = 0; y < height; ++y)
+    {
+        rows->rowStarts[y + 1] += rows->rowStarts[y];
+    }
+    for (int x = 0; x < count; ++x)
+    {
+        int spanCount = OrderLayerSpans(&layers->columns[x], ordered);
+        for (int i = 0; i < spanCount; ++i)
+        {
+            if (ordered[i].top < ordered[i].bottom && ordered[i].top < height)
+            {
+                rows->events[rows->rowStarts[SDL_max(ordered[i].top, 0)]++] = LayerEvent { x, ordered[i].color };
+            }
+        }
+    }
+
+    // The fill moved every start to the next row's, so row y's events now
+    // begin where row y - 1's ended.
+    int pitchInPixels = buffer.pitch / buffer.bytesPerPixel;
+    Uint32 *origin = (Uint32 *)(buffer.memory) + (int)MapDimsInPixels.x;
+    kernels.fillSpan(rows->colors, count, Grey);
+    int event = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        for (; event < rows->rowStarts[y]; ++event)
+        {
+            rows->colors[rows->events[event].column] = rows->events[event].color;
+        }
+        kernels.copySpan(origin + y * pitchInPixels, rows->colors, count);
+    }
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef HITCACHE_H
+#define HITCACHE_H
+
+// Panoramic ray hit cache.
+//
+// Turning in place does not change what the rays hit, only which of them are
+// on screen. The cache casts a full circle of rays from the player position,
+// PanoramaOversample times finer than the view's ray spacing, and every view
+// column samples the nearest cached ray. The cache is rebuilt only when the
+// position, the map, the view distance or the resolution changes.
+//
+// Redrawing the minimap trail dominates once the traversal is cached, so the
+// trail of every ray is stored as buffer offsets and replayed with plain
+// stores.
+//
+// Any move rebuilds the whole panorama, 360 / fov * PanoramaOversample times
+// the rays of a frame, so it only wins while the player turns in place:
+// 23 us per frame against 87 us for DrawRays in bench. Moving, it is 10-20x
+// slower than the float caster in the flythrough over 64 tile maps, and
+// 3.5x slower on the demo replay (1.09 against 0.30 ms per frame).
+
+const int PanoramaOversample = 2;
+
+struct PanoramaRay
+{
+    // Along the ray, the fisheye correction depends on the facing angle.
+    float distance;
+    // Range of the ray's minimap pixels in HitCache::trail.
+    int trailStart;
+    int trailCount;
+    bool wasHit;
+    Uint32 color;
+};
+
+struct HitCache
+{
+    bool valid;
+    int tileX;
+    int tileY;
+    float offsetX;
+    float offsetY;
+    Uint32 worldGeneration;
+    float viewDistance;
+    int bufferWidth;
+    int bufferHeight;
+    int rayCount;
+    int capacity;
+    PanoramaRay *rays;
+
+    Uint32 *trail;
+    int trailCount;
+    int trailCapacity;
+};
+
+HitCache hitCache;
+
+bool IsHitCacheValid(ScreenBuffer buffer, int rayCount)
+{
+    return hitCache.valid &&
+           hitCache.rayCount == rayCount &&
+           hitCache.bufferWidth == buffer.width &&
+           hitCache.bufferHeight == buffer.height &&
+           hitCache.tileX == player.position.tileX &&
+           hitCache.tileY == player.position.tileY &&
+           hitCache.offsetX == player.position.offset.x &&
+           hitCache.offsetY == player.position.offset.y &&
+           hitCache.worldGeneration == worldGeneration &&
+           hitCache.viewDistance == viewDistance;
+}
+
+inline void AppendTrailPixel(Uint32 offset)
+{
+    if (hitCache.trailCount == hitCache.trailCapacity)
+    {
+        hitCache.trailCapacity = SDL_max(4096, hitCache.trailCapacity * 2);
+        hitCache.trail = (Uint32 *) realloc(hitCache.trail, hitCache.trailCapacity * sizeof(Uint32));
+    }
+    hitCache.trail[hitCache.trailCount++] = offset;
+}
+
+void BuildHitCache(ScreenBuffer buffer, Texture texture, int rayCount)
+{
+    if (rayCount > hitCache.capacity)
+    {
+        hitCache.capacity = rayCount;
+        hitCache.rays = (PanoramaRay *) realloc(hitCache.rays, rayCount * sizeof(PanoramaRay));
+    }
+
+    const int tileWidth = TileDimsInPixels.x;
+    const int tileHeight = TileDimsInPixels.y;
+
+    Vec2 eye = player.position.offset;
+    Vec2 minimapOrigin = TileToPixelPosition(GetMinimapOriginTile(buffer), TileDimsInPixels);
+    Vec2 minimapDims = TileToPixelPosition(GetMinimapDimsInTiles(buffer), TileDimsInPixels);
+    int minimapBaseX = TileOriginPixelX(player.position) - (int)minimapOrigin.x;
+    int minimapBaseY = TileOriginPixelY(player.position) - (int)minimapOrigin.y;
+    hitCache.trailCount = 0;
+
+    for (int rayIndex = 0; rayIndex < rayCount; ++rayIndex)
+    {
+        float angle = (360.0f * rayIndex) / rayCount;
+        PanoramaRay *ray = &hitCache.rays[rayIndex];
+        float cos = cosf(angle * AngleToRadian);
+        float sin = sinf(angle * AngleToRadian);
+        ray->distance = 0;
+        ray->trailStart = hitCache.trailCount;
+        ray->wasHit = false;
+        ray->color = Grey;
+
+        for (int i = 0; i < viewDistance; i += 2)
+        {
+            Vec2 rayPixelPosition(eye.x + cos * i, eye.y + sin * i);
+            int pixelX = FloorToInt(rayPixelPosition.x);
+            int pixelY = FloorToInt(rayPixelPosition.y);
+            TileType tile = GetTile(player.position.tileX + FloorDiv(pixelX, tileWidth),
+                                    player.position.tileY + FloorDiv(pixelY, tileHeight));
+
+            if (tile != _)
+            {
+                ray->distance = Distance(eye, rayPixelPosition);
+                ray->wasHit = true;
+                ray->color = GetTileColor(tile, texture);
+                break;
+            }
+
+            int minimapX = minimapBaseX + pixelX;
+            int minimapY = minimapBaseY + pixelY;
+            if (minimapX >= 0 && minimapY >= 0 && minimapX < minimapDims.x && minimapY < minimapDims.y)
+            {
+                AppendTrailPixel(minimapX + minimapY * buffer.width);
+            }
+        }
+        ray->trailCount = hitCache.trailCount - ray->trailStart;
+    }
+
+    hitCache.valid = true;
+    hitCache.rayCount = rayCount;
+    hitCache.tileX = player.position.tileX;
+    hitCache.tileY = player.position.tileY;
+    hitCache.offsetX = player.position.offset.x;
+    hitCache.offsetY = player.position.offset.y;
+    hitCache.worldGeneration = worldGeneration;
+    hitCache.viewDistance = viewDistance;
+    hitCache.bufferWidth = buffer.width;
+    hitCache.bufferHeight = buffer.height;
+}
+
+void DrawRaysCached(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    int rayCount = hits->count;
+    if (rayCount <= 0)
+    {
+        return;
+    }
+
+    int panoramaCount = PanoramaOversample * (int)ceilf(360.0f * rayCount / player.fov);
+    if (!IsHitCacheValid(buffer, panoramaCount))
+    {
+        BuildHitCache(buffer, texture, panoramaCount);
+    }
+
+    Uint32 *pixels = (Uint32 *)buffer.memory;
+    float raysPerDegree = panoramaCount / 360.0f;
+
+    for (int rayIndex = 0; rayIndex < rayCount; ++rayIndex)
+    {
+        float angle = GetColumnAngle(rayIndex, rayCount);
+        int panoramaIndex = (int)floorf((player.facingAngle + angle) * raysPerDegree + 0.5f) % panoramaCount;
+        if (panoramaIndex < 0)
+        {
+            panoramaIndex += panoramaCount;
+        }
+        const PanoramaRay *ray = &hitCache.rays[panoramaIndex];
+
+        const Uint32 *trail = hitCache.trail + ray->trailStart;
+        for (int i = 0; i < ray->trailCount; ++i)
+        {
+            pixels[trail[i]] = White;
+        }
+
+        if (ray->wasHit)
+        {
+            auto *hitData = &hits->data[rayIndex];
+            hitData->wasHit = true;
+            hitData->distanceFromPlayer = cosf((angle) * AngleToRadian) * ray->distance;
+            hitData->color = ray->color;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+// Input to photon latency.
+//
+// Every SDL input event gets a sequence number and a performance counter
+// stamp of when SDL queued it. The player state carries the sequence number of
+// the first input it does not reflect yet, the rendered frame inherits it,
+// and when that frame has been presented every input below it is done.
+// Only the main thread, which polls and presents, ever reads the stamps.
+//
+// Each input is split into stages that add up to the total:
+//
+//   simulate  queued by SDL until a player state reflecting it exists
+//   render    until the frame rendered from that state is finished
+//   present   until SDL_RenderPresent of that frame returned
+//
+// Frames that are never presented, because a newer one replaced them first,
+// leave their inputs to the next presented frame.
+
+enum LatencyStage
+{
+    LatencyStage_Simulate,
+    LatencyStage_Render,
+    LatencyStage_Present,
+    LatencyStage_Total,
+    LatencyStage_Count
+};
+
+const char *LatencyStageNames[LatencyStage_Count] = { "simulate", "render", "present", "total" };
+
+// Quarter octave buckets of microseconds, bucket i holds [2^(i/4), 2^((i+1)/4)).
+// The last one collects everything from about 16 seconds on.
+const int LatencyBucketsPerOctave = 4;
+const int LatencyBucketCount = 24 * LatencyBucketsPerOctave;
+
+struct LatencyHistogram
+{
+    Uint32 buckets[LatencyBucketCount];
+    Uint32 count;
+    double totalUs;
+    double maxUs;
+};
+
+// Inputs that can wait for a present at once; older ones are dropped.
+const int LatencyRingSize = 1024;
+
+struct LatencyTracker
+{
+    Uint64 queued[LatencyRingSize];
+    Uint32 nextInput;
+    Uint32 presentedInput;
+    Uint32 droppedInputs;
+    LatencyHistogram stages[LatencyStage_Count];
+};
+
+// What a frame reflects: inputs below inputEnd, simulated and rendered at
+// the given performance counters.
+struct FrameLatency
+{
+    Uint32 inputEnd;
+    Uint64 simulated;
+    Uint64 rendered;
+};
+
+inline double CounterToUs(Uint64 counter)
+{
+    return (double)counter * 1e6 / (double)SDL_GetPerformanceFrequency();
+}
+
+inline int LatencyBucket(double us)
+{
+    if (us < 1)
+    {
+        return 0;
+    }
+    int bucket = (int)(log2(us) * LatencyBucketsPerOctave);
+    return SDL_min(bucket, LatencyBucketCount - 1);
+}
+
+inline double LatencyBucketUpperUs(int bucket)
+{
+    return exp2((double)(bucket + 1) / LatencyBucketsPerOctave);
+}
+
+void AddLatency(LatencyHistogram *histogram, double us)
+{
+    ++histogram->buckets[LatencyBucket(us)];
+    ++histogram->count;
+    histogram->totalUs += us;
+    histogram->maxUs = SDL_max(histogram->maxUs, us);
+}
+
+// Upper bound of the bucket holding the given fraction of samples.
+double LatencyPercentileUs(const LatencyHistogram *histogram, double fraction)
+{
+    Uint32 target = (Uint32)ceil(fraction * histogram->count);
+    Uint32 seen = 0;
+    for (int bucket = 0; bucket < LatencyBucketCount; ++bucket)
+    {
+        seen += histogram->buckets[bucket];
+        if (seen >= SDL_max(target, 1u))
+        {
+            return SDL_min(LatencyBucketUpperUs(bucket), histogram->maxUs);
+        }
+    }
+    return histogram->maxUs;
+}
+
+// Stamps a polled input and returns its sequence number. SDL timestamps
+// events in milliseconds when it queues them; the time they waited for a
+// poll counts against the input too.
+Uint32 StampInput(LatencyTracker *tracker, Uint32 eventTicks)
+{
+    Uint64 queued = SDL_GetPerformanceCounter();
+    Uint32 waitedMs = SDL_GetTicks() - eventTicks;
+    if (waitedMs < 1000)
+    {
+        queued -= SDL_min((Uint64)waitedMs * SDL_GetPerformanceFrequency() / 1000, queued);
+    }
+
+    Uint32 input = tracker->nextInput++;
+    tracker->queued[input % LatencyRingSize] = queued;
+    if (input - tracker->presentedInput >= (Uint32)LatencyRingSize)
+    {
+        ++tracker->presentedInput;
+        ++tracker->droppedInputs;
+    }
+    return input;
+}
+
+// Call once the frame is on screen, with the counter right after presenting.
+void RecordPresent(LatencyTracker *tracker, FrameLatency frame, Uint64 presented)
+{
+    for (; (Sint32)(frame.inputEnd - tracker->presentedInput) > 0; ++tracker->presentedInput)
+    {
+        Uint64 queued = tracker->queued[tracker->presentedInput % LatencyRingSize];
+        // The simulation can apply an input before this thread stamped it,
+        // and the single threaded loop applies it while polling.
+        Uint64 simulated = SDL_max(frame.simulated, queued);
+        Uint64 rendered = SDL_max(frame.rendered, simulated);
+        AddLatency(&tracker->stages[LatencyStage_Simulate], CounterToUs(simulated - queued));
+        AddLatency(&tracker->stages[LatencyStage_Render], CounterToUs(rendered - simulated));
+        AddLatency(&tracker->stages[LatencyStage_Present], CounterToUs(presented - rendered));
+        AddLatency(&tracker->stages[LatencyStage_Total], CounterToUs(presented - queued));
+    }
+}
+
+// All stages as JSON, buckets as [upper bound in us, count] pairs.
+bool SaveLatency(const LatencyTracker *tracker, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "{\n  \"dropped_inputs\": %u,\n  \"stages\": {\n", tracker->droppedInputs);
+    for (int stage = 0; stage < LatencyStage_Count; ++stage)
+    {
+        const LatencyHistogram *histogram = &tracker->stages[stage];
+        fprintf(file, "    \"%s\": {\"count\": %u, \"mean_us\": %.1f, \"p50_us\": %.1f, \"p95_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, \"buckets\": [",
+                LatencyStageNames[stage], histogram->count, histogram->count ? histogram->totalUs / histogram->count : 0.0,
+                LatencyPercentileUs(histogram, 0.5), LatencyPercentileUs(histogram, 0.95), LatencyPercentileUs(histogram, 0.99),
+                histogram->maxUs);
+        bool first = true;
+        for (int bucket = 0; bucket < LatencyBucketCount; ++bucket)
+        {
+            if (histogram->buckets[bucket])
+            {
+                fprintf(file, "%s[%.1f, %u]", first ? "" : ", ", LatencyBucketUpperUs(bucket), histogram->buckets[bucket]);
+                first = false;
+            }
+        }
+        fprintf(file, "]}%s\n", stage + 1 < LatencyStage_Count ? "," : "");
+    }
+    fprintf(file, "  }\n}\n");
+    fclose(file);
+    return true;
+}
+
+// Logs every stage and the total histogram, and saves them to path if given.
+void ReportLatency(const LatencyTracker *tracker, const char *path)
+{
+    if (path && !SaveLatency(tracker, path))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Latency log fail : %s\n", path);
+    }
+
+    const LatencyHistogram *total = &tracker->stages[LatencyStage_Total];
+    if (total->count == 0)
+    {
+        return;
+    }
+
+    for (int stage = 0; stage < LatencyStage_Count; ++stage)
+    {
+        const LatencyHistogram *histogram = &tracker->stages[stage];
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Latency %-8s: %u inputs, mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms",
+                    LatencyStageNames[stage], histogram->count, histogram->totalUs / histogram->count * 1e-3,
+                    LatencyPercentileUs(histogram, 0.5) * 1e-3, LatencyPercentileUs(histogram, 0.95) * 1e-3,
+                    LatencyPercentileUs(histogram, 0.99) * 1e-3, histogram->maxUs * 1e-3);
+    }
+
+    // The total histogram, one line per occupied bucket.
+    for (int bucket = 0; bucket < LatencyBucketCount; ++bucket)
+    {
+        if (total->buckets[bucket])
+        {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "  < %9.3f ms %6u %.*s", LatencyBucketUpperUs(bucket) * 1e-3, total->buckets[bucket],
+                        (int)SDL_min(60u, (total->buckets[bucket] * 60 + total->count - 1) / total->count),
+                        "############################################################");
+        }
+    }
+    if (tracker->droppedInputs)
+    {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Latency: %u inputs dropped before being presented", tracker->droppedInputs);
+    }
+}
+
+#endif
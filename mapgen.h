@@ -0,0 +1,314 @@
+#ifndef MAPGEN_H
+#define MAPGEN_H
+
+// Procedural maps for the flythrough benchmark.
+//
+// Every generator returns a square, walled map together with a camera path:
+// a list of tile positions where each consecutive pair is connected by a
+// straight run of open tiles, so a camera following it never enters a wall.
+
+enum MapKind
+{
+    MapKind_Maze,
+    MapKind_Arena,
+    MapKind_Pillars,
+    MapKind_Corridors,
+    MapKind_Count
+};
+
+const char *MapKindNames[MapKind_Count] = { "maze", "arena", "pillars", "corridors" };
+
+struct GeneratedMap
+{
+    TileMap map;
+    Vec2 *path;
+    int pathLength;
+};
+
+struct PathBuilder
+{
+    Vec2 *points;
+    int count;
+    int capacity;
+};
+
+void AppendPathPoint(PathBuilder *builder, int x, int y)
+{
+    if (builder->count == builder->capacity)
+    {
+        builder->capacity = SDL_max(64, builder->capacity * 2);
+        builder->points = (Vec2 *) realloc(builder->points, builder->capacity * sizeof(Vec2));
+    }
+    builder->points[builder->count++] = Vec2(x, y);
+}
+
+inline void SetTile(TileMap *map, int x, int y, TileType tile)
+{
+    map->tiles[x + y * map->width] = tile;
+}
+
+inline TileType RandomWall(BenchRng *rng)
+{
+    const TileType walls[] = { A, B, C };
+    return walls[NextRandom(rng) % ArrayCount(walls)];
+}
+
+void FillWithBorder(TileMap *map, TileType fill, BenchRng *rng)
+{
+    for (int y = 0; y < map->height; ++y)
+    {
+        for (int x = 0; x < map->width; ++x)
+        {
+            bool border = x == 0 || y == 0 || x == map->width - 1 || y == map->height - 1;
+            SetTile(map, x, y, border ? A : (fill == _ ? _ : RandomWall(rng)));
+        }
+    }
+}
+
+// Open floor with scattered 2x2 blocks kept off a rectangular loop the
+// camera circles on.
+void GenerateArena(TileMap *map, PathBuilder *path, BenchRng *rng)
+{
+    FillWithBorder(map, _, rng);
+
+    int size = map->width;
+    int lo = 2;
+    int hi = size - 3;
+    int blockCount = (size * size) / 64;
+    for (int i = 0; i < blockCount; ++i)
+    {
+        int x = RandomInt(rng, 1, size - 2);
+        int y = RandomInt(rng, 1, size - 2);
+        bool touchesLoop = (x <= hi && x + 1 >= lo && (y <= lo && y + 1 >= lo)) ||
+                           (x <= hi && x + 1 >= lo && (y <= hi && y + 1 >= hi)) ||
+                           (y <= hi && y + 1 >= lo && (x <= lo && x + 1 >= lo)) ||
+                           (y <= hi && y + 1 >= lo && (x <= hi && x + 1 >= hi));
+        if (touchesLoop)
+        {
+            continue;
+        }
+
+        TileType wall = RandomWall(rng);
+        SetTile(map, x, y, wall);
+        SetTile(map, x + 1, y, wall);
+        SetTile(map, x, y + 1, wall);
+        SetTile(map, x + 1, y + 1, wall);
+    }
+
+    AppendPathPoint(path, lo, lo);
+    AppendPathPoint(path, hi, lo);
+    AppendPathPoint(path, hi, hi);
+    AppendPathPoint(path, lo, hi);
+    AppendPathPoint(path, lo, lo);
+}
+
+// Single tile pillars on most odd/odd tiles. Even rows and columns stay
+// open and the camera snakes along them.
+void GeneratePillars(TileMap *map, PathBuilder *path, BenchRng *rng)
+{
+    FillWithBorder(map, _, rng);
+
+    int size = map->width;
+    for (int y = 1; y < size - 1; y += 2)
+    {
+        for (int x = 1; x < size - 1; x += 2)
+        {
+            if (NextRandom(rng) % 10 < 7)
+            {
+                SetTile(map, x, y, RandomWall(rng));
+            }
+        }
+    }
+
+    int last = (size - 2) & ~1;
+    bool leftToRight = true;
+    for (int y = 2; y <= last; y += 2)
+    {
+        AppendPathPoint(path, leftToRight ? 2 : last, y);
+        AppendPathPoint(path, leftToRight ? last : 2, y);
+        leftToRight = !leftToRight;
+    }
+}
+
+// Two tile wide horizontal corridors joined at alternating ends.
+void GenerateCorridors(TileMap *map, PathBuilder *path, BenchRng *rng)
+{
+    FillWithBorder(map, A, rng);
+
+    int size = map->width;
+    int corridorCount = 0;
+    for (int y = 1; y + 1 < size - 1; y += 4)
+    {
+        for (int x = 1; x < size - 1; ++x)
+        {
+            SetTile(map, x, y, _);
+            SetTile(map, x, y + 1, _);
+        }
+
+        bool joinRight = (corridorCount % 2) == 0;
+        int joinX = joinRight ? size - 2 : 1;
+        bool hasNext = y + 5 < size - 1;
+        if (hasNext)
+        {
+            SetTile(map, joinX, y + 2, _);
+            SetTile(map, joinX, y + 3, _);
+        }
+
+        AppendPathPoint(path, joinRight ? 1 : size - 2, y);
+        AppendPathPoint(path, joinX, y);
+        if (hasNext)
+        {
+            AppendPathPoint(path, joinX, y + 4);
+        }
+        ++corridorCount;
+    }
+}
+
+// Perfect maze carved by an iterative recursive backtracker. The camera path
+// is the depth first stack at the point it first reaches the target depth,
+// which is a simple path from the entrance.
+void GenerateMaze(TileMap *map, PathBuilder *path, BenchRng *rng, int targetPathCells)
+{
+    FillWithBorder(map, A, rng);
+
+    int cellsPerSide = (map->width - 1) / 2;
+    int cellCount = cellsPerSide * cellsPerSide;
+    Uint8 *visited = (Uint8 *) calloc(cellCount, 1);
+    int *stack = (int *) malloc(cellCount * sizeof(int));
+    int *bestStack = (int *) malloc((targetPathCells + 1) * sizeof(int));
+    int bestDepth = 0;
+    int depth = 0;
+
+    stack[depth++] = 0;
+    visited[0] = 1;
+    SetTile(map, 1, 1, _);
+
+    const int dx[] = { 1, -1, 0, 0 };
+    const int dy[] = { 0, 0, 1, -1 };
+
+    while (depth > 0)
+    {
+        if (depth > bestDepth && bestDepth < targetPathCells)
+        {
+            bestDepth = SDL_min(depth, targetPathCells);
+            memcpy(bestStack, stack, bestDepth * sizeof(int));
+        }
+
+        int cell = stack[depth - 1];
+        int cellX = cell % cellsPerSide;
+        int cellY = cell / cellsPerSide;
+
+        int candidates[4];
+        int candidateCount = 0;
+        for (int dir = 0; dir < 4; ++dir)
+        {
+            int nx = cellX + dx[dir];
+            int ny = cellY + dy[dir];
+            if (nx >= 0 && ny >= 0 && nx < cellsPerSide && ny < cellsPerSide && !visited[nx + ny * cellsPerSide])
+            {
+                candidates[candidateCount++] = dir;
+            }
+        }
+
+        if (candidateCount == 0)
+        {
+            --depth;
+            continue;
+        }
+
+        int dir = candidates[NextRandom(rng) % candidateCount];
+        int nx = cellX + dx[dir];
+        int ny = cellY + dy[dir];
+        int next = nx + ny * cellsPerSide;
+        visited[next] = 1;
+
+        SetTile(map, 2 * cellX + 1 + dx[dir], 2 * cellY + 1 + dy[dir], _);
+        SetTile(map, 2 * nx + 1, 2 * ny + 1, _);
+        stack[depth++] = next;
+    }
+
+    for (int i = 0; i < bestDepth; ++i)
+    {
+        int cell = bestStack[i];
+        AppendPathPoint(path, 2 * (cell % cellsPerSide) + 1, 2 * (cell / cellsPerSide) + 1);
+    }
+
+    free(bestStack);
+    free(stack);
+    free(visited);
+}
+
+GeneratedMap GenerateMap(MapKind kind, int size, Uint64 seed, int targetPathCells)
+{
+    // Mazes need odd sizes so every cell has a wall ring around it.
+    if (kind == MapKind_Maze && size % 2 == 0)
+    {
+        --size;
+    }
+
+    BenchRng rng = { seed * 0x9E3779B97F4A7C15ULL + (Uint64)kind + 1 };
+
+    GeneratedMap result = {0};
+    result.map.width = size;
+    result.map.height = size;
+    result.map.tiles = (TileType *) malloc((size_t)size * size * sizeof(TileType));
+
+    PathBuilder path = {0};
+    switch (kind)
+    {
+    case MapKind_Maze: GenerateMaze(&result.map, &path, &rng, targetPathCells); break;
+    case MapKind_Arena: GenerateArena(&result.map, &path, &rng); break;
+    case MapKind_Pillars: GeneratePillars(&result.map, &path, &rng); break;
+    case MapKind_Corridors: GenerateCorridors(&result.map, &path, &rng); break;
+    default: break;
+    }
+
+    result.path = path.points;
+    result.pathLength = path.count;
+    return result;
+}
+
+// Short walls at random positions and angles anywhere over the map, with
+// every fourth slot a square pillar of four segments instead. Returns count
+// segments, free them.
+WallSegment *GenerateWalls(const TileMap *map, int count, Uint64 seed)
+{
+    BenchRng rng = { seed * 0x9E3779B97F4A7C15ULL + 0x57A11ULL };
+    WallSegment *segments = (WallSegment *) malloc((size_t)SDL_max(count, 1) * sizeof(WallSegment));
+    float width = map->width * TileDimsInPixels.x;
+    float height = map->height * TileDimsInPixels.y;
+
+    int i = 0;
+    while (i < count)
+    {
+        float x = RandomFloat(&rng, 0, width);
+        float y = RandomFloat(&rng, 0, height);
+        TileType tile = RandomWall(&rng);
+        if (i % 4 == 0 && i + 4 <= count)
+        {
+            float half = RandomFloat(&rng, 2, 8);
+            float cornersX[4] = { x - half, x + half, x + half, x - half };
+            float cornersY[4] = { y - half, y - half, y + half, y + half };
+            for (int corner = 0; corner < 4; ++corner)
+            {
+                int next = (corner + 1) % 4;
+                segments[i++] = WallSegment { cornersX[corner], cornersY[corner], cornersX[next], cornersY[next], tile };
+            }
+            continue;
+        }
+
+        float length = RandomFloat(&rng, 8, 64);
+        float angle = RandomFloat(&rng, 0, 360) * AngleToRadian;
+        segments[i++] = WallSegment { x, y, x + cosf(angle) * length, y + sinf(angle) * length, tile };
+    }
+    return segments;
+}
+
+void FreeGeneratedMap(GeneratedMap *generated)
+{
+    free(generated->map.tiles);
+    free(generated->path);
+    *generated = GeneratedMap();
+}
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Threaded frame pipeline for interactive runs.
+//
+// Three threads, none of which waits on another to make progress:
+//
+//   main        polls SDL events, pushes actions into an SPSC queue and
+//               presents the newest finished frame. SDL wants both on the
+//               thread that created the window.
+//   simulation  owns the player. Applies queued actions, records them, and
+//               publishes an immutable Snapshot through a triple buffer.
+//   render      takes the newest snapshot, renders it into one of three
+//               frame buffers and publishes that through a second triple
+//               buffer.
+//
+// A triple buffer hands the consumer the latest complete slot without locks:
+// the producer writes its back slot and swaps it with the middle one, the
+// consumer swaps its front slot with the middle one when it is marked fresh.
+// Neither side ever touches the other's slot, and intermediate values the
+// consumer was too slow for are simply overwritten.
+//
+// The render thread copies each snapshot into the global player before
+// rendering, so the ray casters keep reading the same globals as before. The
+// simulation's own player is never read by another thread.
+//
+// Input sequence numbers from latency.h ride along: the simulation counts the
+// actions it applied into each snapshot, the render thread copies that into
+// the frame it renders, and the main thread records the inputs as presented.
+//
+// The render thread also owns the resolution scaler; each frame slot carries
+// the view size it was rendered at to Present.
+//
+// Replays and golden images keep the single threaded loop, which steps the
+// simulation exactly once per rendered frame.
+
+// Fresh is set on the middle index when the producer published after the
+// consumer last took it.
+const int TripleBufferFresh = 4;
+
+struct TripleBuffer
+{
+    alignas(64) SDL_atomic_t middle;
+    alignas(64) int back;
+    alignas(64) int front;
+};
+
+void InitTripleBuffer(TripleBuffer *buffer)
+{
+    buffer->back = 0;
+    SDL_AtomicSet(&buffer->middle, 1);
+    buffer->front = 2;
+}
+
+// Producer side: hands the back slot over, returns the next one to write.
+inline int PublishTripleBuffer(TripleBuffer *buffer)
+{
+    int previous = SDL_AtomicSet(&buffer->middle, buffer->back | TripleBufferFresh);
+    buffer->back = previous & ~TripleBufferFresh;
+    return buffer->back;
+}
+
+// Consumer side: moves front to the newest published slot, false when
+// nothing was published since the last call.
+inline bool AcquireTripleBuffer(TripleBuffer *buffer)
+{
+    if (!(SDL_AtomicGet(&buffer->middle) & TripleBufferFresh))
+    {
+        return false;
+    }
+    int previous = SDL_AtomicSet(&buffer->middle, buffer->front);
+    buffer->front = previous & ~TripleBufferFresh;
+    return true;
+}
+
+// Single producer single consumer ring of actions. Head and tail only grow,
+// their difference is the fill level.
+const int InputQueueCapacity = 256;
+
+struct InputQueue
+{
+    alignas(64) SDL_atomic_t head;
+    alignas(64) SDL_atomic_t tail;
+    Uint8 actions[InputQueueCapacity];
+};
+
+// Fails when the simulation is InputQueueCapacity actions behind.
+inline bool PushInput(InputQueue *queue, InputAction action)
+{
+    int tail = SDL_AtomicGet(&queue->tail);
+    if (tail - SDL_AtomicGet(&queue->head) == InputQueueCapacity)
+    {
+        return false;
+    }
+    queue->actions[tail & (InputQueueCapacity - 1)] = (Uint8)action;
+    SDL_AtomicSet(&queue->tail, tail + 1);
+    return true;
+}
+
+inline bool PopInput(InputQueue *queue, InputAction *action)
+{
+    int head = SDL_AtomicGet(&queue->head);
+    if (head == SDL_AtomicGet(&queue->tail))
+    {
+        return false;
+    }
+    *action = (InputAction)queue->actions[head & (InputQueueCapacity - 1)];
+    SDL_AtomicSet(&queue->head, head + 1);
+    return true;
+}
+
+struct Snapshot
+{
+    Player player;
+    // Number of snapshots published before this one.
+    Uint32 tick;
+    // Actions applied so far, and when this snapshot was published.
+    Uint32 inputEnd;
+    Uint64 simulated;
+};
+
+struct Pipeline
+{
+    InputQueue input;
+    TripleBuffer snapshots;
+    TripleBuffer frames;
+    Snapshot *snapshotSlots;
+    ScreenBuffer frameSlots[3];
+    FrameLatency frameLatency[3];
+
+    SDL_sem *simulationWake;
+    SDL_sem *renderWake;
+    SDL_atomic_t running;
+    SDL_Thread *simulation;
+    SDL_Thread *render;
+
+    InputLog *inputLog;
+    Texture texture;
+    ResolutionScaler scaler;
+
+    // Written by their own thread, read after both stopped.
+    Uint32 ticks;
+    Uint32 renderedFrames;
+};
+
+// Idle threads wake up this often to notice a stop.
+const Uint32 PipelineIdleMs = 100;
+
+int SimulationThread(void *data)
+{
+    Pipeline *pipeline = (Pipeline *) data;
+    // The back slot is only ever touched by this thread.
+    Player state = pipeline->snapshotSlots[pipeline->snapshots.back].player;
+    Uint32 tick = 0;
+    Uint32 inputs = 0;
+
+    while (SDL_AtomicGet(&pipeline->running))
+    {
+        bool changed = false;
+        InputAction action;
+        while (PopInput(&pipeline->input, &action))
+        {
+            // Recorded on the last published tick, which replays render
+            // before they apply it.
+            RecordAction(pipeline->inputLog, tick, action);
+            ApplyAction(&state, action);
+            ++inputs;
+            changed = true;
+        }
+
+        if (changed)
+        {
+            Snapshot *snapshot = &pipeline->snapshotSlots[pipeline->snapshots.back];
+            snapshot->player = state;
+            snapshot->tick = ++tick;
+            snapshot->inputEnd = inputs;
+            snapshot->simulated = SDL_GetPerformanceCounter();
+            PublishTripleBuffer(&pipeline->snapshots);
+            SDL_SemPost(pipeline->renderWake);
+        }
+        else
+        {
+            SDL_SemWaitTimeout(pipeline->simulationWake, PipelineIdleMs);
+        }
+    }
+    pipeline->ticks = tick;
+    return 0;
+}
+
+int RenderThread(void *data)
+{
+    Pipeline *pipeline = (Pipeline *) data;
+    RayHits *hits = (RayHits *) calloc(1, sizeof(RayHits));
+    Uint32 frames = 0;
+    int renderedChunks = -1;
+
+    while (SDL_AtomicGet(&pipeline->running))
+    {
+        // Streamed chunks can arrive without a new snapshot, the loader
+        // wakes this thread for them too. Read before rendering, so a chunk
+        // published during the frame gets another one.
+        bool fresh = AcquireTripleBuffer(&pipeline->snapshots);
+        int publishedChunks = GetPublishedChunks();
+        if (!fresh && publishedChunks == renderedChunks)
+        {
+            SDL_SemWaitTimeout(pipeline->renderWake, PipelineIdleMs);
+            continue;
+        }
+        renderedChunks = publishedChunks;
+
+        Snapshot *snapshot = &pipeline->snapshotSlots[pipeline->snapshots.front];
+        player = snapshot->player;
+        UpdateChunkStream();
+        ScreenBuffer *frame = &pipeline->frameSlots[pipeline->frames.back];
+        ApplyResolution(&pipeline->scaler, frame);
+        Uint64 renderStart = SDL_GetPerformanceCounter();
+        RenderFrame(*frame, pipeline->texture, hits);
+        Uint64 renderEnd = SDL_GetPerformanceCounter();
+        UpdateResolution(&pipeline->scaler, (float)(CounterToUs(renderEnd - renderStart) * 1e-3));
+        pipeline->frameLatency[pipeline->frames.back] = FrameLatency { snapshot->inputEnd, snapshot->simulated, renderEnd };
+        PublishTripleBuffer(&pipeline->frames);
+        ++frames;
+    }
+    pipeline->renderedFrames = frames;
+    free(hits);
+    return 0;
+}
+
+bool StartPipeline(Pipeline *pipeline, ScreenBuffer buffer, Texture texture, InputLog *inputLog, float frameBudgetMs)
+{
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->inputLog = inputLog;
+    pipeline->texture = texture;
+    pipeline->scaler = MakeResolutionScaler(frameBudgetMs);
+
+    InitTripleBuffer(&pipeline->snapshots);
+    InitTripleBuffer(&pipeline->frames);
+    pipeline->snapshotSlots = (Snapshot *) malloc(3 * sizeof(Snapshot));
+    for (int i = 0; i < 3; ++i)
+    {
+        pipeline->snapshotSlots[i] = Snapshot { player, 0, 0, 0 };
+        pipeline->frameSlots[i] = CreateScreenBuffer(buffer.texture, buffer.width, buffer.height);
+    }
+    // The initial state is the first snapshot.
+    PublishTripleBuffer(&pipeline->snapshots);
+
+    pipeline->simulationWake = SDL_CreateSemaphore(0);
+    pipeline->renderWake = SDL_CreateSemaphore(0);
+    SetChunkReadyWake(pipeline->renderWake);
+    SDL_AtomicSet(&pipeline->running, 1);
+    pipeline->simulation = SDL_CreateThread(SimulationThread, "simulation", pipeline);
+    pipeline->render = SDL_CreateThread(RenderThread, "render", pipeline);
+    return pipeline->simulation && pipeline->render;
+}
+
+// Joins both threads; the simulation's last state becomes the global player.
+void StopPipeline(Pipeline *pipeline)
+{
+    SetChunkReadyWake(NULL);
+    SDL_AtomicSet(&pipeline->running, 0);
+    SDL_SemPost(pipeline->simulationWake);
+    SDL_SemPost(pipeline->renderWake);
+    SDL_WaitThread(pipeline->simulation, NULL);
+    SDL_WaitThread(pipeline->render, NULL);
+
+    AcquireTripleBuffer(&pipeline->snapshots);
+    player = pipeline->snapshotSlots[pipeline->snapshots.front].player;
+
+    SDL_DestroySemaphore(pipeline->simulationWake);
+    SDL_DestroySemaphore(pipeline->renderWake);
+    for (int i = 0; i < 3; ++i)
+    {
+        free(pipeline->frameSlots[i].memory);
+    }
+    free(pipeline->snapshotSlots);
+}
+
+// Forwards input to the simulation, presents the newest frame.
+void PumpPipeline(Pipeline *pipeline, SDL_Renderer *renderer, LatencyTracker *latency)
+{
+    SDL_Event e;
+    bool pushed = false;
+    // Bounded so a finished frame is presented within a millisecond.
+    for (bool waiting = SDL_WaitEventTimeout(&e, 1); waiting; waiting = SDL_PollEvent(&e))
+    {
+        if (e.type == SDL_QUIT)
+        {
+            done = true;
+        }
+        else if (e.type == SDL_KEYDOWN)
+        {
+            InputAction action = KeyToAction(e.key.keysym.sym);
+            if (action == Action_Quit)
+            {
+                done = true;
+            }
+            else if (action != Action_None)
+            {
+                if (PushInput(&pipeline->input, action))
+                {
+                    StampInput(latency, e.key.timestamp);
+                }
+                else
+                {
+                    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Input queue full, dropped action : %d\n", action);
+                }
+                pushed = true;
+            }
+        }
+    }
+    if (pushed)
+    {
+        SDL_SemPost(pipeline->simulationWake);
+    }
+
+    if (AcquireTripleBuffer(&pipeline->frames))
+    {
+        Present(renderer, pipeline->frameSlots[pipeline->frames.front]);
+        RecordPresent(latency, pipeline->frameLatency[pipeline->frames.front], SDL_GetPerformanceCounter());
+    }
+}
+
+#endif
@@ -0,0 +1,354 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <stdio.h>
+
+// Minimal PNG writer for the golden reference images, stb_image only reads
+// them. Rows are filtered with whichever PNG filter leaves the smallest
+// residuals and compressed into a single fixed Huffman deflate block with
+// greedy LZ77 matches. The renders are mostly flat colour, a 960x540 pose
+// comes out at 11-16 KB against 1.4 MB raw.
+
+const int PngWindowSize = 32768;
+const int PngHashSize = 1 << 15;
+const int PngMaxChain = 32;
+const int PngMinMatch = 3;
+const int PngMaxMatch = 258;
+
+struct PngStream
+{
+    Uint8 *data;
+    size_t size;
+    size_t capacity;
+    Uint32 bits;
+    int bitCount;
+};
+
+void PutPngByte(PngStream *stream, Uint8 value)
+{
+    if (stream->size == stream->capacity)
+    {
+        stream->capacity = SDL_max((size_t)4096, stream->capacity * 2);
+        stream->data = (Uint8 *) realloc(stream->data, stream->capacity);
+    }
+    stream->data[stream->size++] = value;
+}
+
+void PutPngUint32(PngStream *stream, Uint32 value)
+{
+    PutPngByte(stream, value >> 24);
+    PutPngByte(stream, value >> 16);
+    PutPngByte(stream, value >> 8);
+    PutPngByte(stream, value);
+}
+
+// Deflate packs bits from the least significant end.
+void PutDeflateBits(PngStream *stream, Uint32 value, int count)
+{
+    stream->bits |= value << stream->bitCount;
+    stream->bitCount += count;
+    while (stream->bitCount >= 8)
+    {
+        PutPngByte(stream, stream->bits & 0xFF);
+        stream->bits >>= 8;
+        stream->bitCount -= 8;
+    }
+}
+
+// Huffman codes go out most significant bit first.
+void PutDeflateCode(PngStream *stream, Uint32 code, int length)
+{
+    Uint32 reversed = 0;
+    for (int i = 0; i < length; ++i)
+    {
+        reversed |= ((code >> i) & 1) << (length - 1 - i);
+    }
+    PutDeflateBits(stream, reversed, length);
+}
+
+void PutDeflateSymbol(PngStream *stream, int symbol)
+{
+    if (symbol < 144)
+    {
+        PutDeflateCode(stream, 0x30 + symbol, 8);
+    }
+    else if (symbol < 256)
+    {
+        PutDeflateCode(stream, 0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280)
+    {
+        PutDeflateCode(stream, symbol - 256, 7);
+    }
+    else
+    {
+        PutDeflateCode(stream, 0xC0 + symbol - 280, 8);
+    }
+}
+
+void PutDeflateMatch(PngStream *stream, int length, int distance)
+{
+    static const int LengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int LengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                       3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int DistanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                        8193, 12289, 16385, 24577 };
+    static const int DistanceExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                         7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    int lengthCode = ArrayCount(LengthBase) - 1;
+    while (LengthBase[lengthCode] > length)
+    {
+        --lengthCode;
+    }
+    PutDeflateSymbol(stream, 257 + lengthCode);
+    PutDeflateBits(stream, length - LengthBase[lengthCode], LengthExtra[lengthCode]);
+
+    int distanceCode = ArrayCount(DistanceBase) - 1;
+    while (DistanceBase[distanceCode] > distance)
+    {
+        --distanceCode;
+    }
+    PutDeflateCode(stream, distanceCode, 5);
+    PutDeflateBits(stream, distance - DistanceBase[distanceCode], DistanceExtra[distanceCode]);
+}
+
+inline Uint32 HashPngBytes(const Uint8 *bytes)
+{
+    return ((bytes[0] << 16 | bytes[1] << 8 | bytes[2]) * 2654435761u) >> 17;
+}
+
+// Appends a zlib stream holding data to stream.
+void PutZlib(PngStream *stream, const Uint8 *data, int size)
+{
+    PutPngByte(stream, 0x78);
+    PutPngByte(stream, 0x01);
+    // Final block, fixed Huffman codes.
+    PutDeflateBits(stream, 1, 1);
+    PutDeflateBits(stream, 1, 2);
+
+    int *head = (int *) malloc(PngHashSize * sizeof(int));
+    int *previous = (int *) malloc(PngWindowSize * sizeof(int));
+    for (int i = 0; i < PngHashSize; ++i)
+    {
+        head[i] = -1;
+    }
+
+    int position = 0;
+    while (position < size)
+    {
+        int bestLength = 0;
+        int bestDistance = 0;
+        if (position + PngMinMatch <= size)
+        {
+            Uint32 hash = HashPngBytes(data + position);
+            int maxLength = SDL_min(PngMaxMatch, size - position);
+            int candidate = head[hash];
+            for (int chain = 0; candidate >= 0 && position - candidate <= PngWindowSize && chain < PngMaxChain; ++chain)
+            {
+                int length = 0;
+                while (length < maxLength && data[candidate + length] == data[position + length])
+                {
+                    ++length;
+                }
+                if (length > bestLength)
+                {
+                    bestLength = length;
+                    bestDistance = position - candidate;
+                    if (length == maxLength)
+                    {
+                        break;
+                    }
+                }
+                candidate = previous[candidate % PngWindowSize];
+            }
+        }
+
+        int advance = 1;
+        if (bestLength >= PngMinMatch)
+        {
+            PutDeflateMatch(stream, bestLength, bestDistance);
+            advance = bestLength;
+        }
+        else
+        {
+            PutDeflateSymbol(stream, data[position]);
+        }
+
+        for (int end = position + advance; position < end; ++position)
+        {
+            if (position + PngMinMatch <= size)
+            {
+                Uint32 hash = HashPngBytes(data + position);
+                previous[position % PngWindowSize] = head[hash];
+                head[hash] = position;
+            }
+        }
+    }
+
+    PutDeflateSymbol(stream, 256);
+    PutDeflateBits(stream, 0, 7);
+    free(previous);
+    free(head);
+
+    Uint32 a = 1;
+    Uint32 b = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    PutPngUint32(stream, b << 16 | a);
+}
+
+Uint32 Crc32(const Uint8 *data, size_t size)
+{
+    static Uint32 table[256];
+    if (!table[1])
+    {
+        for (Uint32 i = 0; i < 256; ++i)
+        {
+            Uint32 value = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+            }
+            table[i] = value;
+        }
+    }
+
+    Uint32 crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+// Ends the chunk whose length and type start at chunkStart.
+void EndPngChunk(PngStream *stream, size_t chunkStart)
+{
+    Uint32 length = (Uint32)(stream->size - chunkStart - 8);
+    stream->data[chunkStart] = length >> 24;
+    stream->data[chunkStart + 1] = length >> 16;
+    stream->data[chunkStart + 2] = length >> 8;
+    stream->data[chunkStart + 3] = length;
+    PutPngUint32(stream, Crc32(stream->data + chunkStart + 4, length + 4));
+}
+
+size_t BeginPngChunk(PngStream *stream, const char *type)
+{
+    size_t chunkStart = stream->size;
+    PutPngUint32(stream, 0);
+    for (int i = 0; i < 4; ++i)
+    {
+        PutPngByte(stream, type[i]);
+    }
+    return chunkStart;
+}
+
+inline int PaethPredictor(int left, int up, int upLeft)
+{
+    int estimate = left + up - upLeft;
+    int toLeft = abs(estimate - left);
+    int toUp = abs(estimate - up);
+    int toUpLeft = abs(estimate - upLeft);
+    return toLeft <= toUp && toLeft <= toUpLeft ? left : toUp <= toUpLeft ? up : upLeft;
+}
+
+// Filters row with PNG filter type into out, prior is the row above or NULL.
+// Returns the sum of the residuals as signed bytes.
+int FilterPngRow(int type, const Uint8 *row, const Uint8 *prior, int size, Uint8 *out)
+{
+    const int bytesPerPixel = 3;
+    int cost = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        int left = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+        int up = prior ? prior[i] : 0;
+        int upLeft = prior && i >= bytesPerPixel ? prior[i - bytesPerPixel] : 0;
+        int predicted = type == 1 ? left : type == 2 ? up : type == 3 ? (left + up) / 2 :
+                        type == 4 ? PaethPredictor(left, up, upLeft) : 0;
+        out[i] = (Uint8)(row[i] - predicted);
+        cost += abs((Sint8)out[i]);
+    }
+    return cost;
+}
+
+bool WritePNG(const char *path, ScreenBuffer buffer)
+{
+    int rowSize = buffer.width * 3;
+    Uint8 *rows = (Uint8 *) malloc(2 * rowSize);
+    Uint8 *filtered = (Uint8 *) malloc((size_t)(rowSize + 1) * buffer.height);
+    Uint8 *candidate = (Uint8 *) malloc(rowSize);
+
+    for (int y = 0; y < buffer.height; ++y)
+    {
+        Uint8 *row = rows + (y & 1) * rowSize;
+        const Uint8 *prior = y > 0 ? rows + ((y - 1) & 1) * rowSize : NULL;
+        for (int x = 0; x < buffer.width; ++x)
+        {
+            Uint8 alpha, blue, green, red;
+            UnpackColorABGR(GetPixelColorAt(buffer, Vec2(x, y)), &alpha, &blue, &green, &red);
+            row[x * 3] = red;
+            row[x * 3 + 1] = green;
+            row[x * 3 + 2] = blue;
+        }
+
+        Uint8 *out = filtered + (size_t)y * (rowSize + 1);
+        int bestCost = FilterPngRow(0, row, prior, rowSize, out + 1);
+        out[0] = 0;
+        for (int type = 1; type <= 4; ++type)
+        {
+            int cost = FilterPngRow(type, row, prior, rowSize, candidate);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                out[0] = type;
+                memcpy(out + 1, candidate, rowSize);
+            }
+        }
+    }
+
+    PngStream stream = {0};
+    const Uint8 Signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    for (int i = 0; i < ArrayCount(Signature); ++i)
+    {
+        PutPngByte(&stream, Signature[i]);
+    }
+
+    size_t chunk = BeginPngChunk(&stream, "IHDR");
+    PutPngUint32(&stream, buffer.width);
+    PutPngUint32(&stream, buffer.height);
+    // 8 bit RGB, deflate, adaptive filters, not interlaced.
+    const Uint8 Header[] = { 8, 2, 0, 0, 0 };
+    for (int i = 0; i < ArrayCount(Header); ++i)
+    {
+        PutPngByte(&stream, Header[i]);
+    }
+    EndPngChunk(&stream, chunk);
+
+    chunk = BeginPngChunk(&stream, "IDAT");
+    PutZlib(&stream, filtered, (rowSize + 1) * buffer.height);
+    EndPngChunk(&stream, chunk);
+
+    chunk = BeginPngChunk(&stream, "IEND");
+    EndPngChunk(&stream, chunk);
+
+    free(candidate);
+    free(filtered);
+    free(rows);
+
+    FILE *file = fopen(path, "wb");
+    bool written = file && fwrite(stream.data, 1, stream.size, file) == stream.size;
+    if (file)
+    {
+        written = fclose(file) == 0 && written;
+    }
+    free(stream.data);
+    return written;
+}
+
+#endif
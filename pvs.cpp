@@ -0,0 +1,297 @@
+#define RAYCASTER_NO_MAIN
+#include "raycaster.cpp"
+#include "benchutil.h"
+#include "mapgen.h"
+
+// Offline potentially visible set builder.
+//
+// Builds the sets of a generated map, or the built-in one, for a view
+// distance and optionally saves them with --save, checking that the file
+// loads back to the same sets. Then places random entities within the view
+// distance of random viewers, where a distance check cannot reject them, and
+// times rejecting the ones out of view with the set against tracing a line
+// of sight to every one of them. Results are written as JSON.
+
+// Same sampling as DrawRays: 2 pixel steps, the first wall tile stops it.
+bool HasLineOfSight(Vec2 from, Vec2 to)
+{
+    float length = Distance(from, to);
+    if (length > viewDistance)
+    {
+        return false;
+    }
+
+    Vec2 direction = (to - from) * (1.0f / SDL_max(length, 1.0f));
+    for (float i = 0; i < length; i += 2)
+    {
+        Vec2 sample = from + direction * i;
+        if (GetTile((int)sample.x / (int)TileDimsInPixels.x, (int)sample.y / (int)TileDimsInPixels.y) != _)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+Vec2 RandomOpenPosition(BenchRng *rng)
+{
+    int x, y;
+    do
+    {
+        x = RandomInt(rng, 0, world.width);
+        y = RandomInt(rng, 0, world.height);
+    } while (world.tiles[TileIndex(world, x, y)] != _);
+
+    Vec2 offset(RandomFloat(rng, 0, TileDimsInPixels.x), RandomFloat(rng, 0, TileDimsInPixels.y));
+    return TileToPixelPosition(Vec2(x, y), TileDimsInPixels, offset);
+}
+
+// Open position at most the view distance away on both axes, the center
+// itself when none turns up.
+Vec2 RandomOpenPositionNear(BenchRng *rng, Vec2 center)
+{
+    Vec2 mapDims = TileToPixelPosition(Vec2(world.width, world.height), TileDimsInPixels);
+    for (int attempt = 0; attempt < 64; ++attempt)
+    {
+        float x = SDL_min(SDL_max(center.x + RandomFloat(rng, -viewDistance, viewDistance), 0), mapDims.x - 1);
+        float y = SDL_min(SDL_max(center.y + RandomFloat(rng, -viewDistance, viewDistance), 0), mapDims.y - 1);
+        if (GetTile((int)x / (int)TileDimsInPixels.x, (int)y / (int)TileDimsInPixels.y) == _)
+        {
+            return Vec2(x, y);
+        }
+    }
+    return center;
+}
+
+inline int PixelToTileX(Vec2 pixel)
+{
+    return (int)pixel.x / (int)TileDimsInPixels.x;
+}
+
+inline int PixelToTileY(Vec2 pixel)
+{
+    return (int)pixel.y / (int)TileDimsInPixels.y;
+}
+
+bool IsSamePvs(const PotentiallyVisibleSet *a, const PotentiallyVisibleSet *b)
+{
+    size_t tileCount = (size_t)a->width * a->height;
+    return a->width == b->width && a->height == b->height && a->radius == b->radius &&
+           a->setCount == b->setCount && a->wordCount == b->wordCount &&
+           memcmp(a->setOfTile, b->setOfTile, tileCount * sizeof(Uint32)) == 0 &&
+           memcmp(a->sets, b->sets, a->setCount * sizeof(PvsSet)) == 0 &&
+           memcmp(a->words, b->words, a->wordCount * sizeof(Uint32)) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options = {0};
+    options.seed = 1;
+    options.warmupReps = 1;
+    options.reps = 5;
+
+    int mapKind = MapKind_Maze;
+    bool builtInMap = false;
+    int size = 256;
+    int threadCount = 0;
+    // Per viewer.
+    int entityCount = 1024;
+    int viewerCount = 256;
+    const char *savePath = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--map") == 0 && hasValue)
+        {
+            const char *name = argv[++i];
+            builtInMap = strcmp(name, "builtin") == 0;
+            mapKind = MapKind_Count;
+            for (int kind = 0; kind < MapKind_Count; ++kind)
+            {
+                if (strcmp(name, MapKindNames[kind]) == 0)
+                {
+                    mapKind = kind;
+                }
+            }
+            if (!builtInMap && mapKind == MapKind_Count)
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown map : %s\n", name);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--size") == 0 && hasValue)
+        {
+            size = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--view-distance") == 0 && hasValue)
+        {
+            viewDistance = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--entities") == 0 && hasValue)
+        {
+            int count = atoi(argv[++i]);
+            entityCount = SDL_max(1, count);
+        }
+        else if (strcmp(argv[i], "--save") == 0 && hasValue)
+        {
+            savePath = argv[++i];
+        }
+        else if (!ParseBenchOption(argc, argv, &i, &options))
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown argument : %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    bool pinned = threadCount == 1 && PinToCpu(options.cpu);
+
+    GeneratedMap generated = {0};
+    if (!builtInMap)
+    {
+        generated = GenerateMap((MapKind)mapKind, size, options.seed, 2);
+        SetWorld(generated.map);
+    }
+
+    PotentiallyVisibleSet built = {0};
+    Uint64 buildStart = SDL_GetPerformanceCounter();
+    if (!BuildPvs(&built, world, PvsRadiusForViewDistance(), threadCount))
+    {
+        return 1;
+    }
+    double buildMs = CounterToNs(SDL_GetPerformanceCounter() - buildStart) * 1e-6;
+
+    if (savePath)
+    {
+        PotentiallyVisibleSet loaded = {0};
+        if (!SavePvs(&built, savePath))
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "PVS save fail : %s\n", savePath);
+            return 1;
+        }
+        if (!LoadPvs(&loaded, savePath, world) || !IsSamePvs(&built, &loaded))
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "PVS load mismatch : %s\n", savePath);
+            return 1;
+        }
+        FreePvs(&loaded);
+    }
+
+    size_t tileCount = (size_t)world.width * world.height;
+    size_t openTiles = 0;
+    double visibleTiles = 0;
+    for (size_t i = 0; i < tileCount; ++i)
+    {
+        if (world.tiles[TileIndex(world, (int)(i % world.width), (int)(i / world.width))] == _)
+        {
+            const PvsSet *set = &built.sets[built.setOfTile[i]];
+            const Uint32 *words = built.words + set->offset;
+            for (Uint32 word = 0; word < PvsWordCount(set->width * set->height); ++word)
+            {
+                visibleTiles += __builtin_popcount(words[word]);
+            }
+            ++openTiles;
+        }
+    }
+    size_t bytes = tileCount * sizeof(Uint32) + built.setCount * sizeof(PvsSet) + built.wordCount * sizeof(Uint32);
+    // One uncompressed bit per map tile for every open tile.
+    double rawBytes = (double)openTiles * tileCount / 8;
+
+    BenchRng rng = { options.seed * 0x9E3779B97F4A7C15ULL + 1 };
+    Vec2 *viewers = (Vec2 *) malloc(viewerCount * sizeof(Vec2));
+    Vec2 *entities = (Vec2 *) malloc((size_t)viewerCount * entityCount * sizeof(Vec2));
+    for (int viewer = 0; viewer < viewerCount; ++viewer)
+    {
+        viewers[viewer] = RandomOpenPosition(&rng);
+        for (int i = 0; i < entityCount; ++i)
+        {
+            entities[viewer * entityCount + i] = RandomOpenPositionNear(&rng, viewers[viewer]);
+        }
+    }
+
+    // Entities with a line of sight the set rejected, should stay 0.
+    int misses = 0;
+    int passed = 0;
+    int visible = 0;
+    double pvsNs = 0;
+    double sightNs = 0;
+    for (int rep = 0; rep < options.warmupReps + options.reps; ++rep)
+    {
+        int repPassed = 0;
+        int repVisible = 0;
+        Uint64 pvsStart = SDL_GetPerformanceCounter();
+        for (int viewer = 0; viewer < viewerCount; ++viewer)
+        {
+            int viewerX = PixelToTileX(viewers[viewer]);
+            int viewerY = PixelToTileY(viewers[viewer]);
+            const Vec2 *near = entities + viewer * entityCount;
+            for (int i = 0; i < entityCount; ++i)
+            {
+                repPassed += IsTileInSet(&built, viewerX, viewerY, PixelToTileX(near[i]), PixelToTileY(near[i]));
+            }
+        }
+        Uint64 sightStart = SDL_GetPerformanceCounter();
+        for (int viewer = 0; viewer < viewerCount; ++viewer)
+        {
+            const Vec2 *near = entities + viewer * entityCount;
+            for (int i = 0; i < entityCount; ++i)
+            {
+                repVisible += HasLineOfSight(viewers[viewer], near[i]);
+            }
+        }
+        Uint64 sightEnd = SDL_GetPerformanceCounter();
+
+        if (rep >= options.warmupReps)
+        {
+            pvsNs += CounterToNs(sightStart - pvsStart);
+            sightNs += CounterToNs(sightEnd - sightStart);
+        }
+        passed = repPassed;
+        visible = repVisible;
+    }
+
+    for (int viewer = 0; viewer < viewerCount; ++viewer)
+    {
+        int viewerX = PixelToTileX(viewers[viewer]);
+        int viewerY = PixelToTileY(viewers[viewer]);
+        const Vec2 *near = entities + viewer * entityCount;
+        for (int i = 0; i < entityCount; ++i)
+        {
+            misses += HasLineOfSight(viewers[viewer], near[i]) &&
+                      !IsTileInSet(&built, viewerX, viewerY, PixelToTileX(near[i]), PixelToTileY(near[i]));
+        }
+    }
+
+    FILE *output = OpenBenchOutput(options);
+    if (!output)
+    {
+        return 1;
+    }
+
+    double tests = (double)options.reps * viewerCount * entityCount;
+    WriteBenchHeader(output, "pvs", options, pinned);
+    fprintf(output, "  \"map\": \"%s\",\n  \"tiles\": %d,\n  \"view_distance\": %d,\n  \"radius\": %d,\n  \"threads\": %d,\n",
+            builtInMap ? "builtin" : MapKindNames[mapKind], world.width, (int)viewDistance, built.radius,
+            threadCount > 0 ? threadCount : SDL_GetCPUCount());
+    fprintf(output, "  \"build_ms\": %.3f,\n  \"open_tiles\": %zu,\n  \"sets\": %d,\n  \"bytes\": %zu,\n  \"raw_bytes\": %.0f,\n  \"visible_tiles_mean\": %.2f,\n",
+            buildMs, openTiles, built.setCount, bytes, rawBytes, openTiles ? visibleTiles / openTiles : 0.0);
+    fprintf(output, "  \"entities\": %d,\n  \"viewers\": %d,\n  \"passed_fraction\": %.4f,\n  \"line_of_sight_fraction\": %.4f,\n  \"misses\": %d,\n",
+            entityCount, viewerCount, (double)passed / ((double)viewerCount * entityCount),
+            (double)visible / ((double)viewerCount * entityCount), misses);
+    fprintf(output, "  \"pvs_ns_per_test\": %.3f,\n  \"line_of_sight_ns_per_test\": %.3f\n}\n", pvsNs / tests, sightNs / tests);
+    CloseBenchOutput(output);
+
+    free(entities);
+    free(viewers);
+    FreePvs(&built);
+    if (!builtInMap)
+    {
+        SetWorld(TileMap { (int)MapDimsInTiles.x, (int)MapDimsInTiles.y, Map });
+        FreeGeneratedMap(&generated);
+    }
+    return misses == 0 ? 0 : 1;
+}
@@ -0,0 +1,595 @@
+#ifndef PVS_H
+#define PVS_H
+
+#include <stdio.h>
+
+// Precomputed potentially visible sets.
+//
+// For every open tile the set holds the tiles that can be seen from anywhere
+// inside it, up to the view distance the set was built for. Game code can
+// then reject anything outside the viewer's set with a single bit test
+// instead of tracing a line of sight per object.
+//
+// Visibility is sampled: rays are cast from points spread over the tile's
+// border, visibility from inside a tile being the same as from its border.
+// From every point one ray grazes each wall corner a line of sight can pass,
+// which finds the narrow gaps between diagonal walls, and a fan of rays a
+// tile apart at the view distance covers the open space. A tile is in the
+// set when a ray crosses it, walls included.
+//
+// Sets are compressed twice: each is cropped to the bounding box of its
+// visible tiles, and identical sets are stored once, which is most tiles of
+// a closed room. Building runs the rows of the map on all cores.
+// BuildPvs is the load time path, SavePvs and LoadPvs cache the result
+// offline; see pvs.cpp.
+
+const char PvsMagic[4] = {'R', 'C', 'P', 'V'};
+const Uint32 PvsVersion = 1;
+
+// Sample points per tile border edge, and the spacing of the fan in tiles
+// at the radius.
+const int PvsEdgeSamples = 2;
+const float PvsRaySpacing = 1.0f;
+
+// Visible tiles in [x, x + width) x [y, y + height). Bit i of the set, in
+// row major order over the box, starts at bit 0 of words[offset].
+struct PvsSet
+{
+    Uint16 x;
+    Uint16 y;
+    Uint16 width;
+    Uint16 height;
+    Uint32 offset;
+};
+
+struct PotentiallyVisibleSet
+{
+    // worldGeneration the global set was built for, not saved.
+    Uint32 generation;
+    int width;
+    int height;
+    // Chebyshev distance in tiles covered around every tile.
+    int radius;
+    Uint64 mapHash;
+
+    // Index into sets per tile. Set 0 is empty, used for walls.
+    Uint32 *setOfTile;
+    PvsSet *sets;
+    int setCount;
+    Uint32 *words;
+    Uint32 wordCount;
+};
+
+PotentiallyVisibleSet pvs;
+
+inline Uint32 PvsWordCount(int bitCount)
+{
+    return (bitCount + 31) / 32;
+}
+
+inline bool IsTileInSet(const PotentiallyVisibleSet *set, int fromX, int fromY, int toX, int toY)
+{
+    if ((unsigned)fromX >= (unsigned)set->width || (unsigned)fromY >= (unsigned)set->height)
+    {
+        return false;
+    }
+    const PvsSet *visible = &set->sets[set->setOfTile[fromX + fromY * set->width]];
+    unsigned column = toX - visible->x;
+    unsigned row = toY - visible->y;
+    if (column >= visible->width || row >= visible->height)
+    {
+        return false;
+    }
+    Uint32 bit = column + row * visible->width;
+    return (set->words[visible->offset + bit / 32] >> (bit % 32)) & 1;
+}
+
+// Whether anything on the to tile can be in view from the from tile.
+inline bool IsTilePotentiallyVisible(int fromX, int fromY, int toX, int toY)
+{
+    return IsTileInSet(&pvs, fromX, fromY, toX, toY);
+}
+
+Uint64 HashTiles(TileMap map)
+{
+    // FNV-1a.
+    Uint64 hash = 14695981039346656037ULL ^ (Uint64)map.width ^ ((Uint64)map.height << 32);
+    // In row major order whatever the layout, sets load for either.
+    for (int y = 0; y < map.height; ++y)
+    {
+        for (int x = 0; x < map.width; ++x)
+        {
+            hash = (hash ^ map.tiles[TileIndex(map, x, y)]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+// Tile radius that covers everything a ray of the current view distance can
+// reach from anywhere inside a tile.
+int PvsRadiusForViewDistance()
+{
+    int tileSize = SDL_min((int)TileDimsInPixels.x, (int)TileDimsInPixels.y);
+    return (int)ceilf(viewDistance / tileSize) + 1;
+}
+
+void FreePvs(PotentiallyVisibleSet *set)
+{
+    free(set->setOfTile);
+    free(set->sets);
+    free(set->words);
+    *set = PotentiallyVisibleSet {0};
+}
+
+// One row of source tiles, compressed but not yet shared across rows.
+struct PvsRow
+{
+    PvsSet *sets;
+    Uint32 *words;
+    Uint32 wordCount;
+    Uint32 wordCapacity;
+};
+
+struct PvsBuild
+{
+    TileMap map;
+    int radius;
+    PvsRow *rows;
+    SDL_atomic_t nextRow;
+};
+
+// Per worker state. Marks of one source tile over its (2 * radius + 1)^2
+// window.
+struct PvsScratch
+{
+    float *rayCos;
+    float *raySin;
+    int rayCount;
+
+    // Silhouette corners in the window of the current source tile.
+    Sint32 *corners;
+    int cornerCount;
+
+    Uint32 *stamps;
+    Uint32 stamp;
+    int windowSize;
+    int originX;
+    int originY;
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+inline bool IsPvsWall(TileMap map, int x, int y)
+{
+    return (unsigned)x >= (unsigned)map.width || (unsigned)y >= (unsigned)map.height ||
+           map.tiles[TileIndex(map, x, y)] != _;
+}
+
+// Grid points a line of sight can graze: the corner of a lone wall tile, or
+// where two walls touch diagonally. Corners inside walls or along a flat wall
+// cannot bound what is visible.
+inline bool IsPvsSilhouetteCorner(TileMap map, int cornerX, int cornerY)
+{
+    bool topLeft = IsPvsWall(map, cornerX - 1, cornerY - 1);
+    bool topRight = IsPvsWall(map, cornerX, cornerY - 1);
+    bool bottomLeft = IsPvsWall(map, cornerX - 1, cornerY);
+    bool bottomRight = IsPvsWall(map, cornerX, cornerY);
+    int walls = topLeft + topRight + bottomLeft + bottomRight;
+    return walls == 1 || (walls == 2 && topLeft == bottomRight);
+}
+
+inline void MarkPvsTile(PvsScratch *scratch, int x, int y)
+{
+    scratch->stamps[(x - scratch->originX) + (y - scratch->originY) * scratch->windowSize] = scratch->stamp;
+    scratch->minX = SDL_min(scratch->minX, x);
+    scratch->minY = SDL_min(scratch->minY, y);
+    scratch->maxX = SDL_max(scratch->maxX, x);
+    scratch->maxY = SDL_max(scratch->maxY, y);
+}
+
+// Walks the tiles along the ray in tile units until it hits a wall or
+// leaves the window. The renderer samples rays every 2 pixels, which can
+// step over the corner of a wall, so walls the ray crosses for less than a
+// sample step do not stop it.
+void TracePvsRay(const PvsBuild *build, PvsScratch *scratch, float originX, float originY, float directionX, float directionY)
+{
+    int tileX = (int)floorf(originX);
+    int tileY = (int)floorf(originY);
+    int stepX = directionX < 0 ? -1 : 1;
+    int stepY = directionY < 0 ? -1 : 1;
+    float deltaX = directionX != 0 ? fabsf(1.0f / directionX) : INFINITY;
+    float deltaY = directionY != 0 ? fabsf(1.0f / directionY) : INFINITY;
+    float nextX = directionX != 0 ? ((stepX > 0 ? tileX + 1 - originX : originX - tileX) * deltaX) : INFINITY;
+    float nextY = directionY != 0 ? ((stepY > 0 ? tileY + 1 - originY : originY - tileY) * deltaY) : INFINITY;
+
+    const float sampleStep = 2.0f / SDL_min(TileDimsInPixels.x, TileDimsInPixels.y);
+    int lastX = scratch->originX + scratch->windowSize - 1;
+    int lastY = scratch->originY + scratch->windowSize - 1;
+    for (;;)
+    {
+        float enter = SDL_min(nextX, nextY);
+        if (nextX < nextY)
+        {
+            tileX += stepX;
+            nextX += deltaX;
+        }
+        else
+        {
+            tileY += stepY;
+            nextY += deltaY;
+        }
+
+        if (tileX < scratch->originX || tileY < scratch->originY || tileX > lastX || tileY > lastY ||
+            (unsigned)tileX >= (unsigned)build->map.width || (unsigned)tileY >= (unsigned)build->map.height)
+        {
+            return;
+        }
+        MarkPvsTile(scratch, tileX, tileY);
+        if (IsPvsWall(build->map, tileX, tileY) && SDL_min(nextX, nextY) - enter >= sampleStep)
+        {
+            return;
+        }
+    }
+}
+
+void AppendPvsWords(PvsRow *row, Uint32 count)
+{
+    if (row->wordCount + count > row->wordCapacity)
+    {
+        row->wordCapacity = SDL_max(row->wordCount + count, row->wordCapacity * 2);
+        row->words = (Uint32 *) realloc(row->words, row->wordCapacity * sizeof(Uint32));
+    }
+    memset(row->words + row->wordCount, 0, count * sizeof(Uint32));
+    row->wordCount += count;
+}
+
+void ComputePvsRow(const PvsBuild *build, PvsScratch *scratch, int y)
+{
+    PvsRow *row = &build->rows[y];
+    row->sets = (PvsSet *) calloc(build->map.width, sizeof(PvsSet));
+
+    // Rays from the border of the tile, inset so they start inside it.
+    const float inset = 1.0f / 64.0f;
+
+    for (int x = 0; x < build->map.width; ++x)
+    {
+        if (IsPvsWall(build->map, x, y))
+        {
+            continue;
+        }
+
+        ++scratch->stamp;
+        scratch->originX = x - build->radius;
+        scratch->originY = y - build->radius;
+        scratch->minX = scratch->maxX = x;
+        scratch->minY = scratch->maxY = y;
+        MarkPvsTile(scratch, x, y);
+
+        scratch->cornerCount = 0;
+        for (int cornerY = y - build->radius; cornerY <= y + build->radius + 1; ++cornerY)
+        {
+            for (int cornerX = x - build->radius; cornerX <= x + build->radius + 1; ++cornerX)
+            {
+                if (IsPvsSilhouetteCorner(build->map, cornerX, cornerY))
+                {
+                    scratch->corners[2 * scratch->cornerCount] = cornerX;
+                    scratch->corners[2 * scratch->cornerCount + 1] = cornerY;
+                    ++scratch->cornerCount;
+                }
+            }
+        }
+
+        for (int edge = 0; edge < 4; ++edge)
+        {
+            for (int sample = 0; sample < PvsEdgeSamples; ++sample)
+            {
+                float along = inset + (1 - 2 * inset) * sample / PvsEdgeSamples;
+                float sampleX = edge == 0 ? along : edge == 1 ? 1 - inset : edge == 2 ? 1 - along : inset;
+                float sampleY = edge == 0 ? inset : edge == 1 ? along : edge == 2 ? 1 - inset : 1 - along;
+                float originX = x + sampleX;
+                float originY = y + sampleY;
+                for (int ray = 0; ray < scratch->rayCount; ++ray)
+                {
+                    TracePvsRay(build, scratch, originX, originY, scratch->rayCos[ray], scratch->raySin[ray]);
+                }
+                for (int corner = 0; corner < scratch->cornerCount; ++corner)
+                {
+                    float toX = scratch->corners[2 * corner] - originX;
+                    float toY = scratch->corners[2 * corner + 1] - originY;
+                    float length = sqrtf(toX * toX + toY * toY);
+                    TracePvsRay(build, scratch, originX, originY, toX / length, toY / length);
+                }
+            }
+        }
+
+        PvsSet *set = &row->sets[x];
+        set->x = scratch->minX;
+        set->y = scratch->minY;
+        set->width = scratch->maxX - scratch->minX + 1;
+        set->height = scratch->maxY - scratch->minY + 1;
+        set->offset = row->wordCount;
+        AppendPvsWords(row, PvsWordCount(set->width * set->height));
+
+        Uint32 *words = row->words + set->offset;
+        for (int j = 0; j < set->height; ++j)
+        {
+            const Uint32 *stamps = scratch->stamps + (set->x - scratch->originX) + (set->y + j - scratch->originY) * scratch->windowSize;
+            for (int i = 0; i < set->width; ++i)
+            {
+                if (stamps[i] == scratch->stamp)
+                {
+                    Uint32 bit = i + j * set->width;
+                    words[bit / 32] |= 1u << (bit % 32);
+                }
+            }
+        }
+    }
+}
+
+int SDLCALL PvsWorker(void *data)
+{
+    PvsBuild *build = (PvsBuild *) data;
+    PvsScratch scratch = {0};
+    scratch.rayCount = (int)ceilf(2 * M_PI * build->radius / PvsRaySpacing);
+    scratch.rayCos = (float *) malloc(scratch.rayCount * sizeof(float));
+    scratch.raySin = (float *) malloc(scratch.rayCount * sizeof(float));
+    for (int ray = 0; ray < scratch.rayCount; ++ray)
+    {
+        float angle = 2 * M_PI * ray / scratch.rayCount;
+        scratch.rayCos[ray] = cosf(angle);
+        scratch.raySin[ray] = sinf(angle);
+    }
+    scratch.windowSize = 2 * build->radius + 1;
+    scratch.corners = (Sint32 *) malloc(2 * (size_t)(scratch.windowSize + 1) * (scratch.windowSize + 1) * sizeof(Sint32));
+    scratch.stamps = (Uint32 *) calloc((size_t)scratch.windowSize * scratch.windowSize, sizeof(Uint32));
+
+    for (int y = SDL_AtomicAdd(&build->nextRow, 1); y < build->map.height; y = SDL_AtomicAdd(&build->nextRow, 1))
+    {
+        ComputePvsRow(build, &scratch, y);
+    }
+
+    free(scratch.rayCos);
+    free(scratch.raySin);
+    free(scratch.corners);
+    free(scratch.stamps);
+    return 0;
+}
+
+inline Uint64 HashPvsSet(const PvsSet *set, const Uint32 *words)
+{
+    Uint64 hash = 14695981039346656037ULL;
+    hash = (hash ^ (set->x | (Uint32)set->y << 16)) * 1099511628211ULL;
+    hash = (hash ^ (set->width | (Uint32)set->height << 16)) * 1099511628211ULL;
+    Uint32 count = PvsWordCount(set->width * set->height);
+    for (Uint32 i = 0; i < count; ++i)
+    {
+        hash = (hash ^ words[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline bool IsSamePvsSet(const PvsSet *a, const Uint32 *aWords, const PvsSet *b, const Uint32 *bWords)
+{
+    return a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height &&
+           memcmp(aWords, bWords, PvsWordCount(a->width * a->height) * sizeof(Uint32)) == 0;
+}
+
+// Moves the rows into the result, storing every distinct set once.
+void MergePvsRows(PvsBuild *build, PotentiallyVisibleSet *result)
+{
+    size_t tileCount = (size_t)build->map.width * build->map.height;
+    Uint32 totalWords = 0;
+    for (int y = 0; y < build->map.height; ++y)
+    {
+        totalWords += build->rows[y].wordCount;
+    }
+
+    result->setOfTile = (Uint32 *) calloc(tileCount, sizeof(Uint32));
+    result->sets = (PvsSet *) malloc((tileCount + 1) * sizeof(PvsSet));
+    result->words = (Uint32 *) malloc(SDL_max(totalWords, 1) * sizeof(Uint32));
+    result->sets[0] = PvsSet {0};
+    result->setCount = 1;
+    result->wordCount = 0;
+
+    // Open addressing, set index per slot, 0 when free.
+    Uint32 slotCount = 1024;
+    while (slotCount < 2 * tileCount)
+    {
+        slotCount *= 2;
+    }
+    Uint32 *slots = (Uint32 *) calloc(slotCount, sizeof(Uint32));
+
+    for (int y = 0; y < build->map.height; ++y)
+    {
+        PvsRow *row = &build->rows[y];
+        for (int x = 0; x < build->map.width; ++x)
+        {
+            const PvsSet *set = &row->sets[x];
+            if (set->width == 0)
+            {
+                continue;
+            }
+
+            const Uint32 *words = row->words + set->offset;
+            Uint32 slot = (Uint32)HashPvsSet(set, words) & (slotCount - 1);
+            while (slots[slot] && !IsSamePvsSet(&result->sets[slots[slot]], result->words + result->sets[slots[slot]].offset, set, words))
+            {
+                slot = (slot + 1) & (slotCount - 1);
+            }
+
+            if (!slots[slot])
+            {
+                Uint32 count = PvsWordCount(set->width * set->height);
+                PvsSet *stored = &result->sets[result->setCount];
+                *stored = *set;
+                stored->offset = result->wordCount;
+                memcpy(result->words + result->wordCount, words, count * sizeof(Uint32));
+                result->wordCount += count;
+                slots[slot] = result->setCount++;
+            }
+            result->setOfTile[x + y * build->map.width] = slots[slot];
+        }
+
+        free(row->sets);
+        free(row->words);
+    }
+
+    free(slots);
+    result->sets = (PvsSet *) realloc(result->sets, result->setCount * sizeof(PvsSet));
+}
+
+// Builds the sets of every tile of the map on threadCount threads, 0 for one
+// per core. Maps wider than 65535 tiles are not supported.
+bool BuildPvs(PotentiallyVisibleSet *result, TileMap map, int radius, int threadCount)
+{
+    if (map.width > 0xFFFF || map.height > 0xFFFF || radius < 1)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "PVS build fail : unsupported %dx%d map, radius %d\n", map.width, map.height, radius);
+        return false;
+    }
+
+    PvsBuild build = {0};
+    build.map = map;
+    build.radius = radius;
+    build.rows = (PvsRow *) calloc(map.height, sizeof(PvsRow));
+
+    if (threadCount <= 0)
+    {
+        threadCount = SDL_GetCPUCount();
+    }
+    threadCount = SDL_max(1, SDL_min(threadCount, map.height));
+
+    // The calling thread is one of the workers.
+    SDL_Thread **threads = (SDL_Thread **) calloc(threadCount, sizeof(SDL_Thread *));
+    for (int i = 1; i < threadCount; ++i)
+    {
+        threads[i] = SDL_CreateThread(PvsWorker, "pvs", &build);
+        if (!threads[i])
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "PVS thread fail : %s\n", SDL_GetError());
+        }
+    }
+    PvsWorker(&build);
+    for (int i = 1; i < threadCount; ++i)
+    {
+        SDL_WaitThread(threads[i], NULL);
+    }
+    free(threads);
+
+    FreePvs(result);
+    result->width = map.width;
+    result->height = map.height;
+    result->radius = radius;
+    result->mapHash = HashTiles(map);
+    MergePvsRows(&build, result);
+    free(build.rows);
+    return true;
+}
+
+// The global set follows the world and the view distance, like the distance
+// field. The first call after a change pays for the build.
+void UpdatePvs()
+{
+    int radius = PvsRadiusForViewDistance();
+    if (pvs.generation != worldGeneration || pvs.radius < radius)
+    {
+        if (BuildPvs(&pvs, world, radius, 0))
+        {
+            pvs.generation = worldGeneration;
+        }
+    }
+}
+
+bool SavePvs(const PotentiallyVisibleSet *set, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    Sint32 header[4] = { set->width, set->height, set->radius, set->setCount };
+    size_t tileCount = (size_t)set->width * set->height;
+    bool written =
+        fwrite(PvsMagic, sizeof(PvsMagic), 1, file) == 1 &&
+        fwrite(&PvsVersion, sizeof(PvsVersion), 1, file) == 1 &&
+        fwrite(&set->mapHash, sizeof(set->mapHash), 1, file) == 1 &&
+        fwrite(header, sizeof(header), 1, file) == 1 &&
+        fwrite(&set->wordCount, sizeof(set->wordCount), 1, file) == 1 &&
+        fwrite(set->setOfTile, sizeof(Uint32), tileCount, file) == tileCount &&
+        fwrite(set->sets, sizeof(PvsSet), set->setCount, file) == (size_t)set->setCount &&
+        fwrite(set->words, sizeof(Uint32), set->wordCount, file) == set->wordCount;
+    return fclose(file) == 0 && written;
+}
+
+// Fails unless the file was built for exactly the tiles of map.
+bool LoadPvs(PotentiallyVisibleSet *result, const char *path, TileMap map)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    char magic[4];
+    Uint32 version;
+    Uint64 mapHash;
+    Sint32 header[4];
+    Uint32 wordCount;
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        fread(&mapHash, sizeof(mapHash), 1, file) != 1 ||
+        fread(header, sizeof(header), 1, file) != 1 ||
+        fread(&wordCount, sizeof(wordCount), 1, file) != 1 ||
+        memcmp(magic, PvsMagic, sizeof(magic)) != 0 ||
+        version != PvsVersion ||
+        header[0] != map.width || header[1] != map.height || header[3] < 1 ||
+        mapHash != HashTiles(map))
+    {
+        fclose(file);
+        return false;
+    }
+
+    PotentiallyVisibleSet loaded = {0};
+    loaded.width = header[0];
+    loaded.height = header[1];
+    loaded.radius = header[2];
+    loaded.setCount = header[3];
+    loaded.mapHash = mapHash;
+    loaded.wordCount = wordCount;
+
+    size_t tileCount = (size_t)loaded.width * loaded.height;
+    loaded.setOfTile = (Uint32 *) malloc(tileCount * sizeof(Uint32));
+    loaded.sets = (PvsSet *) malloc(loaded.setCount * sizeof(PvsSet));
+    loaded.words = (Uint32 *) malloc(SDL_max(wordCount, 1) * sizeof(Uint32));
+    bool valid =
+        fread(loaded.setOfTile, sizeof(Uint32), tileCount, file) == tileCount &&
+        fread(loaded.sets, sizeof(PvsSet), loaded.setCount, file) == (size_t)loaded.setCount &&
+        fread(loaded.words, sizeof(Uint32), wordCount, file) == wordCount;
+    fclose(file);
+
+    // Every index has to stay in bounds, the queries do not check.
+    for (size_t i = 0; valid && i < tileCount; ++i)
+    {
+        valid = loaded.setOfTile[i] < (Uint32)loaded.setCount;
+    }
+    for (int i = 0; valid && i < loaded.setCount; ++i)
+    {
+        const PvsSet *set = &loaded.sets[i];
+        valid = (Uint64)set->offset + PvsWordCount(set->width * set->height) <= wordCount;
+    }
+
+    if (!valid)
+    {
+        FreePvs(&loaded);
+        return false;
+    }
+
+    FreePvs(result);
+    *result = loaded;
+    return true;
+}
+
+#endif
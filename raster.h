@@ -0,0 +1,69 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+// Span based 2D rasterization.
+//
+// Every primitive is clipped against the buffer once, up front, and then
+// written a row at a time through the kernels table. Nothing drawn partially
+// or fully off screen touches memory outside the buffer, which the per pixel
+// SetPixelColor path never checked.
+
+// Pixel rectangle, max edges exclusive.
+struct PixelRect
+{
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+inline Uint32 *GetPixelRow(ScreenBuffer buffer, int y)
+{
+    return (Uint32 *)(buffer.memory + y * buffer.pitch);
+}
+
+// Intersects the rectangle with the buffer, false when nothing is left.
+inline bool ClipToBuffer(ScreenBuffer buffer, PixelRect *rect)
+{
+    rect->minX = SDL_max(rect->minX, 0);
+    rect->minY = SDL_max(rect->minY, 0);
+    rect->maxX = SDL_min(rect->maxX, buffer.width);
+    rect->maxY = SDL_min(rect->maxY, buffer.height);
+    return rect->minX < rect->maxX && rect->minY < rect->maxY;
+}
+
+void FillRect(ScreenBuffer buffer, int x, int y, int width, int height, Uint32 color)
+{
+    PixelRect rect = { x, y, x + width, y + height };
+    if (!ClipToBuffer(buffer, &rect))
+    {
+        return;
+    }
+
+    int spanLength = rect.maxX - rect.minX;
+    for (int row = rect.minY; row < rect.maxY; ++row)
+    {
+        kernels.fillSpan(GetPixelRow(buffer, row) + rect.minX, spanLength, color);
+    }
+}
+
+// Copies a width by height block of 32 bit pixels to x, y. Source rows are
+// sourcePitch bytes apart.
+void CopyRect(ScreenBuffer buffer, int x, int y, int width, int height, const Uint8 *source, int sourcePitch)
+{
+    PixelRect rect = { x, y, x + width, y + height };
+    if (!ClipToBuffer(buffer, &rect))
+    {
+        return;
+    }
+
+    int spanLength = rect.maxX - rect.minX;
+    const Uint8 *sourceRow = source + (rect.minY - y) * sourcePitch + (rect.minX - x) * sizeof(Uint32);
+    for (int row = rect.minY; row < rect.maxY; ++row)
+    {
+        kernels.copySpan(GetPixelRow(buffer, row) + rect.minX, (const Uint32 *)sourceRow, spanLength);
+        sourceRow += sourcePitch;
+    }
+}
+
+#endif
@@ -18,25 +18,42 @@ struct ScreenBuffer
     int pitch;
     int bytesPerPixel;
     Uint8 *memory;
+    // Size the FPS view right of the minimap is rendered at, from its top
+    // left corner. Below native only with dynamic resolution, see resolution.h.
+    int viewWidth;
+    int viewHeight;
 };
+// Whole tiles plus the pixel offset into the tile, see worldpos.h.
+struct WorldPosition
+{
+    int tileX;
+    int tileY;
+    Vec2 offset;
+};
+
 struct Player
 {
-    Vec2 pixelPosition;
+    WorldPosition position;
     Vec2 dimensions;
     float facingAngle;
     float speed;
     float fov;
+    // Horizon shift in view heights, positive looks up.
+    float pitch;
 };
 
+const int MaxRayCount = 2048;
+
 struct RayHits
 {
+    int count;
     struct Data
     {
         float distanceFromPlayer;
         bool wasHit;
         Uint32 color;
     } 
-    data[480];
+    data[MaxRayCount];
 };
 
 struct Texture
@@ -58,6 +75,8 @@ constexpr Vec2 TileToPixelPosition(Vec2 tileIndex, Vec2 tileDims, Vec2 offset =
     return Vec2((tileIndex.x * tileDims.x) + offset.x, (tileIndex.y * tileDims.y) + offset.y);
 }
 
+#include "worldpos.h"
+
 constexpr Uint32 PackColorABGR(Uint8 alpha, Uint8 blue, Uint8 green, Uint8 red)
 { 
     return ((alpha << 24) | (blue << 16) | (green << 8) | red);
@@ -80,8 +99,11 @@ const Uint32 Black = PackColorABGR(255, 0, 0, 0);
 
 const float AngleToRadian = M_PI / 180.0f;
 const float RayLength = 300.0f;
+// Looking up or down moves the horizon at most to the edge of the view.
+const float MaxPitch = 0.5f;
+const float PitchStep = 0.02f;
 
-enum TileType
+enum TileType : Uint8
 {
     _ = 0,
     A = 1,
@@ -89,7 +111,7 @@ enum TileType
     C = 3
 };
 
-const TileType Map[] = 
+TileType Map[] = 
 {
     A, A, A, A, A, A, A, A, A, A,
     A, _, _, _, B, _, _, _, _, A,
@@ -103,19 +125,184 @@ const TileType Map[] =
     A, A, A, A, A, A, A, A, A, A,
 };
 
+// How TileMap::tiles is ordered, see tilelayout.h.
+enum TileLayout
+{
+    TileLayout_RowMajor,
+    TileLayout_Bricked
+};
+
+struct TileMap
+{
+    int width;
+    int height;
+    TileType *tiles;
+    TileLayout layout;
+};
+
+#include "tilelayout.h"
+
+// The map everything is rendered from. Defaults to the built-in Map, the
+// benchmarks swap in procedurally generated ones.
+TileMap world = { (int)MapDimsInTiles.x, (int)MapDimsInTiles.y, Map };
+// Changes with every SetWorld. The ray casters' per map caches are keyed on
+// it rather than on the tiles, a freed map's memory is often handed straight
+// to the next one.
+Uint32 worldGeneration = 1;
+
+// Replaces world, which drops everything built from the previous map.
+void SetWorld(TileMap map)
+{
+    world = map;
+    ++worldGeneration;
+}
+
+float viewDistance = RayLength;
+
+enum InputAction
+{
+    Action_None = 0,
+    Action_TurnRight,
+    Action_TurnLeft,
+    Action_StrafeLeft,
+    Action_StrafeRight,
+    Action_MoveForward,
+    Action_MoveBackward,
+    Action_Quit,
+    // After Quit so recorded actions keep their values.
+    Action_LookUp,
+    Action_LookDown
+};
+
+#include "replay.h"
+#include "latency.h"
+
 bool done;
 
 Player player = 
 {
-    .pixelPosition = TileToPixelPosition(Vec2(2, 2), TileDimsInPixels),
+    .position = { 2, 2, Vec2(0, 0) },
     .dimensions = Vec2 (5, 5),
     .facingAngle = 90.0f,
     .speed = 2.0f,
     .fov = 45
 };
 
-void Update(SDL_Window *window, SDL_Renderer *renderer, ScreenBuffer buffer)
+InputAction KeyToAction(SDL_Keycode key)
+{
+    switch (key)
+    {
+    case SDLK_ESCAPE: return Action_Quit;
+    case SDLK_s: return Action_TurnRight;
+    case SDLK_a: return Action_TurnLeft;
+    case SDLK_LEFT: return Action_StrafeLeft;
+    case SDLK_RIGHT: return Action_StrafeRight;
+    case SDLK_UP: return Action_MoveForward;
+    case SDLK_DOWN: return Action_MoveBackward;
+    case SDLK_PAGEUP: return Action_LookUp;
+    case SDLK_PAGEDOWN: return Action_LookDown;
+    default: return Action_None;
+    }
+}
+
+void ApplyAction(Player *player, InputAction action)
+{
+    switch (action)
+    {
+    case Action_Quit:
+        done = true;
+        break;
+    case Action_TurnRight:
+        player->facingAngle -= player->speed;
+        break;
+    case Action_TurnLeft:
+        player->facingAngle += player->speed;
+        break;
+    case Action_StrafeLeft:
+        {
+            float direction = (player->facingAngle - 90.f) * AngleToRadian;
+            Vec2 offset(cosf(direction), sinf(direction));
+            player->position = MoveWorldPosition(player->position, offset);
+        }
+        break;
+    case Action_StrafeRight:
+        {
+            float direction = (player->facingAngle + 90.f) * AngleToRadian;
+            Vec2 offset(cosf(direction), sinf(direction));
+            player->position = MoveWorldPosition(player->position, offset);
+        }
+        break;
+    case Action_MoveForward:
+        {
+            float direction = player->facingAngle * AngleToRadian;
+            Vec2 offset(cosf(direction), sinf(direction));
+            player->position = MoveWorldPosition(player->position, offset);
+        }
+        break;
+    case Action_MoveBackward:
+        {
+            float direction = player->facingAngle * AngleToRadian;
+            Vec2 offset(cosf(direction), sinf(direction));
+            player->position = MoveWorldPosition(player->position, offset * -1.0f);
+        }
+        break;
+    case Action_LookUp:
+        player->pitch = SDL_min(player->pitch + PitchStep, MaxPitch);
+        break;
+    case Action_LookDown:
+        player->pitch = SDL_max(player->pitch - PitchStep, -MaxPitch);
+        break;
+    default:
+        break;
+    }
+}
+
+void Present(SDL_Renderer *renderer, ScreenBuffer buffer)
+{
+    // Headless runs have no texture to present to.
+    if (!buffer.texture)
+    {
+        return;
+    }
+
+    SDL_UpdateTexture(buffer.texture, NULL, buffer.memory, buffer.pitch);
+    int mapWidth = SDL_min((int)MapDimsInPixels.x, buffer.width);
+    if (buffer.viewWidth == buffer.width - mapWidth && buffer.viewHeight == buffer.height)
+    {
+        SDL_RenderCopy(renderer, buffer.texture, NULL, NULL);
+    }
+    else
+    {
+        // A scaled down view is stretched over the native one.
+        SDL_Rect map = { 0, 0, mapWidth, buffer.height };
+        SDL_Rect view = { mapWidth, 0, buffer.viewWidth, buffer.viewHeight };
+        SDL_Rect nativeView = { mapWidth, 0, buffer.width - mapWidth, buffer.height };
+        SDL_RenderCopy(renderer, buffer.texture, &map, &map);
+        SDL_RenderCopy(renderer, buffer.texture, &view, &nativeView);
+    }
+    SDL_RenderPresent(renderer);
+}
+
+void Update(SDL_Window *window, SDL_Renderer *renderer, ScreenBuffer buffer, InputLog *inputLog, Uint32 frame,
+            LatencyTracker *latency, FrameLatency frameLatency)
 {
+    if (IsReplaying(inputLog))
+    {
+        // Replays run at a fixed timestep of one frame per loop iteration,
+        // so recorded actions are applied on the frame they were captured on.
+        if (ReplayFinished(inputLog))
+        {
+            done = true;
+            return;
+        }
+
+        int action;
+        while ((action = NextReplayAction(inputLog, frame)) != Action_None)
+        {
+            ApplyAction(&player, (InputAction)action);
+        }
+    }
+
     SDL_Event e;
     while (SDL_PollEvent(&e))
     {
@@ -127,51 +314,32 @@ void Update(SDL_Window *window, SDL_Renderer *renderer, ScreenBuffer buffer)
 
         if (e.type == SDL_KEYDOWN)
         {
-            if (e.key.keysym.sym == SDLK_ESCAPE)
-            {
-                done = true;
-            }
-            if (e.key.keysym.sym == SDLK_s)
-            {
-                player.facingAngle -= player.speed;
-            }
-            if (e.key.keysym.sym == SDLK_a)
-            {
-                player.facingAngle += player.speed;
-            }
-            if (e.key.keysym.sym == SDLK_LEFT)
+            InputAction action = KeyToAction(e.key.keysym.sym);
+            if (IsReplaying(inputLog) && action != Action_Quit)
             {
-                float direction = (player.facingAngle - 90.f) * AngleToRadian;
-                Vec2 offset(cosf(direction), sinf(direction));
-                player.pixelPosition += offset;
+                continue;
             }
-            if (e.key.keysym.sym == SDLK_RIGHT)
+            if (action != Action_None)
             {
-                float direction = (player.facingAngle + 90.f) * AngleToRadian;
-                Vec2 offset(cosf(direction), sinf(direction));
-                player.pixelPosition += offset;
-            }
-            if (e.key.keysym.sym == SDLK_UP)
-            {
-                float direction = player.facingAngle * AngleToRadian;
-                Vec2 offset(cosf(direction), sinf(direction));
-                player.pixelPosition += offset;
-            }
-            if (e.key.keysym.sym == SDLK_DOWN)
-            {
-                float direction = player.facingAngle * AngleToRadian;
-                Vec2 offset(cosf(direction), sinf(direction));
-                player.pixelPosition -= offset;       
+                RecordAction(inputLog, frame, action);
+                ApplyAction(&player, action);
+                if (action != Action_Quit)
+                {
+                    StampInput(latency, e.key.timestamp);
+                }
             }
             return;
         }
     }
 
-    SDL_UpdateTexture(buffer.texture, NULL, buffer.memory, buffer.pitch);
-    SDL_RenderCopy(renderer, buffer.texture, NULL, NULL);
-    SDL_RenderPresent(renderer);
+    Present(renderer, buffer);
+    RecordPresent(latency, frameLatency, SDL_GetPerformanceCounter());
 }
 
+#include "simd.h"
+#include "raster.h"
+#include "geometry.h"
+#include "chunks.h"
 
 inline void SetPixelColor(ScreenBuffer buffer, int x, int y, Uint32 color)
 {
@@ -192,26 +360,27 @@ inline void SetPixelColor(ScreenBuffer buffer, Vec2 pixelPosition, Uint32 color)
     SetPixelColor(buffer, pixelPosition.x, pixelPosition.y, color);
 }
 
-void FillTileWithColor(ScreenBuffer buffer, int tileX, int tileY, int width, int height, Uint32 color)
+// FNV-1a over the whole framebuffer, used to compare the output of two builds.
+Uint64 HashScreenBuffer(ScreenBuffer buffer)
 {
-    for (int i = tileX * width; i < (tileX + 1) * width; ++i)
+    Uint64 hash = 14695981039346656037ULL;
+    int size = buffer.width * buffer.height * buffer.bytesPerPixel;
+    for (int i = 0; i < size; ++i)
     {
-        for (int j = tileY * height; j < (tileY + 1) * height; ++j)
-        {
-            SetPixelColor(buffer, i, j, color);
-        }
+        hash ^= buffer.memory[i];
+        hash *= 1099511628211ULL;
     }
+    return hash;
+}
+
+void FillTileWithColor(ScreenBuffer buffer, int tileX, int tileY, int width, int height, Uint32 color)
+{
+    FillRect(buffer, tileX * width, tileY * height, width, height, color);
 }
 
 void DrawRect(ScreenBuffer buffer, Vec2 topLeft, Vec2 dimensions, Uint32 color)
 {
-    for (int i = 0; i < dimensions.x; ++i)
-    {
-        for (int j = 0; j < dimensions.y; ++j)
-        {
-            SetPixelColor(buffer, topLeft.x + i, topLeft.y + j, color);
-        }
-    }
+    FillRect(buffer, floorf(topLeft.x), floorf(topLeft.y), ceilf(dimensions.x), ceilf(dimensions.y), color);
 }
 
 Uint32 GetTextureColor(int textureIndex, Texture texture)
@@ -222,53 +391,67 @@ Uint32 GetTextureColor(int textureIndex, Texture texture)
     return *color;
 }
 
+Uint32 GetTileColor(TileType tile, Texture texture)
+{
+    switch (tile)
+    {
+    case _: return Grey;
+    case A: return GetTextureColor(1, texture);
+    case B: return GetTextureColor(2, texture);
+    case C: return GetTextureColor(0, texture);
+    default: return Black;
+    }
+}
+
+// Number of whole tiles the minimap shows, bounded by the buffer for small
+// resolutions.
+Vec2 GetMinimapDimsInTiles(ScreenBuffer buffer)
+{
+    int width = SDL_min((int)MapDimsInPixels.x, buffer.width) / (int)TileDimsInPixels.x;
+    int height = SDL_min((int)MapDimsInPixels.y, buffer.height) / (int)TileDimsInPixels.y;
+    return Vec2(SDL_min(width, world.width), SDL_min(height, world.height));
+}
+
+// Top left tile shown on the minimap. Maps larger than the minimap scroll in
+// whole tiles so the player stays in view.
+Vec2 GetMinimapOriginTile(ScreenBuffer buffer)
+{
+    Vec2 visibleTiles = GetMinimapDimsInTiles(buffer);
+    int playerTileX = player.position.tileX;
+    int playerTileY = player.position.tileY;
+
+    int originX = SDL_max(0, SDL_min(playerTileX - (int)visibleTiles.x / 2, world.width - (int)visibleTiles.x));
+    int originY = SDL_max(0, SDL_min(playerTileY - (int)visibleTiles.y / 2, world.height - (int)visibleTiles.y));
+    return Vec2(originX, originY);
+}
+
 void DrawMap(ScreenBuffer buffer, Texture texture)
 {
-    const int MaxTileY = MapDimsInTiles.y;
-    const int MaxTileX = MapDimsInTiles.x;
-    const int tileWidthToPixel = MapDimsInPixels.x / MapDimsInTiles.y;
-    const int tileHeightToPixel = MapDimsInPixels.y / MapDimsInTiles.x;
+    Vec2 visibleTiles = GetMinimapDimsInTiles(buffer);
+    Vec2 originTile = GetMinimapOriginTile(buffer);
+    const int MaxTileY = visibleTiles.y;
+    const int MaxTileX = visibleTiles.x;
+    const int tileWidthToPixel = TileDimsInPixels.x;
+    const int tileHeightToPixel = TileDimsInPixels.y;
 
     for (int y = 0; y < MaxTileY; ++y)
     {
         for (int x = 0; x < MaxTileX; ++x)
         {
-            TileType tile = Map[x + y * MaxTileY];
+            int worldX = originTile.x + x;
+            int worldY = originTile.y + y;
+            TileType tile = world.tiles ? world.tiles[TileIndex(world, worldX, worldY)] : GetStreamedTile(worldX, worldY);
 
-            switch (tile)
-            {
-            case _:
-                FillTileWithColor(buffer, x, y, tileWidthToPixel, tileHeightToPixel, Grey);
-                break;
-            case A:
-                {
-                    Uint32 texColor = GetTextureColor(1, texture);
-                    FillTileWithColor(buffer, x, y, tileWidthToPixel, tileHeightToPixel, texColor);
-                } 
-                break;
-            case B:
-                {
-                    Uint32 texColor = GetTextureColor(2, texture);
-                    FillTileWithColor(buffer, x, y, tileWidthToPixel, tileHeightToPixel, texColor);
-                } 
-                break;
-            case C:
-                {
-                    Uint32 texColor = GetTextureColor(0, texture);
-                    FillTileWithColor(buffer, x, y, tileWidthToPixel, tileHeightToPixel, texColor);
-                } 
-                break;
-            default:
-                break;
-            }
+            Uint32 color = GetTileColor(tile, texture);
+            FillTileWithColor(buffer, x, y, tileWidthToPixel, tileHeightToPixel, color);
         }
     }
 }
 
 Vec2 PixelToTilePosition(ScreenBuffer buffer, int x, int y)
 {
-    const int tileWidthToPixel = MapDimsInPixels.x / MapDimsInTiles.y;
-    const int tileHeightToPixel = MapDimsInPixels.y / MapDimsInTiles.x;
+    const int tileWidthToPixel = TileDimsInPixels.x;
+    const int tileHeightToPixel = TileDimsInPixels.y;
 
     int tileX = x / tileWidthToPixel;
     int tileY = y / tileHeightToPixel;
@@ -276,87 +459,316 @@ Vec2 PixelToTilePosition(ScreenBuffer buffer, int x, int y)
     return Vec2(tileX, tileY);
 }
 
+// Tiles outside the map count as walls, so rays always terminate.
+inline TileType GetTile(int tileX, int tileY)
+{
+    if (!world.tiles)
+    {
+        return GetStreamedTile(tileX, tileY);
+    }
+    if (tileX < 0 || tileY < 0 || tileX >= world.width || tileY >= world.height)
+    {
+        return A;
+    }
+
+    return world.tiles[TileIndex(world, tileX, tileY)];
+}
+
 TileType GetTileValue(Vec2 tilePosition)
 {
-    int tileIndex = tilePosition.x + tilePosition.y * MapDimsInTiles.y;
-    return Map[tileIndex];
+    return GetTile(tilePosition.x, tilePosition.y);
+}
+
+// Angle of column rayIndex relative to the facing angle.
+inline float GetColumnAngle(int rayIndex, int rayCount)
+{
+    float rayScaler = (float)rayIndex / (float)rayCount;
+    return (player.fov * -0.5f) + (rayScaler * player.fov);
+}
+
+// Direction of column rayIndex, angle relative to the facing angle.
+inline void GetColumnRay(int rayIndex, int rayCount, float *angle, float *cos, float *sin)
+{
+    *angle = GetColumnAngle(rayIndex, rayCount);
+    *cos = cosf((player.facingAngle + *angle) * AngleToRadian);
+    *sin = sinf((player.facingAngle + *angle) * AngleToRadian);
 }
 
-void DrawRays(ScreenBuffer buffer, RayHits* hits)
+// Records the hit of column rayIndex, distance along the ray, corrected
+// to the perpendicular distance the FPS view projects.
+inline void SetRayHit(RayHits *hits, int rayIndex, float angle, float distance, TileType tile, Texture texture)
 {
-    int rayCount = FpsViewDimsInPixels.x;
+    auto *hitData = &hits->data[rayIndex];
+    hitData->wasHit = true;
+    hitData->distanceFromPlayer = cosf((angle) * AngleToRadian) * distance;
+    hitData->color = GetTileColor(tile, texture);
+}
+
+#include "simd_rays.h"
+
+// Where ray samples land on the minimap. Rays are traced in pixels from the
+// origin of the player's tile, without Vec2 so this needs no constructor.
+struct MinimapTrail
+{
+    float eyeX;
+    float eyeY;
+    int width;
+    int height;
+    int baseX;
+    int baseY;
+};
+
+MinimapTrail GetMinimapTrail(ScreenBuffer buffer)
+{
+    Vec2 minimapOrigin = TileToPixelPosition(GetMinimapOriginTile(buffer), TileDimsInPixels);
+    Vec2 minimapDims = TileToPixelPosition(GetMinimapDimsInTiles(buffer), TileDimsInPixels);
+    MinimapTrail trail;
+    trail.eyeX = player.position.offset.x;
+    trail.eyeY = player.position.offset.y;
+    trail.width = (int)minimapDims.x;
+    trail.height = (int)minimapDims.y;
+    trail.baseX = TileOriginPixelX(player.position) - (int)minimapOrigin.x;
+    trail.baseY = TileOriginPixelY(player.position) - (int)minimapOrigin.y;
+    return trail;
+}
+
+inline Vec2 GetRaySample(const MinimapTrail *trail, float cos, float sin, int i)
+{
+    return Vec2(trail->eyeX + cos * i, trail->eyeY + sin * i);
+}
+
+// The white trail of samples [0, sampleEnd), all known to be open.
+void DrawRayTrail(ScreenBuffer buffer, const MinimapTrail *trail, float cos, float sin, int sampleEnd)
+{
+    // The minimap is convex, once the trail leaves it no later sample can be
+    // on it.
+    bool onMinimap = false;
+    for (int i = 0; i < sampleEnd; i += 2)
+    {
+        Vec2 rayPixelPosition = GetRaySample(trail, cos, sin, i);
+        int minimapX = trail->baseX + FloorToInt(rayPixelPosition.x);
+        int minimapY = trail->baseY + FloorToInt(rayPixelPosition.y);
+        if (minimapX >= 0 && minimapY >= 0 && minimapX < trail->width && minimapY < trail->height)
+        {
+            SetPixelColor(buffer, minimapX, minimapY, White);
+            onMinimap = true;
+        }
+        else if (onMinimap)
+        {
+            break;
+        }
+    }
+}
+
+// Row of the horizon in the FPS view. Pitch shears the view by moving it,
+// walls keep their size and no column costs more than looking straight.
+inline int GetHorizonRow(ScreenBuffer buffer)
+{
+    return buffer.viewHeight / 2 + (int)(player.pitch * buffer.viewHeight);
+}
+
+template<typename Geometry>
+void DrawRaysKernel(ScreenBuffer buffer, Texture texture, RayHits* hits)
+{
+    int rayCount = Geometry::ColumnCount(hits);
+
+    // Rays are traced in pixels from the origin of the player's tile.
+    Vec2 eye = player.position.offset;
+    Vec2 minimapOrigin = TileToPixelPosition(GetMinimapOriginTile(buffer), TileDimsInPixels);
+    Vec2 minimapDims = TileToPixelPosition(GetMinimapDimsInTiles(buffer), TileDimsInPixels);
+    int minimapBaseX = TileOriginPixelX(player.position) - (int)minimapOrigin.x;
+    int minimapBaseY = TileOriginPixelY(player.position) - (int)minimapOrigin.y;
 
     for (int rayIndex = 0; rayIndex < rayCount; ++rayIndex)
     {
-        float rayScaler = (float)rayIndex / (float)rayCount;
-        float angle = (player.fov * -0.5f) + (rayScaler * player.fov); 
-        float cos = cosf((player.facingAngle + angle) * AngleToRadian);
-        float sin = sinf((player.facingAngle + angle) * AngleToRadian);
+        float angle, cos, sin;
+        GetColumnRay(rayIndex, rayCount, &angle, &cos, &sin);
 
-        for (int i = 0; i < RayLength; i += 2)
+        for (int i = 0; i < viewDistance; i += 2)
         {
-            Vec2 rayPixelPosition(player.pixelPosition.x + cos * i, player.pixelPosition.y + sin * i);
-            Vec2 tilePosition = PixelToTilePosition(buffer, rayPixelPosition.x, rayPixelPosition.y);
-            TileType tile = GetTileValue(tilePosition);
+            Vec2 rayPixelPosition(eye.x + cos * i, eye.y + sin * i);
+            int pixelX = FloorToInt(rayPixelPosition.x);
+            int pixelY = FloorToInt(rayPixelPosition.y);
+            TileType tile = Geometry::GetTile(player.position.tileX + Geometry::FloorPixelToTileX(pixelX),
+                                              player.position.tileY + Geometry::FloorPixelToTileY(pixelY));
 
             if (tile == _)
             {
-                SetPixelColor(buffer, rayPixelPosition.x, rayPixelPosition.y, White);
+                int minimapX = minimapBaseX + pixelX;
+                int minimapY = minimapBaseY + pixelY;
+                if (minimapX >= 0 && minimapY >= 0 && minimapX < minimapDims.x && minimapY < minimapDims.y)
+                {
+                    SetPixelColor(buffer, minimapX, minimapY, White);
+                }
             }
             else
             {
-                float distance = Distance(player.pixelPosition, rayPixelPosition);
-                auto *hitData = &hits->data[rayIndex];
-                hitData->wasHit = true;
-                hitData->distanceFromPlayer = cosf((angle) * AngleToRadian) * distance;
-                hitData->color = GetPixelColorAt(buffer, rayPixelPosition);
+                SetRayHit(hits, rayIndex, angle, Distance(eye, rayPixelPosition), tile, texture);
                 break;
             }
         }
     }
 }
 
+void DrawRays(ScreenBuffer buffer, Texture texture, RayHits* hits)
+{
+    if (kernels.traceRays && world.tiles)
+    {
+        kernels.traceRays(buffer, texture, hits);
+        return;
+    }
+
+    switch (SelectGeometry(hits))
+    {
+    case Geometry_BuiltIn:
+        DrawRaysKernel<BuiltInGeometry>(buffer, texture, hits);
+        break;
+    case Geometry_Bricked:
+        DrawRaysKernel<BrickedGeometry>(buffer, texture, hits);
+        break;
+    case Geometry_Streamed:
+        DrawRaysKernel<StreamedGeometry>(buffer, texture, hits);
+        break;
+    default:
+        DrawRaysKernel<DynamicGeometry>(buffer, texture, hits);
+        break;
+    }
+}
+
+#include "fixed.h"
+#include "hitcache.h"
+#include "sectors.h"
+#include "pvs.h"
+#include "distfield.h"
+#include "adaptive.h"
+#include "segments.h"
+#include "walls.h"
+#include "bsp.h"
+#include "heights.h"
+#include "terrain.h"
+
+enum RayCaster
+{
+    RayCaster_Float,
+    RayCaster_Fixed,
+    RayCaster_Cached,
+    RayCaster_DistanceField,
+    RayCaster_Portal,
+    RayCaster_Adaptive,
+    RayCaster_Segments,
+    RayCaster_Bsp,
+    RayCaster_Count
+};
+
+const char *RayCasterNames[RayCaster_Count] = { "float", "fixed", "cached", "sdf", "portal", "adaptive", "segments", "bsp" };
+
+RayCaster rayCaster = RayCaster_Float;
+
+bool ParseRayCaster(const char *name, RayCaster *result)
+{
+    for (int i = 0; i < RayCaster_Count; ++i)
+    {
+        if (strcmp(name, RayCasterNames[i]) == 0)
+        {
+            *result = (RayCaster)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CastRays(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    // The other casters keep per map state built from world.tiles, the
+    // BSP level does not use them.
+    if (IsWorldStreamed() && rayCaster != RayCaster_Bsp)
+    {
+        DrawRays(buffer, texture, hits);
+        CastWalls(buffer, texture, hits);
+        return;
+    }
+
+    switch (rayCaster)
+    {
+    case RayCaster_Fixed:
+        DrawRaysFixed(buffer, texture, hits);
+        break;
+    case RayCaster_Cached:
+        DrawRaysCached(buffer, texture, hits);
+        break;
+    case RayCaster_DistanceField:
+        DrawRaysDistanceField(buffer, texture, hits);
+        break;
+    case RayCaster_Portal:
+        DrawRaysPortal(buffer, texture, hits);
+        break;
+    case RayCaster_Adaptive:
+        DrawRaysAdaptive(buffer, texture, hits);
+        break;
+    case RayCaster_Segments:
+        DrawRaysSegments(buffer, texture, hits);
+        break;
+    case RayCaster_Bsp:
+        DrawRaysBsp(buffer, texture, hits);
+        break;
+    default:
+        DrawRays(buffer, texture, hits);
+        break;
+    }
+    CastWalls(buffer, texture, hits);
+}
+
 void DrawPlayer(ScreenBuffer buffer)
 {
-    DrawRect(buffer, player.pixelPosition, player.dimensions, Black);
+    Vec2 originTile = GetMinimapOriginTile(buffer);
+    WorldPosition minimapOrigin = { (int)originTile.x, (int)originTile.y, Vec2(0, 0) };
+    DrawRect(buffer, WorldPositionDelta(minimapOrigin, player.position), player.dimensions, Black);
 }
 
 void DrawFpsView(ScreenBuffer buffer, RayHits *hits)
 {
-    DrawRect(buffer, Vec2(MapDimsInPixels.x, 0), FpsViewDimsInPixels, Grey);
+    static ColumnSpans spans;
+    spans.count = SDL_min(hits->count, buffer.viewWidth);
+    if (spans.count <= 0)
+    {
+        return;
+    }
 
-    for (int i = 0; i < ArrayCount(hits->data); ++i)
+    int halfHeight = (buffer.viewHeight / 2);
+    int horizon = GetHorizonRow(buffer);
+    for (int i = 0; i < spans.count; ++i)
     {
         auto ray = hits->data[i];
+        spans.top[i] = 0;
+        spans.bottom[i] = 0;
+        spans.color[i] = ray.color;
+
         if (ray.wasHit)
         {
-            float lineSize = 1 - (ray.distanceFromPlayer / RayLength);
-            int halfHeight = (buffer.height / 2);
-            int lineTopY = halfHeight - (lineSize * halfHeight);
-            int lineBottomY = halfHeight + (lineSize * halfHeight);
-            
-            for (int y = halfHeight; y > lineTopY; --y)
-            {
-                // float alphaScale = 1.0f - (float) lineTopY / y;
-                // Uint32 alpha = (Uint32)(alphaScale * 255);
-
-                SetPixelColor(buffer, Vec2(MapDimsInPixels.x + i, y), ray.color);
-            }
+            float lineSize = 1 - (ray.distanceFromPlayer / viewDistance);
+            int lineTopY = horizon - (lineSize * halfHeight);
+            int lineBottomY = horizon + (lineSize * halfHeight);
 
-            for (int y = halfHeight; y < lineBottomY; ++y)
+            // The wall grows from the horizon up to just below lineTopY and
+            // down to just above lineBottomY, always covering the horizon row.
+            bool above = lineTopY < horizon;
+            bool below = lineBottomY > horizon;
+            if (above || below)
             {
-                // float alphaScale = 1.0f - (float) y / lineBottomY;
-                // Uint8 alpha = (Uint8)(alphaScale * 255);
-
-                SetPixelColor(buffer, Vec2(MapDimsInPixels.x + i, y), ray.color);
+                spans.top[i] = SDL_max(above ? lineTopY + 1 : horizon, 0);
+                spans.bottom[i] = SDL_min(below ? lineBottomY : horizon + 1, buffer.viewHeight);
             }
         }
     }
+
+    Uint32 *origin = (Uint32 *)(buffer.memory) + (int)MapDimsInPixels.x;
+    kernels.fillColumns(origin, buffer.pitch / buffer.bytesPerPixel, buffer.viewHeight, &spans, Grey);
 }
 
-void ClearHits(RayHits *hits)
+void ClearHits(RayHits *hits, int rayCount)
 {
-    for (int hitIndex = 0; hitIndex < ArrayCount(hits->data); ++hitIndex)
+    hits->count = rayCount;
+    for (int hitIndex = 0; hitIndex < rayCount; ++hitIndex)
     {
         auto* hit = hits->data + hitIndex;
         hit->wasHit = false;
@@ -372,85 +784,423 @@ void DrawTexture(ScreenBuffer buffer, Texture texture, int textureIndex)
     const int textureEndX = (textureIndex + 1) * textureWidth;
     assert(textureEndX <= texture.width);
 
-    for (int x = textureStartX ; x < textureEndX; ++x)
+    const Uint8 *source = texture.data + textureStartX * texture.bytesPerPixel;
+    CopyRect(buffer, textureStartX, 0, textureWidth, texture.height, source, texture.width * texture.bytesPerPixel);
+}
+
+ScreenBuffer CreateScreenBuffer(SDL_Texture *texture, int width, int height)
+{
+    const int bytesPerPixel = 4;
+
+    ScreenBuffer buffer = {0};
+    buffer.texture = texture;
+    buffer.bytesPerPixel = bytesPerPixel;
+    buffer.width = width;
+    buffer.height = height;
+    buffer.pitch = width * bytesPerPixel;
+    buffer.memory = (Uint8 *) malloc(width * height * bytesPerPixel);
+    buffer.viewWidth = SDL_max(0, SDL_min(width - (int)MapDimsInPixels.x, MaxRayCount));
+    buffer.viewHeight = height;
+    return buffer;
+}
+
+Texture LoadTexture(const char *path)
+{
+    int imgWidth;
+    int imgHeight;
+    int compsPerPixel;
+
+    Texture texture = {0};
+
+    Uint8 *data = stbi_load(path, &imgWidth, &imgHeight, &compsPerPixel, STBI_rgb_alpha);
+    if (data)
+    {
+        texture.width = imgWidth;
+        texture.height = imgHeight;
+        // stbi_load converts to RGBA regardless of the file's components.
+        texture.bytesPerPixel = 4;
+        texture.data = data;
+    }
+    return texture;
+}
+
+void RenderFrame(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    // Outdoors there are no tiles to cast rays against.
+    if (terrain.texels)
     {
-        for (int y = 0; y < texture.height; ++y)
+        DrawTerrainMap(buffer);
+        DrawTerrain(buffer);
+        return;
+    }
+    DrawMap(buffer, texture);
+    // One ray per column of the FPS view to the right of the minimap.
+    ClearHits(hits, buffer.viewWidth);
+    // Stacked spans need a walk that continues past short walls.
+    if (tileHeights.floor)
+    {
+        DrawRaysLayered(buffer, texture, hits);
+        DrawPlayer(buffer);
+        DrawFpsViewLayered(buffer);
+        return;
+    }
+    CastRays(buffer, texture, hits);
+    DrawPlayer(buffer);
+    DrawFpsView(buffer, hits);
+}
+
+#include "png.h"
+#include "golden.h"
+#include "resolution.h"
+#include "pipeline.h"
+
+struct LaunchOptions
+{
+    const char *recordPath;
+    const char *replayPath;
+    const char *goldenPath;
+    bool goldenUpdate;
+    int goldenTolerance;
+    SimdLevel simdLevel;
+    const char *worldPath;
+    int chunkBudgetMb;
+    const char *wallsPath;
+    const char *bspPath;
+    const char *heightsPath;
+    const char *terrainPath;
+    const char *terrainColorsPath;
+    TileLayout layout;
+    const char *latencyPath;
+    float frameBudgetMs;
+    bool singleThread;
+    bool headless;
+};
+
+bool ParseLaunchOptions(int argc, char *argv[], LaunchOptions *options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--record") == 0 && hasValue)
+        {
+            options->recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && hasValue)
+        {
+            options->replayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--golden") == 0 && hasValue)
+        {
+            options->goldenPath = argv[++i];
+            options->headless = true;
+        }
+        else if (strcmp(argv[i], "--golden-update") == 0 && hasValue)
+        {
+            options->goldenPath = argv[++i];
+            options->goldenUpdate = true;
+            options->headless = true;
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && hasValue)
+        {
+            options->goldenTolerance = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--raycaster") == 0 && hasValue)
+        {
+            if (!ParseRayCaster(argv[++i], &rayCaster))
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown ray caster : %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--simd") == 0 && hasValue)
+        {
+            if (!ParseSimdLevel(argv[++i], &options->simdLevel))
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown SIMD level : %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--world") == 0 && hasValue)
+        {
+            options->worldPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--chunk-budget") == 0 && hasValue)
+        {
+            int budget = atoi(argv[++i]);
+            options->chunkBudgetMb = SDL_max(1, budget);
+        }
+        else if (strcmp(argv[i], "--walls") == 0 && hasValue)
+        {
+            options->wallsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bsp") == 0 && hasValue)
+        {
+            options->bspPath = argv[++i];
+            rayCaster = RayCaster_Bsp;
+        }
+        else if (strcmp(argv[i], "--heights") == 0 && hasValue)
+        {
+            options->heightsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--terrain") == 0 && hasValue)
+        {
+            options->terrainPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--terrain-colors") == 0 && hasValue)
+        {
+            options->terrainColorsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--terrain-distance") == 0 && hasValue)
+        {
+            float distance = (float)atof(argv[++i]);
+            terrainDistance = SDL_max(2.0f, distance);
+        }
+        else if (strcmp(argv[i], "--terrain-threads") == 0 && hasValue)
+        {
+            terrainThreadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--layout") == 0 && hasValue)
+        {
+            if (!ParseTileLayout(argv[++i], &options->layout))
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown tile layout : %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--frame-budget") == 0 && hasValue)
+        {
+            options->frameBudgetMs = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--latency-log") == 0 && hasValue)
         {
-            Uint32* color = (Uint32*)(texture.data + (x + y * texture.width) * texture.bytesPerPixel);
-            SetPixelColor(buffer, Vec2(x, y), *color);
+            options->latencyPath = argv[++i];
         }
+        else if (strcmp(argv[i], "--single-thread") == 0)
+        {
+            options->singleThread = true;
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+        {
+            options->headless = true;
+        }
+        else
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown argument : %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (options->headless && !options->replayPath && !options->goldenPath)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "--headless needs --replay to drive the player\n");
+        return false;
+    }
+    if (options->recordPath && options->replayPath)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "--record and --replay are exclusive\n");
+        return false;
     }
+    if (rayCaster == RayCaster_Bsp && !options->bspPath)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "--raycaster bsp needs a level from --bsp\n");
+        return false;
+    }
+    // The layered walk has its own traversal of the tile map.
+    if (options->heightsPath && (rayCaster != RayCaster_Float || options->wallsPath || options->bspPath))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "--heights draws the tile map only, without --raycaster, --walls or --bsp\n");
+        return false;
+    }
+    if (options->terrainColorsPath && !options->terrainPath)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "--terrain-colors needs a heightmap from --terrain\n");
+        return false;
+    }
+    return true;
 }
 
+#ifndef RAYCASTER_NO_MAIN
 int main(int argc, char *argv[])
 {
     static_assert(ArrayCount(Map) == MapDimsInTiles.y * MapDimsInTiles.x, "Invalid array size.");
     
     SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO);
 
-    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    LaunchOptions options = {0};
+    options.simdLevel = Simd_Count;
+    options.chunkBudgetMb = 64;
+    if (!ParseLaunchOptions(argc, argv, &options))
+    {
+        return 1;
+    }
+
+    if (SDL_Init(options.headless ? 0 : SDL_INIT_VIDEO) != 0)
     {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_Init fail : %s\n", SDL_GetError());
         return 1;
     }
 
-    auto *window = SDL_CreateWindow("Raycaster", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WindowSize.x, WindowSize.y, 0);
-    if (!window)
+    InitRenderKernels(options.simdLevel);
+
+    SDL_Window *window = NULL;
+    SDL_Renderer *renderer = NULL;
+    SDL_Texture *texture = NULL;
+
+    if (!options.headless)
+    {
+        window = SDL_CreateWindow("Raycaster", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WindowSize.x, WindowSize.y, 0);
+        if (!window)
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Window creation fail : %s\n", SDL_GetError());
+            return 1;
+        }
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+        if (!renderer)
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Render creation for surface fail : %s\n", SDL_GetError());
+            return 1;
+        }
+
+        SDL_RenderClear(renderer);
+
+        // Stretched views look less blocky filtered.
+        if (options.frameBudgetMs > 0)
+        {
+            SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+        }
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, WindowSize.x, WindowSize.y);
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    }
+
+    InputLog inputLog = {0};
+    if (options.replayPath && !LoadReplay(&inputLog, options.replayPath, &player))
     {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Window creation fail : %s\n", SDL_GetError());
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Replay load fail : %s\n", options.replayPath);
         return 1;
     }
-    auto *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
-    if (!renderer)
+    if (options.recordPath && !BeginRecording(&inputLog, options.recordPath, player))
     {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Render creation for surface fail : %s\n", SDL_GetError());
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Recording fail : %s\n", options.recordPath);
         return 1;
     }
 
-    SDL_RenderClear(renderer);
+    if (options.worldPath && !OpenChunkStream(options.worldPath, (size_t)options.chunkBudgetMb << 20))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "World load fail : %s\n", options.worldPath);
+        return 1;
+    }
 
-    auto *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, WindowSize.x, WindowSize.y);
-    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    if (options.wallsPath && !LoadWalls(options.wallsPath))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Walls load fail : %s\n", options.wallsPath);
+        return 1;
+    }
 
-    const int bytesPerPixel = 4;
+    if (options.bspPath && !LoadBsp(&bsp, options.bspPath))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "BSP load fail : %s\n", options.bspPath);
+        return 1;
+    }
 
-    ScreenBuffer buffer = {0};
-    buffer.texture = texture;
-    buffer.bytesPerPixel = bytesPerPixel;
-    buffer.width = WindowSize.x;
-    buffer.height = WindowSize.y;
-    buffer.pitch = WindowSize.x * bytesPerPixel;
-    buffer.memory = (Uint8 *) malloc(WindowSize.x * WindowSize.y * bytesPerPixel);
+    if (options.layout != TileLayout_RowMajor && world.tiles)
+    {
+        SetWorld(ConvertTileLayout(world, options.layout));
+    }
 
-    int imgWidth;
-    int imgHeight;
-    int compsPerPixel;
+    if (options.heightsPath && !LoadTileHeights(options.heightsPath))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Heights load fail : %s\n", options.heightsPath);
+        return 1;
+    }
 
-    Texture imgTexture = {0};
+    if (options.terrainPath && !LoadTerrain(options.terrainPath, options.terrainColorsPath))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Terrain load fail : %s\n", options.terrainPath);
+        return 1;
+    }
 
-    Uint8 *data = stbi_load("walltext.png", &imgWidth, &imgHeight, &compsPerPixel, STBI_rgb_alpha);
-    if (data)
+    ScreenBuffer buffer = CreateScreenBuffer(texture, WindowSize.x, WindowSize.y);
+
+    Texture imgTexture = LoadTexture("walltext.png");
+
+    if (options.goldenPath)
     {
-        imgTexture.width = imgWidth;
-        imgTexture.height = imgHeight;
-        imgTexture.bytesPerPixel = compsPerPixel;
-        imgTexture.data = data;
+        int failures = RunGoldenImages(buffer, imgTexture, options.goldenPath, options.goldenUpdate, options.goldenTolerance);
+        SDL_Quit();
+        return failures == 0 ? 0 : 1;
+    }
+
+    done = false;
+    LatencyTracker *latency = (LatencyTracker *) calloc(1, sizeof(LatencyTracker));
+
+    // Interactive runs simulate, render and handle input on separate threads.
+    if (!options.headless && !IsReplaying(&inputLog) && !options.singleThread)
+    {
+        Pipeline pipeline;
+        if (!StartPipeline(&pipeline, buffer, imgTexture, &inputLog, options.frameBudgetMs))
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Thread creation fail : %s\n", SDL_GetError());
+            return 1;
+        }
+        while (!done)
+        {
+            PumpPipeline(&pipeline, renderer, latency);
+        }
+        StopPipeline(&pipeline);
+        ReportLatency(latency, options.latencyPath);
+
+        EndRecording(&inputLog);
+        CloseChunkStream();
+        FreeTerrain();
+        SDL_Quit();
+        return 0;
     }
 
     RayHits hits = {0};
+    ResolutionScaler scaler = MakeResolutionScaler(IsReplaying(&inputLog) ? 0.0f : options.frameBudgetMs);
 
-    done = false;
+    Uint32 frame = 0;
+    Uint64 renderCounter = 0;
+    Uint64 sequenceHash = 0;
 
     while (!done)
     {
-        DrawMap(buffer, imgTexture);
-        ClearHits(&hits);
-        DrawRays(buffer, &hits);
-        DrawPlayer(buffer);
-        DrawFpsView(buffer, &hits);
-        Update(window, renderer, buffer);
+        UpdateChunkStream();
+        if (IsReplaying(&inputLog))
+        {
+            WaitForChunkLoads();
+        }
+
+        // Actions are applied as they are polled, the frame reflects all of them.
+        ApplyResolution(&scaler, &buffer);
+        Uint64 renderStart = SDL_GetPerformanceCounter();
+        RenderFrame(buffer, imgTexture, &hits);
+        Uint64 renderEnd = SDL_GetPerformanceCounter();
+        renderCounter += renderEnd - renderStart;
+        UpdateResolution(&scaler, (float)(CounterToUs(renderEnd - renderStart) * 1e-3));
+        FrameLatency frameLatency = { latency->nextInput, 0, renderEnd };
+
+        if (IsReplaying(&inputLog))
+        {
+            sequenceHash = sequenceHash * 31 + HashScreenBuffer(buffer);
+        }
+
+        Update(window, renderer, buffer, &inputLog, frame, latency, frameLatency);
+        ++frame;
     }
 
+    if (IsReplaying(&inputLog))
+    {
+        double renderMs = (double)renderCounter * 1000.0 / (double)SDL_GetPerformanceFrequency();
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Replay: %u frames, %.3f ms render, %.4f ms/frame, hash %016llx",
+                    frame, renderMs, renderMs / frame, (unsigned long long)sequenceHash);
+    }
+    ReportLatency(latency, options.latencyPath);
+    EndRecording(&inputLog);
+    CloseChunkStream();
+    FreeTerrain();
+
     SDL_Quit();
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,163 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+
+// Input recording and deterministic replay.
+//
+// A recording starts with the initial player state followed by one record per
+// applied action. Version 2 stores the player's tile and offset into it,
+// version 1 files with an absolute pixel position still load. Each record
+// stores the frame it was applied on and the milliseconds since recording
+// started. Replays ignore the wall clock and apply each action on its
+// recorded frame, so two builds fed the same file render exactly the same
+// frames.
+
+const char ReplayMagic[4] = {'R', 'C', 'I', 'N'};
+const Uint32 ReplayVersion = 2;
+
+struct InputEvent
+{
+    Uint32 frame;
+    Uint32 ticks;
+    Uint8 action;
+};
+
+struct InputLog
+{
+    FILE *recordFile;
+    Uint32 recordStartTicks;
+
+    InputEvent *events;
+    int eventCount;
+    int nextEvent;
+};
+
+inline bool IsRecording(InputLog *log)
+{
+    return log && log->recordFile;
+}
+
+inline bool IsReplaying(InputLog *log)
+{
+    return log && log->events;
+}
+
+inline bool ReplayFinished(InputLog *log)
+{
+    return log->nextEvent >= log->eventCount;
+}
+
+bool BeginRecording(InputLog *log, const char *path, Player initialState)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    Sint32 tile[] = { initialState.position.tileX, initialState.position.tileY };
+    float state[] =
+    {
+        initialState.position.offset.x, initialState.position.offset.y,
+        initialState.facingAngle, initialState.speed, initialState.fov
+    };
+
+    fwrite(ReplayMagic, sizeof(ReplayMagic), 1, file);
+    fwrite(&ReplayVersion, sizeof(ReplayVersion), 1, file);
+    fwrite(tile, sizeof(tile), 1, file);
+    fwrite(state, sizeof(state), 1, file);
+
+    log->recordFile = file;
+    log->recordStartTicks = SDL_GetTicks();
+    return true;
+}
+
+void RecordAction(InputLog *log, Uint32 frame, Uint8 action)
+{
+    if (!IsRecording(log))
+    {
+        return;
+    }
+
+    // Records are written field by field so the file stays at 9 bytes per
+    // action regardless of struct padding.
+    Uint32 ticks = SDL_GetTicks() - log->recordStartTicks;
+    fwrite(&frame, sizeof(frame), 1, log->recordFile);
+    fwrite(&ticks, sizeof(ticks), 1, log->recordFile);
+    fwrite(&action, sizeof(action), 1, log->recordFile);
+}
+
+void EndRecording(InputLog *log)
+{
+    if (IsRecording(log))
+    {
+        fclose(log->recordFile);
+        log->recordFile = NULL;
+    }
+}
+
+bool LoadReplay(InputLog *log, const char *path, Player *initialState)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    char magic[4];
+    Uint32 version;
+    Sint32 tile[2] = {0};
+    float state[5];
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        memcmp(magic, ReplayMagic, sizeof(magic)) != 0 ||
+        (version != 1 && version != ReplayVersion) ||
+        (version >= 2 && fread(tile, sizeof(tile), 1, file) != 1) ||
+        fread(state, sizeof(state), 1, file) != 1)
+    {
+        fclose(file);
+        return false;
+    }
+
+    int capacity = 256;
+    InputEvent *events = (InputEvent *) malloc(capacity * sizeof(InputEvent));
+    int count = 0;
+
+    InputEvent event;
+    while (fread(&event.frame, sizeof(event.frame), 1, file) == 1 &&
+           fread(&event.ticks, sizeof(event.ticks), 1, file) == 1 &&
+           fread(&event.action, sizeof(event.action), 1, file) == 1)
+    {
+        if (count == capacity)
+        {
+            capacity *= 2;
+            events = (InputEvent *) realloc(events, capacity * sizeof(InputEvent));
+        }
+        events[count++] = event;
+    }
+    fclose(file);
+
+    initialState->position = MakeWorldPosition(tile[0], tile[1], Vec2(state[0], state[1]));
+    initialState->facingAngle = state[2];
+    initialState->speed = state[3];
+    initialState->fov = state[4];
+
+    log->events = events;
+    log->eventCount = count;
+    log->nextEvent = 0;
+    return true;
+}
+
+// Returns the next action recorded for the given frame, or 0 once the frame
+// has no more actions left.
+int NextReplayAction(InputLog *log, Uint32 frame)
+{
+    if (ReplayFinished(log) || log->events[log->nextEvent].frame != frame)
+    {
+        return 0;
+    }
+    return log->events[log->nextEvent++].action;
+}
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+// Dynamic resolution.
+//
+// With a frame budget, the FPS view is rendered into the top left of its
+// part of the buffer at a fraction of the native size and stretched back
+// over the whole part when presented. The fraction goes in eighths from 8/8
+// down to 3/8, columns and rows alike.
+//
+// Render times are smoothed, and the two directions have different bars so
+// the scale settles instead of flipping every frame: a few frames over budget
+// drop a step, while going up takes many frames in which the next step,
+// predicted from the pixel count, would still leave headroom. A step up
+// that has to be taken back soon after doubles the wait for the next one,
+// so a view right at the edge of the budget stops bouncing.
+//
+// Replays and golden images always render at the native size.
+
+const int ResolutionSteps = 8;
+const int MinResolutionStep = 3;
+const float ResolutionSmoothing = 0.1f;
+const int DownscaleFrames = 4;
+const int UpscaleFrames = 30;
+const int MaxUpscaleFrames = 960;
+// Fraction of the budget the next step up is predicted to stay under.
+const float UpscaleHeadroom = 0.85f;
+
+struct ResolutionScaler
+{
+    // No scaling when zero.
+    float budgetMs;
+    // Eighths of the native view size.
+    int step;
+    float averageMs;
+    int overBudgetFrames;
+    int underBudgetFrames;
+    // Frames under budget a step up waits for, and frames since the last one.
+    int upscaleFrames;
+    int sinceUpscale;
+};
+
+ResolutionScaler MakeResolutionScaler(float budgetMs)
+{
+    return ResolutionScaler { budgetMs, ResolutionSteps, 0.0f, 0, 0, UpscaleFrames, MaxUpscaleFrames };
+}
+
+// Sets the size buffer's FPS view is rendered at for the current step.
+void ApplyResolution(const ResolutionScaler *scaler, ScreenBuffer *buffer)
+{
+    int nativeWidth = SDL_max(0, SDL_min(buffer->width - (int)MapDimsInPixels.x, MaxRayCount));
+    buffer->viewWidth = nativeWidth * scaler->step / ResolutionSteps;
+    buffer->viewHeight = buffer->height * scaler->step / ResolutionSteps;
+}
+
+// Moves the step by the size ratio squared, the smoothed time along with it.
+inline void ChangeResolutionStep(ResolutionScaler *scaler, int step)
+{
+    float ratio = (float)step / (float)scaler->step;
+    scaler->averageMs *= ratio * ratio;
+    scaler->step = step;
+    scaler->overBudgetFrames = 0;
+    scaler->underBudgetFrames = 0;
+}
+
+// Takes the time the last frame took to render, true when the step changed.
+bool UpdateResolution(ResolutionScaler *scaler, float frameMs)
+{
+    if (scaler->budgetMs <= 0)
+    {
+        return false;
+    }
+
+    ++scaler->sinceUpscale;
+    scaler->averageMs = scaler->averageMs > 0 ? scaler->averageMs + (frameMs - scaler->averageMs) * ResolutionSmoothing : frameMs;
+
+    if (scaler->averageMs > scaler->budgetMs)
+    {
+        ++scaler->overBudgetFrames;
+        scaler->underBudgetFrames = 0;
+    }
+    else
+    {
+        scaler->overBudgetFrames = 0;
+        float ratio = (float)(scaler->step + 1) / (float)scaler->step;
+        bool fits = scaler->averageMs * ratio * ratio < scaler->budgetMs * UpscaleHeadroom;
+        scaler->underBudgetFrames = (scaler->step < ResolutionSteps && fits) ? scaler->underBudgetFrames + 1 : 0;
+    }
+
+    if (scaler->overBudgetFrames >= DownscaleFrames && scaler->step > MinResolutionStep)
+    {
+        if (scaler->sinceUpscale < scaler->upscaleFrames)
+        {
+            scaler->upscaleFrames = SDL_min(2 * scaler->upscaleFrames, MaxUpscaleFrames);
+        }
+        ChangeResolutionStep(scaler, scaler->step - 1);
+        return true;
+    }
+    if (scaler->underBudgetFrames >= scaler->upscaleFrames)
+    {
+        // A step that held for long enough earns back a quicker next one.
+        if (scaler->sinceUpscale >= 4 * scaler->upscaleFrames)
+        {
+            scaler->upscaleFrames = SDL_max(scaler->upscaleFrames / 2, UpscaleFrames);
+        }
+        scaler->sinceUpscale = 0;
+        ChangeResolutionStep(scaler, scaler->step + 1);
+        return true;
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,471 @@
+#ifndef SECTORS_H
+#define SECTORS_H
+
+// Sector and portal visibility for large levels.
+//
+// BuildSectors splits the open tiles into convex sectors, maximal rectangles
+// taken greedily in scan order. Sectors are connected by portals wherever
+// they touch: runs of a sector's outside border owned by one neighbour, and
+// the four corner tiles, which rays can pass through diagonally. Portals are
+// found on the fly from the tile ownership, so nothing but the rectangles is
+// stored per sector.
+//
+// Every frame FindVisibleSectors walks the portal graph from the player's
+// sector, clipping the view frustum to the angular extent of each portal and
+// dropping portals beyond the view distance. DrawRaysPortal then traces rays
+// sector by sector: inside a sector a ray jumps straight to where it leaves
+// the rectangle, and a ray entering a sector the walk did not reach stops,
+// since nothing in it is in view. Samples are taken at the same steps as
+// DrawRays, so the hits are identical, and the cost follows the number of
+// visible sectors rather than the view distance or the level size.
+
+// In tiles, ints so any map the tile indices reach fits.
+struct Sector
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// A frustum slice, in degrees relative to the facing angle.
+struct SectorWindow
+{
+    int sector;
+    float minAngle;
+    float maxAngle;
+};
+
+struct SectorMap
+{
+    // worldGeneration the sectors were built for.
+    Uint32 generation;
+    int width;
+    int height;
+
+    // Sector index + 1 per tile, 0 for walls.
+    Uint32 *sectorOfTile;
+    Sector *sectors;
+    int sectorCount;
+    int sectorCapacity;
+
+    // Per sector union of the windows it was reached with, valid when the
+    // stamp matches visibleStamp.
+    Uint32 *windowStamp;
+    float *windowMin;
+    float *windowMax;
+    Uint32 visibleStamp;
+
+    // Tiles within the view distance of the player, inclusive.
+    int viewMinX;
+    int viewMinY;
+    int viewMaxX;
+    int viewMaxY;
+
+    SectorWindow *stack;
+    int stackCount;
+    int stackCapacity;
+};
+
+SectorMap sectorMap;
+
+// Rays can leave a sector up to one sample step past a portal's end, and the
+// sample positions round differently from the exact ray.
+const float PortalPadding = 2.0f;
+
+inline bool IsOpenUnassigned(int x, int y)
+{
+    return world.tiles[TileIndex(world, x, y)] == _ && sectorMap.sectorOfTile[x + y * sectorMap.width] == 0;
+}
+
+void BuildSectors()
+{
+    size_t tileCount = (size_t)world.width * world.height;
+    free(sectorMap.sectorOfTile);
+    sectorMap.sectorOfTile = (Uint32 *) calloc(tileCount, sizeof(Uint32));
+    sectorMap.generation = worldGeneration;
+    sectorMap.width = world.width;
+    sectorMap.height = world.height;
+    sectorMap.sectorCount = 0;
+
+    for (int y = 0; y < world.height; ++y)
+    {
+        for (int x = 0; x < world.width; ++x)
+        {
+            if (!IsOpenUnassigned(x, y))
+            {
+                continue;
+            }
+
+            int width = 1;
+            while (x + width < world.width && IsOpenUnassigned(x + width, y))
+            {
+                ++width;
+            }
+
+            int height = 1;
+            for (bool rowOpen = true; rowOpen && y + height < world.height; )
+            {
+                for (int i = 0; i < width && rowOpen; ++i)
+                {
+                    rowOpen = IsOpenUnassigned(x + i, y + height);
+                }
+                height += rowOpen;
+            }
+
+            if (sectorMap.sectorCount == sectorMap.sectorCapacity)
+            {
+                sectorMap.sectorCapacity = SDL_max(256, sectorMap.sectorCapacity * 2);
+                sectorMap.sectors = (Sector *) realloc(sectorMap.sectors, sectorMap.sectorCapacity * sizeof(Sector));
+                sectorMap.windowStamp = (Uint32 *) realloc(sectorMap.windowStamp, sectorMap.sectorCapacity * sizeof(Uint32));
+                sectorMap.windowMin = (float *) realloc(sectorMap.windowMin, sectorMap.sectorCapacity * sizeof(float));
+                sectorMap.windowMax = (float *) realloc(sectorMap.windowMax, sectorMap.sectorCapacity * sizeof(float));
+            }
+
+            int sector = sectorMap.sectorCount++;
+            sectorMap.sectors[sector] = Sector { x, y, width, height };
+            sectorMap.windowStamp[sector] = 0;
+            for (int j = 0; j < height; ++j)
+            {
+                for (int i = 0; i < width; ++i)
+                {
+                    sectorMap.sectorOfTile[(x + i) + (y + j) * world.width] = sector + 1;
+                }
+            }
+        }
+    }
+    sectorMap.visibleStamp = 0;
+}
+
+void UpdateSectors()
+{
+    if (sectorMap.generation != worldGeneration)
+    {
+        BuildSectors();
+    }
+}
+
+// Sector index + 1 of a tile, 0 for walls and tiles outside the map.
+inline int SectorAt(int tileX, int tileY)
+{
+    if ((unsigned)tileX >= (unsigned)sectorMap.width || (unsigned)tileY >= (unsigned)sectorMap.height)
+    {
+        return 0;
+    }
+    return sectorMap.sectorOfTile[tileX + tileY * sectorMap.width];
+}
+
+inline float NormalizeDegrees(float angle)
+{
+    angle = fmodf(angle + 180.0f, 360.0f);
+    return (angle < 0 ? angle + 360.0f : angle) - 180.0f;
+}
+
+inline float DistanceToSegment(Vec2 point, Vec2 from, Vec2 to)
+{
+    Vec2 segment = to - from;
+    float lengthSquared = DotProduct(segment, segment);
+    float t = lengthSquared > 0 ? DotProduct(point - from, segment) / lengthSquared : 0;
+    t = SDL_max(0.0f, SDL_min(1.0f, t));
+    return Distance(point, from + segment * t);
+}
+
+void PushSectorWindow(int sector, float minAngle, float maxAngle)
+{
+    if (sectorMap.stackCount == sectorMap.stackCapacity)
+    {
+        sectorMap.stackCapacity = SDL_max(256, sectorMap.stackCapacity * 2);
+        sectorMap.stack = (SectorWindow *) realloc(sectorMap.stack, sectorMap.stackCapacity * sizeof(SectorWindow));
+    }
+    sectorMap.stack[sectorMap.stackCount++] = SectorWindow { sector, minAngle, maxAngle };
+}
+
+// Clips the window to the padded segment from..to and queues the neighbour.
+void ClipThroughPortal(int neighbour, Vec2 from, Vec2 to, float minAngle, float maxAngle)
+{
+    Vec2 eye = player.position.offset;
+    if (DistanceToSegment(eye, from, to) > viewDistance + PortalPadding)
+    {
+        return;
+    }
+
+    float fromDistance = Distance(eye, from);
+    float toDistance = Distance(eye, to);
+    if (fromDistance <= PortalPadding + 1 || toDistance <= PortalPadding + 1)
+    {
+        PushSectorWindow(neighbour, minAngle, maxAngle);
+        return;
+    }
+
+    float fromAngle = atan2f(from.y - eye.y, from.x - eye.x) * RadianToAngle - player.facingAngle;
+    float toAngle = atan2f(to.y - eye.y, to.x - eye.x) * RadianToAngle - player.facingAngle;
+    float span = NormalizeDegrees(toAngle - fromAngle);
+    if (fabsf(span) >= 179.0f)
+    {
+        // The eye is on the portal's line.
+        PushSectorWindow(neighbour, minAngle, maxAngle);
+        return;
+    }
+
+    // atan(x) <= x, so this pads at least as much as the exact angle.
+    float fromPadding = PortalPadding / fromDistance * RadianToAngle;
+    float toPadding = PortalPadding / toDistance * RadianToAngle;
+    float portalMin = span >= 0 ? fromAngle - fromPadding : fromAngle + span - toPadding;
+    float portalMax = span >= 0 ? fromAngle + span + toPadding : fromAngle + fromPadding;
+
+    float center = NormalizeDegrees(0.5f * (portalMin + portalMax));
+    float halfWidth = 0.5f * (portalMax - portalMin);
+    float clippedMin = SDL_max(minAngle, center - halfWidth);
+    float clippedMax = SDL_min(maxAngle, center + halfWidth);
+    if (clippedMin <= clippedMax)
+    {
+        PushSectorWindow(neighbour, clippedMin, clippedMax);
+    }
+}
+
+// Queues a portal for every run of border tiles owned by one neighbour along
+// the line of tiles starting at (tileX, tileY). Tiles outside the view
+// distance box are skipped, long sectors would otherwise cost their whole
+// perimeter.
+void ClipThroughEdge(int tileX, int tileY, int stepX, int stepY, int length, Vec2 lineStart, Vec2 lineStep,
+                     const SectorWindow &window, const Vec2 *windowDirections)
+{
+    int begin = 0;
+    int end = length;
+    if (stepX)
+    {
+        if (tileY < sectorMap.viewMinY || tileY > sectorMap.viewMaxY)
+        {
+            return;
+        }
+        begin = SDL_max(begin, sectorMap.viewMinX - tileX);
+        end = SDL_min(end, sectorMap.viewMaxX - tileX + 1);
+    }
+    else
+    {
+        if (tileX < sectorMap.viewMinX || tileX > sectorMap.viewMaxX)
+        {
+            return;
+        }
+        begin = SDL_max(begin, sectorMap.viewMinY - tileY);
+        end = SDL_min(end, sectorMap.viewMaxY - tileY + 1);
+    }
+
+    // When both sides of the window cross the edge's line ahead of the eye,
+    // only the tiles between the crossings can be seen.
+    float lineCoordinate = stepX ? lineStart.y : lineStart.x;
+    float eyeAlong = stepX ? player.position.offset.x : player.position.offset.y;
+    float eyeAcross = stepX ? player.position.offset.y : player.position.offset.x;
+    float tileSize = stepX ? TileDimsInPixels.x : TileDimsInPixels.y;
+    float crossings[2];
+    int crossingCount = 0;
+    for (int i = 0; i < 2 && length > 1; ++i)
+    {
+        float along = stepX ? windowDirections[i].x : windowDirections[i].y;
+        float across = stepX ? windowDirections[i].y : windowDirections[i].x;
+        float t = across != 0 ? (lineCoordinate - eyeAcross) / across : -1;
+        if (t > 0)
+        {
+            crossings[crossingCount++] = eyeAlong + along * t;
+        }
+    }
+    if (crossingCount == 2)
+    {
+        float lineOrigin = stepX ? lineStart.x : lineStart.y;
+        float low = SDL_min(crossings[0], crossings[1]) - PortalPadding - lineOrigin;
+        float high = SDL_max(crossings[0], crossings[1]) + PortalPadding - lineOrigin;
+        begin = SDL_max(begin, (int)floorf(low / tileSize));
+        end = SDL_min(end, (int)floorf(high / tileSize) + 1);
+    }
+
+    if (begin >= end)
+    {
+        return;
+    }
+
+    int runStart = begin;
+    int runSector = SectorAt(tileX + begin * stepX, tileY + begin * stepY);
+    for (int i = begin + 1; i <= end; ++i)
+    {
+        int sector = i < end ? SectorAt(tileX + i * stepX, tileY + i * stepY) : -1;
+        if (sector != runSector)
+        {
+            if (runSector > 0)
+            {
+                ClipThroughPortal(runSector - 1, lineStart + lineStep * runStart, lineStart + lineStep * i, window.minAngle, window.maxAngle);
+            }
+            runStart = i;
+            runSector = sector;
+        }
+    }
+}
+
+// Marks every sector a ray of the current view can sample. Returns false
+// when the player is not in an open tile. Portals are clipped in pixels from
+// the origin of the player's tile, like the rays.
+bool FindVisibleSectors()
+{
+    const int tileWidth = TileDimsInPixels.x;
+    const int tileHeight = TileDimsInPixels.y;
+
+    int playerTileX = player.position.tileX;
+    int playerTileY = player.position.tileY;
+    Vec2 eye = player.position.offset;
+    int playerSector = SectorAt(playerTileX, playerTileY);
+    if (playerSector == 0)
+    {
+        return false;
+    }
+
+    // Stamps only need to be unique, start over when they wrap.
+    if (++sectorMap.visibleStamp == 0)
+    {
+        for (int i = 0; i < sectorMap.sectorCount; ++i)
+        {
+            sectorMap.windowStamp[i] = 0;
+        }
+        sectorMap.visibleStamp = 1;
+    }
+
+    float reach = viewDistance + PortalPadding;
+    sectorMap.viewMinX = playerTileX + FloorDiv(floorf(eye.x - reach), tileWidth);
+    sectorMap.viewMinY = playerTileY + FloorDiv(floorf(eye.y - reach), tileHeight);
+    sectorMap.viewMaxX = playerTileX + FloorDiv(floorf(eye.x + reach), tileWidth);
+    sectorMap.viewMaxY = playerTileY + FloorDiv(floorf(eye.y + reach), tileHeight);
+
+    float halfFov = 0.5f * player.fov + 1.0f;
+    sectorMap.stackCount = 0;
+    PushSectorWindow(playerSector - 1, -halfFov, halfFov);
+
+    while (sectorMap.stackCount > 0)
+    {
+        SectorWindow window = sectorMap.stack[--sectorMap.stackCount];
+        int sector = window.sector;
+
+        // A sector reached again through a window it has not seen is reopened
+        // with the whole frustum. That is conservative, and expands every
+        // sector at most twice however many paths lead to it.
+        if (sectorMap.windowStamp[sector] == sectorMap.visibleStamp)
+        {
+            if (window.minAngle >= sectorMap.windowMin[sector] && window.maxAngle <= sectorMap.windowMax[sector])
+            {
+                continue;
+            }
+            window.minAngle = -halfFov;
+            window.maxAngle = halfFov;
+        }
+        sectorMap.windowStamp[sector] = sectorMap.visibleStamp;
+        sectorMap.windowMin[sector] = window.minAngle;
+        sectorMap.windowMax[sector] = window.maxAngle;
+
+        Sector rect = sectorMap.sectors[sector];
+        float left = (rect.x - playerTileX) * tileWidth;
+        float top = (rect.y - playerTileY) * tileHeight;
+        float right = (rect.x + rect.width - playerTileX) * tileWidth;
+        float bottom = (rect.y + rect.height - playerTileY) * tileHeight;
+        Vec2 alongX(tileWidth, 0);
+        Vec2 alongY(0, tileHeight);
+        Vec2 none(0, 0);
+        const Vec2 windowDirections[2] =
+        {
+            Vec2(cosf((player.facingAngle + window.minAngle) * AngleToRadian), sinf((player.facingAngle + window.minAngle) * AngleToRadian)),
+            Vec2(cosf((player.facingAngle + window.maxAngle) * AngleToRadian), sinf((player.facingAngle + window.maxAngle) * AngleToRadian)),
+        };
+
+        ClipThroughEdge(rect.x, rect.y - 1, 1, 0, rect.width, Vec2(left, top), alongX, window, windowDirections);
+        ClipThroughEdge(rect.x, rect.y + rect.height, 1, 0, rect.width, Vec2(left, bottom), alongX, window, windowDirections);
+        ClipThroughEdge(rect.x - 1, rect.y, 0, 1, rect.height, Vec2(left, top), alongY, window, windowDirections);
+        ClipThroughEdge(rect.x + rect.width, rect.y, 0, 1, rect.height, Vec2(right, top), alongY, window, windowDirections);
+
+        ClipThroughEdge(rect.x - 1, rect.y - 1, 1, 0, 1, Vec2(left, top), none, window, windowDirections);
+        ClipThroughEdge(rect.x + rect.width, rect.y - 1, 1, 0, 1, Vec2(right, top), none, window, windowDirections);
+        ClipThroughEdge(rect.x - 1, rect.y + rect.height, 1, 0, 1, Vec2(left, bottom), none, window, windowDirections);
+        ClipThroughEdge(rect.x + rect.width, rect.y + rect.height, 1, 0, 1, Vec2(right, bottom), none, window, windowDirections);
+    }
+    return true;
+}
+
+inline bool IsSectorVisible(int sector)
+{
+    return sectorMap.windowStamp[sector] == sectorMap.visibleStamp;
+}
+
+template<typename Geometry>
+void DrawRaysPortalKernel(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    const int tileWidth = Geometry::TileWidthInPixels;
+    const int tileHeight = Geometry::TileHeightInPixels;
+    const int sampleEnd = ceilf(viewDistance);
+    int rayCount = Geometry::ColumnCount(hits);
+
+    int playerTileX = player.position.tileX;
+    int playerTileY = player.position.tileY;
+    MinimapTrail trail = GetMinimapTrail(buffer);
+
+    for (int rayIndex = 0; rayIndex < rayCount; ++rayIndex)
+    {
+        float angle, cos, sin;
+        GetColumnRay(rayIndex, rayCount, &angle, &cos, &sin);
+
+        int i = 0;
+        for (; i < sampleEnd; i += 2)
+        {
+            Vec2 rayPixelPosition = GetRaySample(&trail, cos, sin, i);
+            int tileX = playerTileX + Geometry::FloorPixelToTileX(FloorToInt(rayPixelPosition.x));
+            int tileY = playerTileY + Geometry::FloorPixelToTileY(FloorToInt(rayPixelPosition.y));
+            int sector = SectorAt(tileX, tileY) - 1;
+
+            if (sector < 0)
+            {
+                SetRayHit(hits, rayIndex, angle, Distance(Vec2(trail.eyeX, trail.eyeY), rayPixelPosition),
+                          Geometry::GetTile(tileX, tileY), texture);
+                break;
+            }
+            if (!IsSectorVisible(sector))
+            {
+                // Only sectors past the view distance are left out.
+                break;
+            }
+
+            Sector rect = sectorMap.sectors[sector];
+            float exitX = cos > 0 ? ((rect.x + rect.width - playerTileX) * tileWidth - rayPixelPosition.x) / cos :
+                          cos < 0 ? ((rect.x - playerTileX) * tileWidth - rayPixelPosition.x) / cos : viewDistance;
+            float exitY = sin > 0 ? ((rect.y + rect.height - playerTileY) * tileHeight - rayPixelPosition.y) / sin :
+                          sin < 0 ? ((rect.y - playerTileY) * tileHeight - rayPixelPosition.y) / sin : viewDistance;
+
+            // Landing a pixel before the exact exit keeps the next sample in
+            // the sector even when its position rounds the other way.
+            int skip = (int)(SDL_min(SDL_min(exitX, exitY), viewDistance) - 1.0f) & ~1;
+            if (skip > 2)
+            {
+                i += skip - 2;
+            }
+        }
+        DrawRayTrail(buffer, &trail, cos, sin, SDL_min(i, sampleEnd));
+    }
+}
+
+void DrawRaysPortal(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    UpdateSectors();
+    if (!FindVisibleSectors())
+    {
+        DrawRays(buffer, texture, hits);
+        return;
+    }
+
+    switch (SelectGeometry(hits))
+    {
+    case Geometry_BuiltIn:
+        DrawRaysPortalKernel<BuiltInGeometry>(buffer, texture, hits);
+        break;
+    case Geometry_Bricked:
+        DrawRaysPortalKernel<BrickedGeometry>(buffer, texture, hits);
+        break;
+    default:
+        DrawRaysPortalKernel<DynamicGeometry>(buffer, texture, hits);
+        break;
+    }
+}
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+// Wall segment renderer.
+//
+// Walls are axis aligned tile faces, so instead of marching a ray per column
+// this walks the open tiles in view breadth first from the player's tile,
+// nearest first, and projects every wall face next to one of them onto the
+// columns between its two end points. Each of those columns intersects its
+// ray with the face once and keeps the nearest face. A tile is only entered
+// when some column it covers is still open beyond the tile's nearest point,
+// so walls cull what is behind them and the walk stays in the visible area.
+// The cost grows with the visible faces and the columns they cover instead
+// of with view distance times columns.
+//
+// Distances are exact intersections rather than the float caster's samples
+// every two pixels, so walls can sit up to two pixels closer. The minimap
+// shows the trails of at most one ray per native view column.
+
+// Hit positions on a face are allowed this far past its ends, so rays
+// through the seam between two faces hit one of them.
+const float SegmentSeamPixels = 0.01f;
+
+struct SegmentFrame
+{
+    MinimapTrail trail;
+    int rayCount;
+    float angle[MaxRayCount];
+    float cos[MaxRayCount];
+    float sin[MaxRayCount];
+    // Distance along the ray to the nearest face so far, and its tile.
+    float depth[MaxRayCount];
+    TileType tile[MaxRayCount];
+
+    // Tiles within view distance of the player, marked with the frame's
+    // stamp once queued.
+    Uint32 *visited;
+    int radius;
+    Uint32 stamp;
+    // Queued tiles as x, y pairs relative to the player's tile.
+    int *queue;
+};
+
+SegmentFrame segmentFrame;
+
+// Columns whose rays pass between the given points, widened by one column on
+// each side. False when none do.
+bool ProjectToColumns(const SegmentFrame *frame, const float *pointsX, const float *pointsY, int count, int *first, int *last)
+{
+    float minAngle = 180.0f;
+    float maxAngle = -180.0f;
+    for (int i = 0; i < count; ++i)
+    {
+        float angle = atan2f(pointsY[i] - frame->trail.eyeY, pointsX[i] - frame->trail.eyeX) / AngleToRadian - player.facingAngle;
+        angle -= 360.0f * floorf((angle + 180.0f) / 360.0f);
+        minAngle = SDL_min(minAngle, angle);
+        maxAngle = SDL_max(maxAngle, angle);
+    }
+
+    // Spanning more than half a turn means passing behind the player, so
+    // only happens right next to it. Every column is a safe answer.
+    if (maxAngle - minAngle > 180.0f)
+    {
+        *first = 0;
+        *last = frame->rayCount - 1;
+        return true;
+    }
+
+    float columnsPerDegree = frame->rayCount / player.fov;
+    *first = SDL_max(0, (int)floorf((minAngle + player.fov * 0.5f) * columnsPerDegree) - 1);
+    *last = SDL_min(frame->rayCount - 1, (int)ceilf((maxAngle + player.fov * 0.5f) * columnsPerDegree) + 1);
+    return *first <= *last;
+}
+
+// Whether anything in the tile could still be nearer than what some of its
+// columns hit.
+bool IsTileInView(const SegmentFrame *frame, float minX, float minY, float maxX, float maxY)
+{
+    float eyeX = frame->trail.eyeX;
+    float eyeY = frame->trail.eyeY;
+    float dx = SDL_max(0.0f, SDL_max(minX - eyeX, eyeX - maxX));
+    float dy = SDL_max(0.0f, SDL_max(minY - eyeY, eyeY - maxY));
+    float nearest = sqrtf(dx * dx + dy * dy);
+    if (!(nearest < viewDistance))
+    {
+        return false;
+    }
+
+    float cornersX[4] = { minX, maxX, minX, maxX };
+    float cornersY[4] = { minY, minY, maxY, maxY };
+    int first, last;
+    if (!ProjectToColumns(frame, cornersX, cornersY, 4, &first, &last))
+    {
+        return false;
+    }
+    for (int column = first; column <= last; ++column)
+    {
+        if (frame->depth[column] > nearest)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The face on the plane at the given pixel across one axis, between from and
+// to along the other, seen from the eye's side.
+void RasterizeFace(SegmentFrame *frame, bool acrossX, float plane, float from, float to, TileType tile)
+{
+    float eye = acrossX ? frame->trail.eyeX : frame->trail.eyeY;
+    float eyeAlong = acrossX ? frame->trail.eyeY : frame->trail.eyeX;
+    float pointsX[2] = { acrossX ? plane : from, acrossX ? plane : to };
+    float pointsY[2] = { acrossX ? from : plane, acrossX ? to : plane };
+    int first, last;
+    if (!ProjectToColumns(frame, pointsX, pointsY, 2, &first, &last))
+    {
+        return;
+    }
+
+    const float *across = acrossX ? frame->cos : frame->sin;
+    const float *along = acrossX ? frame->sin : frame->cos;
+    for (int column = first; column <= last; ++column)
+    {
+        float distance = (plane - eye) / across[column];
+        if (distance > 0 && distance < frame->depth[column])
+        {
+            float hit = eyeAlong + along[column] * distance;
+            if (hit >= from - SegmentSeamPixels && hit <= to + SegmentSeamPixels)
+            {
+                frame->depth[column] = distance;
+                frame->tile[column] = tile;
+            }
+        }
+    }
+}
+
+template<typename Geometry>
+void DrawRaysSegmentsKernel(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    SegmentFrame *frame = &segmentFrame;
+    frame->rayCount = Geometry::ColumnCount(hits);
+    if (frame->rayCount <= 0)
+    {
+        return;
+    }
+    frame->trail = GetMinimapTrail(buffer);
+
+    const int tileWidth = Geometry::TileWidthInPixels;
+    const int tileHeight = Geometry::TileHeightInPixels;
+    int playerTileX = player.position.tileX;
+    int playerTileY = player.position.tileY;
+
+    // A player inside a wall sees it in every column, like the march.
+    TileType inside = Geometry::GetTile(playerTileX, playerTileY);
+    if (inside != _)
+    {
+        for (int column = 0; column < frame->rayCount; ++column)
+        {
+            float angle, cos, sin;
+            GetColumnRay(column, frame->rayCount, &angle, &cos, &sin);
+            SetRayHit(hits, column, angle, 0.0f, inside, texture);
+        }
+        return;
+    }
+
+    for (int column = 0; column < frame->rayCount; ++column)
+    {
+        GetColumnRay(column, frame->rayCount, &frame->angle[column], &frame->cos[column], &frame->sin[column]);
+        frame->depth[column] = viewDistance;
+    }
+
+    // Every tile within view distance fits the visited window.
+    int radius = (int)ceilf(viewDistance / SDL_min(tileWidth, tileHeight)) + 2;
+    int side = 2 * radius + 1;
+    if (radius > frame->radius)
+    {
+        free(frame->visited);
+        free(frame->queue);
+        frame->visited = (Uint32 *) calloc((size_t)side * side, sizeof(Uint32));
+        frame->queue = (int *) malloc((size_t)side * side * 2 * sizeof(int));
+        frame->radius = radius;
+        frame->stamp = 0;
+    }
+    int stride = 2 * frame->radius + 1;
+    Uint32 stamp = ++frame->stamp;
+    Uint32 *visited = frame->visited + frame->radius + frame->radius * stride;
+
+    int head = 0;
+    int tail = 0;
+    frame->queue[tail++] = 0;
+    frame->queue[tail++] = 0;
+    visited[0] = stamp;
+
+    const int neighbourX[4] = { 1, -1, 0, 0 };
+    const int neighbourY[4] = { 0, 0, 1, -1 };
+    while (head < tail)
+    {
+        int x = frame->queue[head++];
+        int y = frame->queue[head++];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            int nextX = x + neighbourX[i];
+            int nextY = y + neighbourY[i];
+            float minX = (float)(nextX * tileWidth);
+            float minY = (float)(nextY * tileHeight);
+            TileType tile = Geometry::GetTile(playerTileX + nextX, playerTileY + nextY);
+
+            if (tile != _)
+            {
+                // The face between this tile and the wall, when the eye is
+                // on this side of it.
+                bool acrossX = neighbourX[i] != 0;
+                float plane = acrossX ? (neighbourX[i] > 0 ? minX : minX + tileWidth) :
+                                        (neighbourY[i] > 0 ? minY : minY + tileHeight);
+                float eye = acrossX ? frame->trail.eyeX : frame->trail.eyeY;
+                int step = acrossX ? neighbourX[i] : neighbourY[i];
+                if ((plane - eye) * step > 0)
+                {
+                    float from = acrossX ? minY : minX;
+                    RasterizeFace(frame, acrossX, plane, from, from + (acrossX ? tileHeight : tileWidth), tile);
+                }
+                continue;
+            }
+
+            if (abs(nextX) > frame->radius || abs(nextY) > frame->radius || visited[nextX + nextY * stride] == stamp)
+            {
+                continue;
+            }
+            visited[nextX + nextY * stride] = stamp;
+            if (IsTileInView(frame, minX, minY, minX + tileWidth, minY + tileHeight))
+            {
+                frame->queue[tail++] = nextX;
+                frame->queue[tail++] = nextY;
+            }
+        }
+    }
+
+    int trailStride = SDL_max(1, frame->rayCount / (int)FpsViewDimsInPixels.x);
+    for (int column = 0; column < frame->rayCount; ++column)
+    {
+        float depth = frame->depth[column];
+        if (depth < viewDistance)
+        {
+            SetRayHit(hits, column, frame->angle[column], depth, frame->tile[column], texture);
+        }
+        if (column % trailStride == 0)
+        {
+            DrawRayTrail(buffer, &frame->trail, frame->cos[column], frame->sin[column], (int)ceilf(depth));
+        }
+    }
+}
+
+void DrawRaysSegments(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    switch (SelectGeometry(hits))
+    {
+    case Geometry_BuiltIn:
+        DrawRaysSegmentsKernel<BuiltInGeometry>(buffer, texture, hits);
+        break;
+    case Geometry_Bricked:
+        DrawRaysSegmentsKernel<BrickedGeometry>(buffer, texture, hits);
+        break;
+    default:
+        DrawRaysSegmentsKernel<DynamicGeometry>(buffer, texture, hits);
+        break;
+    }
+}
+
+#endif
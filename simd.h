@@ -0,0 +1,323 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Runtime CPU feature dispatch for the hot render kernels.
+//
+// InitRenderKernels detects the widest instruction set once at startup and
+// binds every entry of the kernels table to the matching implementation.
+// All implementations produce the same pixels as the scalar ones; the
+// "--simd" option forces a lower level for testing. Non x86 builds only get
+// the scalar kernels.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAYCASTER_X86 1
+#include <immintrin.h>
+#endif
+
+enum SimdLevel
+{
+    Simd_Scalar,
+    Simd_SSE2,
+    Simd_AVX2,
+    Simd_AVX512,
+    Simd_Count
+};
+
+const char *SimdLevelNames[Simd_Count] = { "scalar", "sse2", "avx2", "avx512" };
+
+// Per column wall spans for the FPS view, rows [top, bottom).
+struct ColumnSpans
+{
+    int count;
+    int top[MaxRayCount];
+    int bottom[MaxRayCount];
+    Uint32 color[MaxRayCount];
+};
+
+typedef void FillSpanKernel(Uint32 *pixels, int count, Uint32 color);
+typedef void CopySpanKernel(Uint32 *dest, const Uint32 *source, int count);
+typedef void FillColumnsKernel(Uint32 *origin, int pitchInPixels, int height, const ColumnSpans *spans, Uint32 background);
+typedef void TraceRaysKernel(ScreenBuffer buffer, Texture texture, RayHits *hits);
+
+// Segment packet tests, defined in walls.h.
+struct WallPacket;
+typedef int IntersectWallsKernel(const WallPacket *packet, float eyeX, float eyeY, float dirX, float dirY, float *nearest);
+int IntersectWallsScalar(const WallPacket *packet, float eyeX, float eyeY, float dirX, float dirY, float *nearest);
+
+struct RenderKernels
+{
+    SimdLevel level;
+    FillSpanKernel *fillSpan;
+    CopySpanKernel *copySpan;
+    FillColumnsKernel *fillColumns;
+    // NULL selects the geometry specialized scalar traversal.
+    TraceRaysKernel *traceRays;
+    IntersectWallsKernel *intersectWalls;
+};
+
+void FillSpanScalar(Uint32 *pixels, int count, Uint32 color)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        pixels[i] = color;
+    }
+}
+
+void CopySpanScalar(Uint32 *dest, const Uint32 *source, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        dest[i] = source[i];
+    }
+}
+
+inline Uint32 ColumnPixel(const ColumnSpans *spans, int x, int y, Uint32 background)
+{
+    return (spans->top[x] <= y && y < spans->bottom[x]) ? spans->color[x] : background;
+}
+
+void FillColumnsScalar(Uint32 *origin, int pitchInPixels, int height, const ColumnSpans *spans, Uint32 background)
+{
+    for (int y = 0; y < height; ++y)
+    {
+        Uint32 *row = origin + y * pitchInPixels;
+        for (int x = 0; x < spans->count; ++x)
+        {
+            row[x] = ColumnPixel(spans, x, y, background);
+        }
+    }
+}
+
+RenderKernels kernels = { Simd_Scalar, FillSpanScalar, CopySpanScalar, FillColumnsScalar, NULL, IntersectWallsScalar };
+
+#ifdef RAYCASTER_X86
+// Vectorized ray traversals, defined in simd_rays.h.
+void TraceRaysSSE2(ScreenBuffer buffer, Texture texture, RayHits *hits);
+void TraceRaysAVX2(ScreenBuffer buffer, Texture texture, RayHits *hits);
+void TraceRaysAVX512(ScreenBuffer buffer, Texture texture, RayHits *hits);
+int IntersectWallsSSE2(const WallPacket *packet, float eyeX, float eyeY, float dirX, float dirY, float *nearest);
+int IntersectWallsAVX2(const WallPacket *packet, float eyeX, float eyeY, float dirX, float dirY, float *nearest);
+
+__attribute__((target("sse2")))
+void FillSpanSSE2(Uint32 *pixels, int count, Uint32 color)
+{
+    __m128i value = _mm_set1_epi32(color);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(pixels + i), value);
+    }
+    for (; i < count; ++i)
+    {
+        pixels[i] = color;
+    }
+}
+
+__attribute__((target("sse2")))
+void CopySpanSSE2(Uint32 *dest, const Uint32 *source, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_loadu_si128((const __m128i *)(source + i)));
+    }
+    for (; i < count; ++i)
+    {
+        dest[i] = source[i];
+    }
+}
+
+__attribute__((target("sse2")))
+void FillColumnsSSE2(Uint32 *origin, int pitchInPixels, int height, const ColumnSpans *spans, Uint32 background)
+{
+    __m128i backgroundValue = _mm_set1_epi32(background);
+    for (int y = 0; y < height; ++y)
+    {
+        Uint32 *row = origin + y * pitchInPixels;
+        __m128i rowValue = _mm_set1_epi32(y);
+        int x = 0;
+        for (; x + 4 <= spans->count; x += 4)
+        {
+            __m128i top = _mm_loadu_si128((const __m128i *)(spans->top + x));
+            __m128i bottom = _mm_loadu_si128((const __m128i *)(spans->bottom + x));
+            __m128i color = _mm_loadu_si128((const __m128i *)(spans->color + x));
+            __m128i inside = _mm_andnot_si128(_mm_cmpgt_epi32(top, rowValue), _mm_cmpgt_epi32(bottom, rowValue));
+            __m128i pixel = _mm_or_si128(_mm_and_si128(inside, color), _mm_andnot_si128(inside, backgroundValue));
+            _mm_storeu_si128((__m128i *)(row + x), pixel);
+        }
+        for (; x < spans->count; ++x)
+        {
+            row[x] = ColumnPixel(spans, x, y, background);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void FillSpanAVX2(Uint32 *pixels, int count, Uint32 color)
+{
+    __m256i value = _mm256_set1_epi32(color);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_si256((__m256i *)(pixels + i), value);
+    }
+    for (; i < count; ++i)
+    {
+        pixels[i] = color;
+    }
+}
+
+__attribute__((target("avx2")))
+void CopySpanAVX2(Uint32 *dest, const Uint32 *source, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_si256((__m256i *)(dest + i), _mm256_loadu_si256((const __m256i *)(source + i)));
+    }
+    for (; i < count; ++i)
+    {
+        dest[i] = source[i];
+    }
+}
+
+__attribute__((target("avx2")))
+void FillColumnsAVX2(Uint32 *origin, int pitchInPixels, int height, const ColumnSpans *spans, Uint32 background)
+{
+    __m256i backgroundValue = _mm256_set1_epi32(background);
+    for (int y = 0; y < height; ++y)
+    {
+        Uint32 *row = origin + y * pitchInPixels;
+        __m256i rowValue = _mm256_set1_epi32(y);
+        int x = 0;
+        for (; x + 8 <= spans->count; x += 8)
+        {
+            __m256i top = _mm256_loadu_si256((const __m256i *)(spans->top + x));
+            __m256i bottom = _mm256_loadu_si256((const __m256i *)(spans->bottom + x));
+            __m256i color = _mm256_loadu_si256((const __m256i *)(spans->color + x));
+            __m256i inside = _mm256_andnot_si256(_mm256_cmpgt_epi32(top, rowValue), _mm256_cmpgt_epi32(bottom, rowValue));
+            _mm256_storeu_si256((__m256i *)(row + x), _mm256_blendv_epi8(backgroundValue, color, inside));
+        }
+        for (; x < spans->count; ++x)
+        {
+            row[x] = ColumnPixel(spans, x, y, background);
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+void FillSpanAVX512(Uint32 *pixels, int count, Uint32 color)
+{
+    __m512i value = _mm512_set1_epi32(color);
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm512_storeu_si512(pixels + i, value);
+    }
+    if (i < count)
+    {
+        _mm512_mask_storeu_epi32(pixels + i, (__mmask16)((1 << (count - i)) - 1), value);
+    }
+}
+
+__attribute__((target("avx512f")))
+void CopySpanAVX512(Uint32 *dest, const Uint32 *source, int count)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm512_storeu_si512(dest + i, _mm512_loadu_si512(source + i));
+    }
+    if (i < count)
+    {
+        __mmask16 tail = (__mmask16)((1 << (count - i)) - 1);
+        _mm512_mask_storeu_epi32(dest + i, tail, _mm512_maskz_loadu_epi32(tail, source + i));
+    }
+}
+
+__attribute__((target("avx512f")))
+void FillColumnsAVX512(Uint32 *origin, int pitchInPixels, int height, const ColumnSpans *spans, Uint32 background)
+{
+    __m512i backgroundValue = _mm512_set1_epi32(background);
+    for (int y = 0; y < height; ++y)
+    {
+        Uint32 *row = origin + y * pitchInPixels;
+        __m512i rowValue = _mm512_set1_epi32(y);
+        for (int x = 0; x < spans->count; x += 16)
+        {
+            __mmask16 lanes = (__mmask16)(spans->count - x >= 16 ? 0xFFFF : (1 << (spans->count - x)) - 1);
+            __m512i top = _mm512_maskz_loadu_epi32(lanes, spans->top + x);
+            __m512i bottom = _mm512_maskz_loadu_epi32(lanes, spans->bottom + x);
+            __m512i color = _mm512_maskz_loadu_epi32(lanes, spans->color + x);
+            __mmask16 inside = _mm512_cmple_epi32_mask(top, rowValue) & _mm512_cmpgt_epi32_mask(bottom, rowValue);
+            _mm512_mask_storeu_epi32(row + x, lanes, _mm512_mask_blend_epi32(inside, backgroundValue, color));
+        }
+    }
+}
+
+#endif
+
+SimdLevel DetectSimdLevel()
+{
+#ifdef RAYCASTER_X86
+    if (SDL_HasAVX512F())
+    {
+        return Simd_AVX512;
+    }
+    if (SDL_HasAVX2())
+    {
+        return Simd_AVX2;
+    }
+    if (SDL_HasSSE2())
+    {
+        return Simd_SSE2;
+    }
+#endif
+    return Simd_Scalar;
+}
+
+bool ParseSimdLevel(const char *name, SimdLevel *result)
+{
+    for (int i = 0; i < Simd_Count; ++i)
+    {
+        if (strcmp(name, SimdLevelNames[i]) == 0)
+        {
+            *result = (SimdLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Binds the kernels for the requested level, clamped to what the CPU
+// supports. Pass Simd_Count to use the widest available level.
+void InitRenderKernels(SimdLevel requested)
+{
+    SimdLevel supported = DetectSimdLevel();
+    if (requested != Simd_Count && requested > supported)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s not supported, using %s\n", SimdLevelNames[requested], SimdLevelNames[supported]);
+    }
+    SimdLevel level = SDL_min(requested, supported);
+
+    RenderKernels result = { Simd_Scalar, FillSpanScalar, CopySpanScalar, FillColumnsScalar, NULL, IntersectWallsScalar };
+#ifdef RAYCASTER_X86
+    switch (level)
+    {
+    case Simd_AVX512:
+        result = { level, FillSpanAVX512, CopySpanAVX512, FillColumnsAVX512, TraceRaysAVX512, IntersectWallsAVX2 };
+        break;
+    case Simd_AVX2:
+        result = { level, FillSpanAVX2, CopySpanAVX2, FillColumnsAVX2, TraceRaysAVX2, IntersectWallsAVX2 };
+        break;
+    case Simd_SSE2:
+        result = { level, FillSpanSSE2, CopySpanSSE2, FillColumnsSSE2, TraceRaysSSE2, IntersectWallsSSE2 };
+        break;
+    default:
+        break;
+    }
+#endif
+    kernels = result;
+}
+
+#endif
@@ -0,0 +1,321 @@
+#ifndef SIMD_RAYS_H
+#define SIMD_RAYS_H
+
+// Vectorized versions of the DrawRays traversal, one ray per lane. Like
+// DrawRays, rays are traced in pixels from the origin of the player's tile.
+//
+// SSE2 steps 4 rays at a time and vectorizes the sample positions and their
+// tiles, then looks each tile up with GetTile. AVX2 and AVX-512 step 8 and
+// 16 rays and also gather the tiles and test for walls in the vector
+// registers. Ray setup, hit recording and the minimap trail stay scalar,
+// through GetColumnRay, SetRayHit and the same float math as DrawRays, so
+// every level gives the scalar traversal's output.
+
+struct RayLanes
+{
+    ScreenBuffer buffer;
+    int minimapOriginX;
+    int minimapOriginY;
+    int minimapWidth;
+    int minimapHeight;
+};
+
+RayLanes BeginRayLanes(ScreenBuffer buffer)
+{
+    RayLanes lanes;
+    lanes.buffer = buffer;
+
+    Vec2 origin = TileToPixelPosition(GetMinimapOriginTile(buffer), TileDimsInPixels);
+    Vec2 dims = TileToPixelPosition(GetMinimapDimsInTiles(buffer), TileDimsInPixels);
+    // Relative to the player's tile, like the ray positions.
+    lanes.minimapOriginX = (int)origin.x - TileOriginPixelX(player.position);
+    lanes.minimapOriginY = (int)origin.y - TileOriginPixelY(player.position);
+    lanes.minimapWidth = dims.x;
+    lanes.minimapHeight = dims.y;
+    return lanes;
+}
+
+inline void MarkRayStep(RayLanes *lanes, int pixelX, int pixelY)
+{
+    int minimapX = pixelX - lanes->minimapOriginX;
+    int minimapY = pixelY - lanes->minimapOriginY;
+    if (minimapX >= 0 && minimapY >= 0 && minimapX < lanes->minimapWidth && minimapY < lanes->minimapHeight)
+    {
+        SetPixelColor(lanes->buffer, minimapX, minimapY, White);
+    }
+}
+
+#ifdef RAYCASTER_X86
+
+// Pixel to tile conversion divides in float: for |pixel| < 2^24 the rounding
+// error stays below 1/tileSize, so flooring the quotient matches integer
+// floor division exactly, negative pixels included.
+
+// SSE2 has no floor: truncate, then step down the lanes that rounded up.
+__attribute__((target("sse2")))
+inline __m128i FloorToIntSSE2(__m128 value)
+{
+    __m128i truncated = _mm_cvttps_epi32(value);
+    __m128 roundedUp = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), value);
+    return _mm_add_epi32(truncated, _mm_castps_si128(roundedUp));
+}
+
+__attribute__((target("sse2")))
+void TraceRaysSSE2(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    RayLanes lanes = BeginRayLanes(buffer);
+    int rayCount = hits->count;
+    __m128 playerX = _mm_set1_ps(player.position.offset.x);
+    __m128 playerY = _mm_set1_ps(player.position.offset.y);
+    __m128 tileWidth = _mm_set1_ps(TileDimsInPixels.x);
+    __m128 tileHeight = _mm_set1_ps(TileDimsInPixels.y);
+    __m128i playerTileX = _mm_set1_epi32(player.position.tileX);
+    __m128i playerTileY = _mm_set1_epi32(player.position.tileY);
+
+    for (int base = 0; base < rayCount; base += 4)
+    {
+        int laneCount = SDL_min(4, rayCount - base);
+        alignas(16) float angle[4] = {0}, cos[4] = {0}, sin[4] = {0};
+        for (int lane = 0; lane < laneCount; ++lane)
+        {
+            GetColumnRay(base + lane, rayCount, &angle[lane], &cos[lane], &sin[lane]);
+        }
+        __m128 rayCos = _mm_load_ps(cos);
+        __m128 raySin = _mm_load_ps(sin);
+        int active = (1 << laneCount) - 1;
+
+        for (int i = 0; i < viewDistance && active; i += 2)
+        {
+            __m128 step = _mm_set1_ps((float)i);
+            __m128 rayX = _mm_add_ps(playerX, _mm_mul_ps(rayCos, step));
+            __m128 rayY = _mm_add_ps(playerY, _mm_mul_ps(raySin, step));
+            __m128i pixelX = FloorToIntSSE2(rayX);
+            __m128i pixelY = FloorToIntSSE2(rayY);
+            __m128i tileX = _mm_add_epi32(playerTileX, FloorToIntSSE2(_mm_div_ps(_mm_cvtepi32_ps(pixelX), tileWidth)));
+            __m128i tileY = _mm_add_epi32(playerTileY, FloorToIntSSE2(_mm_div_ps(_mm_cvtepi32_ps(pixelY), tileHeight)));
+
+            alignas(16) float rx[4], ry[4];
+            alignas(16) int px[4], py[4], tx[4], ty[4];
+            _mm_store_ps(rx, rayX);
+            _mm_store_ps(ry, rayY);
+            _mm_store_si128((__m128i *)px, pixelX);
+            _mm_store_si128((__m128i *)py, pixelY);
+            _mm_store_si128((__m128i *)tx, tileX);
+            _mm_store_si128((__m128i *)ty, tileY);
+
+            for (int lane = 0; lane < laneCount; ++lane)
+            {
+                if (!(active & (1 << lane)))
+                {
+                    continue;
+                }
+                TileType tile = GetTile(tx[lane], ty[lane]);
+                if (tile == _)
+                {
+                    MarkRayStep(&lanes, px[lane], py[lane]);
+                }
+                else
+                {
+                    SetRayHit(hits, base + lane, angle[lane], Distance(player.position.offset, Vec2(rx[lane], ry[lane])), tile, texture);
+                    active &= ~(1 << lane);
+                }
+            }
+        }
+    }
+}
+
+// Tiles are bytes, so the gathers fetch the aligned 32 bit word holding each
+// tile and shift it out. Aligned reads never cross into another page. Tile
+// indices go through TileIndexing, so either layout works.
+__attribute__((target("avx2")))
+void TraceRaysAVX2(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    RayLanes lanes = BeginRayLanes(buffer);
+    int rayCount = hits->count;
+    __m256 playerX = _mm256_set1_ps(player.position.offset.x);
+    __m256 playerY = _mm256_set1_ps(player.position.offset.y);
+    __m256i playerTileX = _mm256_set1_epi32(player.position.tileX);
+    __m256i playerTileY = _mm256_set1_epi32(player.position.tileY);
+    __m256 tileWidth = _mm256_set1_ps(TileDimsInPixels.x);
+    __m256 tileHeight = _mm256_set1_ps(TileDimsInPixels.y);
+    __m256i mapWidth = _mm256_set1_epi32(world.width);
+    __m256i mapHeight = _mm256_set1_epi32(world.height);
+    __m256i minusOne = _mm256_set1_epi32(-1);
+    __m256i byteMask = _mm256_set1_epi32(0xFF);
+    __m256i wall = _mm256_set1_epi32(A);
+
+    int misalignment = (int)((uintptr_t)world.tiles & 3);
+    const int *tileWords = (const int *)(world.tiles - misalignment);
+    __m256i misalignmentValue = _mm256_set1_epi32(misalignment);
+    TileIndexing indexing = GetTileIndexing(world);
+    __m128i brickShift = _mm_cvtsi32_si128(indexing.brickShift);
+    __m128i brickAreaShift = _mm_cvtsi32_si128(2 * indexing.brickShift);
+    __m256i brickMask = _mm256_set1_epi32(indexing.brickMask);
+    __m256i brickStride = _mm256_set1_epi32(indexing.brickStride);
+
+    for (int base = 0; base < rayCount; base += 8)
+    {
+        int laneCount = SDL_min(8, rayCount - base);
+        alignas(32) float angle[8] = {0}, cos[8] = {0}, sin[8] = {0};
+        for (int lane = 0; lane < laneCount; ++lane)
+        {
+            GetColumnRay(base + lane, rayCount, &angle[lane], &cos[lane], &sin[lane]);
+        }
+        __m256 rayCos = _mm256_load_ps(cos);
+        __m256 raySin = _mm256_load_ps(sin);
+        int active = (1 << laneCount) - 1;
+
+        for (int i = 0; i < viewDistance && active; i += 2)
+        {
+            __m256 step = _mm256_set1_ps((float)i);
+            __m256 rayX = _mm256_add_ps(playerX, _mm256_mul_ps(rayCos, step));
+            __m256 rayY = _mm256_add_ps(playerY, _mm256_mul_ps(raySin, step));
+            __m256i pixelX = _mm256_cvttps_epi32(_mm256_floor_ps(rayX));
+            __m256i pixelY = _mm256_cvttps_epi32(_mm256_floor_ps(rayY));
+            __m256i tileX = _mm256_add_epi32(playerTileX, _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_div_ps(_mm256_cvtepi32_ps(pixelX), tileWidth))));
+            __m256i tileY = _mm256_add_epi32(playerTileY, _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_div_ps(_mm256_cvtepi32_ps(pixelY), tileHeight))));
+
+            __m256i inside = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpgt_epi32(tileX, minusOne), _mm256_cmpgt_epi32(mapWidth, tileX)),
+                _mm256_and_si256(_mm256_cmpgt_epi32(tileY, minusOne), _mm256_cmpgt_epi32(mapHeight, tileY)));
+            __m256i brick = _mm256_add_epi32(_mm256_srl_epi32(tileX, brickShift),
+                                             _mm256_mullo_epi32(_mm256_srl_epi32(tileY, brickShift), brickStride));
+            __m256i inBrick = _mm256_add_epi32(_mm256_sll_epi32(_mm256_and_si256(tileY, brickMask), brickShift),
+                                               _mm256_and_si256(tileX, brickMask));
+            __m256i index = _mm256_add_epi32(_mm256_add_epi32(_mm256_sll_epi32(brick, brickAreaShift), inBrick), misalignmentValue);
+            __m256i wordIndex = _mm256_andnot_si256(_mm256_set1_epi32(3), index);
+            __m256i shift = _mm256_slli_epi32(_mm256_and_si256(index, _mm256_set1_epi32(3)), 3);
+            __m256i words = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), tileWords, wordIndex, inside, 1);
+            __m256i tile = _mm256_and_si256(_mm256_srlv_epi32(words, shift), byteMask);
+            tile = _mm256_blendv_epi8(wall, tile, inside);
+
+            int solid = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(tile, _mm256_setzero_si256())));
+            int hitLanes = active & solid;
+            int emptyLanes = active & ~solid;
+
+            alignas(32) float rx[8], ry[8];
+            alignas(32) int px[8], py[8], tiles[8];
+            _mm256_store_ps(rx, rayX);
+            _mm256_store_ps(ry, rayY);
+            _mm256_store_si256((__m256i *)px, pixelX);
+            _mm256_store_si256((__m256i *)py, pixelY);
+            _mm256_store_si256((__m256i *)tiles, tile);
+
+            for (int lane = 0; emptyLanes >> lane; ++lane)
+            {
+                if (emptyLanes & (1 << lane))
+                {
+                    MarkRayStep(&lanes, px[lane], py[lane]);
+                }
+            }
+            for (int lane = 0; hitLanes >> lane; ++lane)
+            {
+                if (hitLanes & (1 << lane))
+                {
+                    SetRayHit(hits, base + lane, angle[lane], Distance(player.position.offset, Vec2(rx[lane], ry[lane])), (TileType)tiles[lane], texture);
+                }
+            }
+            active &= ~hitLanes;
+        }
+    }
+}
+
+const int RoundNearest = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+
+__attribute__((target("avx512f")))
+void TraceRaysAVX512(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    RayLanes lanes = BeginRayLanes(buffer);
+    int rayCount = hits->count;
+    __m512 playerX = _mm512_set1_ps(player.position.offset.x);
+    __m512 playerY = _mm512_set1_ps(player.position.offset.y);
+    __m512i playerTileX = _mm512_set1_epi32(player.position.tileX);
+    __m512i playerTileY = _mm512_set1_epi32(player.position.tileY);
+    __m512 tileWidth = _mm512_set1_ps(TileDimsInPixels.x);
+    __m512 tileHeight = _mm512_set1_ps(TileDimsInPixels.y);
+    __m512i mapWidth = _mm512_set1_epi32(world.width);
+    __m512i mapHeight = _mm512_set1_epi32(world.height);
+    __m512i zero = _mm512_setzero_si512();
+    __m512i wall = _mm512_set1_epi32(A);
+
+    int misalignment = (int)((uintptr_t)world.tiles & 3);
+    const int *tileWords = (const int *)(world.tiles - misalignment);
+    __m512i misalignmentValue = _mm512_set1_epi32(misalignment);
+    TileIndexing indexing = GetTileIndexing(world);
+    __m128i brickShift = _mm_cvtsi32_si128(indexing.brickShift);
+    __m128i brickAreaShift = _mm_cvtsi32_si128(2 * indexing.brickShift);
+    __m512i brickMask = _mm512_set1_epi32(indexing.brickMask);
+    __m512i brickStride = _mm512_set1_epi32(indexing.brickStride);
+
+    for (int base = 0; base < rayCount; base += 16)
+    {
+        int laneCount = SDL_min(16, rayCount - base);
+        alignas(64) float angle[16] = {0}, cos[16] = {0}, sin[16] = {0};
+        for (int lane = 0; lane < laneCount; ++lane)
+        {
+            GetColumnRay(base + lane, rayCount, &angle[lane], &cos[lane], &sin[lane]);
+        }
+        __m512 rayCos = _mm512_load_ps(cos);
+        __m512 raySin = _mm512_load_ps(sin);
+        int active = (1 << laneCount) - 1;
+
+        for (int i = 0; i < viewDistance && active; i += 2)
+        {
+            // AVX-512 implies FMA, and a fused multiply add would round
+            // differently from DrawRays. The explicit rounding forms are never
+            // contracted.
+            __m512 step = _mm512_set1_ps((float)i);
+            __m512 rayX = _mm512_add_round_ps(playerX, _mm512_mul_round_ps(rayCos, step, RoundNearest), RoundNearest);
+            __m512 rayY = _mm512_add_round_ps(playerY, _mm512_mul_round_ps(raySin, step, RoundNearest), RoundNearest);
+            __m512i pixelX = _mm512_cvttps_epi32(_mm512_floor_ps(rayX));
+            __m512i pixelY = _mm512_cvttps_epi32(_mm512_floor_ps(rayY));
+            __m512i tileX = _mm512_add_epi32(playerTileX, _mm512_cvttps_epi32(_mm512_floor_ps(_mm512_div_ps(_mm512_cvtepi32_ps(pixelX), tileWidth))));
+            __m512i tileY = _mm512_add_epi32(playerTileY, _mm512_cvttps_epi32(_mm512_floor_ps(_mm512_div_ps(_mm512_cvtepi32_ps(pixelY), tileHeight))));
+
+            __mmask16 inside = _mm512_cmpge_epi32_mask(tileX, zero) & _mm512_cmpgt_epi32_mask(mapWidth, tileX) &
+                               _mm512_cmpge_epi32_mask(tileY, zero) & _mm512_cmpgt_epi32_mask(mapHeight, tileY);
+            __m512i brick = _mm512_add_epi32(_mm512_srl_epi32(tileX, brickShift),
+                                             _mm512_mullo_epi32(_mm512_srl_epi32(tileY, brickShift), brickStride));
+            __m512i inBrick = _mm512_add_epi32(_mm512_sll_epi32(_mm512_and_si512(tileY, brickMask), brickShift),
+                                               _mm512_and_si512(tileX, brickMask));
+            __m512i index = _mm512_add_epi32(_mm512_add_epi32(_mm512_sll_epi32(brick, brickAreaShift), inBrick), misalignmentValue);
+            __m512i wordIndex = _mm512_andnot_si512(_mm512_set1_epi32(3), index);
+            __m512i shift = _mm512_slli_epi32(_mm512_and_si512(index, _mm512_set1_epi32(3)), 3);
+            __m512i words = _mm512_mask_i32gather_epi32(zero, inside, wordIndex, tileWords, 1);
+            __m512i tile = _mm512_and_si512(_mm512_srlv_epi32(words, shift), _mm512_set1_epi32(0xFF));
+            tile = _mm512_mask_blend_epi32(inside, wall, tile);
+
+            int solid = _mm512_cmpneq_epi32_mask(tile, zero);
+            int hitLanes = active & solid;
+            int emptyLanes = active & ~solid;
+
+            alignas(64) float rx[16], ry[16];
+            alignas(64) int px[16], py[16], tiles[16];
+            _mm512_store_ps(rx, rayX);
+            _mm512_store_ps(ry, rayY);
+            _mm512_store_si512(px, pixelX);
+            _mm512_store_si512(py, pixelY);
+            _mm512_store_si512(tiles, tile);
+
+            for (int lane = 0; emptyLanes >> lane; ++lane)
+            {
+                if (emptyLanes & (1 << lane))
+                {
+                    MarkRayStep(&lanes, px[lane], py[lane]);
+                }
+            }
+            for (int lane = 0; hitLanes >> lane; ++lane)
+            {
+                if (hitLanes & (1 << lane))
+                {
+                    SetRayHit(hits, base + lane, angle[lane], Distance(player.position.offset, Vec2(rx[lane], ry[lane])), (TileType)tiles[lane], texture);
+                }
+            }
+            active &= ~hitLanes;
+        }
+    }
+}
+
+#endif
+
+#endif
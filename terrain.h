@@ -0,0 +1,339 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+// Voxel heightmap terrain, an outdoor mode drawn in place of the tile map.
+//
+// A grey heightmap gives the ground height of every texel in texels, a
+// colormap of the same size its colour. Without a colormap the colour comes
+// from the height and the slope. Both load with stb_image, need power of two
+// sizes and wrap around. The player's world pixels are terrain texels.
+//
+// Every column of the FPS view marches its ray from the camera outwards and
+// projects the ground at each sample. Only what rises above the highest row
+// drawn so far is new, so the column fills front to back with a y-buffer of
+// one row and no pixel is written twice. What is left above is sky. The
+// step grows with depth, far terrain is sampled coarser, and the last part
+// of the view distance fades into the sky to hide where it ends.
+//
+// Columns are independent, so bands of them are handed out to a pool of
+// worker threads the caller joins, which draw to disjoint pixels.
+
+const float TerrainEyeHeight = 32.0f;
+// The step is a texel up to 1 / TerrainLodScale deep, proportional beyond.
+const float TerrainLodScale = 1.0f / 256.0f;
+const float TerrainFogStart = 0.6f;
+const int TerrainBandWidth = 16;
+const Uint32 SkyColor = PackColorABGR(255, 235, 206, 135);
+
+struct Terrain
+{
+    int width;
+    int height;
+    // Colour in the low 24 bits, height in the top 8, one load per sample.
+    Uint32 *texels;
+};
+
+Terrain terrain;
+float terrainDistance = 2048.0f;
+// 0 for one per core.
+int terrainThreadCount;
+
+// A weight of 256 is all b.
+inline Uint32 BlendColor(Uint32 a, Uint32 b, Uint32 weight)
+{
+    Uint32 redBlue = ((a & 0x00FF00FF) * (256 - weight) + (b & 0x00FF00FF) * weight) >> 8;
+    Uint32 green = ((a & 0x0000FF00) * (256 - weight) + (b & 0x0000FF00) * weight) >> 8;
+    return (redBlue & 0x00FF00FF) | (green & 0x0000FF00);
+}
+
+// Grass low, rock higher up and snow on the peaks, lit from the west.
+Uint32 GetTerrainColor(const Uint8 *heights, int width, int x, int y)
+{
+    const Uint32 Grass = PackColorABGR(0, 40, 130, 50);
+    const Uint32 Rock = PackColorABGR(0, 80, 110, 130);
+    const Uint32 Snow = PackColorABGR(0, 240, 240, 240);
+
+    int value = heights[x + y * width];
+    Uint32 color = value < 128 ? BlendColor(Grass, Rock, value * 2) : BlendColor(Rock, Snow, (value - 128) * 2);
+
+    int west = heights[((x - 1) & (width - 1)) + y * width];
+    int light = SDL_max(64, SDL_min(256 + (value - west) * 24, 448));
+    Uint8 alpha, blue, green, red;
+    UnpackColorABGR(color, &alpha, &blue, &green, &red);
+    return PackColorABGR(0, SDL_min(blue * light >> 8, 255), SDL_min(green * light >> 8, 255), SDL_min(red * light >> 8, 255));
+}
+
+struct TerrainView
+{
+    ScreenBuffer buffer;
+    float cameraX;
+    float cameraY;
+    float cameraHeight;
+    // Pixels a texel of height spans one texel deep.
+    float focal;
+    int horizon;
+    SDL_atomic_t nextBand;
+};
+
+struct TerrainWorkers
+{
+    int threadCount;
+    SDL_Thread **threads;
+    SDL_sem *start;
+    SDL_sem *finished;
+    SDL_atomic_t running;
+    TerrainView view;
+};
+
+TerrainWorkers terrainWorkers;
+
+void DrawTerrainColumn(const TerrainView *view, int column)
+{
+    ScreenBuffer buffer = view->buffer;
+    int pitch = buffer.pitch / buffer.bytesPerPixel;
+    Uint32 *pixel = (Uint32 *)(buffer.memory) + (int)MapDimsInPixels.x + column;
+    int maskX = terrain.width - 1;
+    int maskY = terrain.height - 1;
+
+    float angle, cos, sin;
+    GetColumnRay(column, buffer.viewWidth, &angle, &cos, &sin);
+    // Steps along the ray are in depth, which projects without correction.
+    float perpendicular = cosf(angle * AngleToRadian);
+    float stepX = cos / perpendicular;
+    float stepY = sin / perpendicular;
+    float fogStart = terrainDistance * TerrainFogStart;
+    float fogScale = 256.0f / (terrainDistance - fogStart);
+
+    int open = buffer.viewHeight;
+    for (float depth = 1.0f; depth < terrainDistance && open > 0; depth += SDL_max(1.0f, depth * TerrainLodScale))
+    {
+        int x = FloorToInt(view->cameraX + stepX * depth) & maskX;
+        int y = FloorToInt(view->cameraY + stepY * depth) & maskY;
+        Uint32 texel = terrain.texels[x + y * terrain.width];
+
+        float top = view->horizon + (view->cameraHeight - (float)(texel >> 24)) * view->focal / depth;
+        if (top >= open - 0.5f)
+        {
+            continue;
+        }
+
+        int row = FloorToInt(SDL_max(top, 0.0f) + 0.5f);
+        Uint32 color = texel;
+        if (depth > fogStart)
+        {
+            color = BlendColor(texel, SkyColor, (Uint32)((depth - fogStart) * fogScale));
+        }
+        color |= 0xFF000000;
+        for (int fill = row; fill < open; ++fill)
+        {
+            pixel[fill * pitch] = color;
+        }
+        open = row;
+    }
+
+    for (int fill = 0; fill < open; ++fill)
+    {
+        pixel[fill * pitch] = SkyColor;
+    }
+}
+
+void DrawTerrainBands(TerrainView *view)
+{
+    int bandCount = (view->buffer.viewWidth + TerrainBandWidth - 1) / TerrainBandWidth;
+    for (int band = SDL_AtomicAdd(&view->nextBand, 1); band < bandCount; band = SDL_AtomicAdd(&view->nextBand, 1))
+    {
+        int end = SDL_min((band + 1) * TerrainBandWidth, view->buffer.viewWidth);
+        for (int column = band * TerrainBandWidth; column < end; ++column)
+        {
+            DrawTerrainColumn(view, column);
+        }
+    }
+}
+
+int TerrainWorker(void *data)
+{
+    TerrainWorkers *workers = (TerrainWorkers *) data;
+    for (;;)
+    {
+        SDL_SemWait(workers->start);
+        if (!SDL_AtomicGet(&workers->running))
+        {
+            return 0;
+        }
+        DrawTerrainBands(&workers->view);
+        SDL_SemPost(workers->finished);
+    }
+}
+
+// The calling thread is one of the workers. A thread that fails to start
+// leaves its bands to the others.
+void StartTerrainWorkers(int threadCount)
+{
+    TerrainWorkers *workers = &terrainWorkers;
+    if (threadCount <= 0)
+    {
+        threadCount = SDL_GetCPUCount();
+    }
+    workers->threadCount = SDL_max(1, threadCount);
+    workers->threads = (SDL_Thread **) calloc(workers->threadCount, sizeof(SDL_Thread *));
+    workers->start = SDL_CreateSemaphore(0);
+    workers->finished = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&workers->running, 1);
+    for (int i = 1; i < workers->threadCount; ++i)
+    {
+        workers->threads[i] = SDL_CreateThread(TerrainWorker, "terrain", workers);
+        if (!workers->threads[i])
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Terrain thread fail : %s\n", SDL_GetError());
+        }
+    }
+}
+
+void StopTerrainWorkers()
+{
+    TerrainWorkers *workers = &terrainWorkers;
+    if (!workers->threadCount)
+    {
+        return;
+    }
+    SDL_AtomicSet(&workers->running, 0);
+    for (int i = 1; i < workers->threadCount; ++i)
+    {
+        SDL_SemPost(workers->start);
+    }
+    for (int i = 1; i < workers->threadCount; ++i)
+    {
+        SDL_WaitThread(workers->threads[i], NULL);
+    }
+    SDL_DestroySemaphore(workers->start);
+    SDL_DestroySemaphore(workers->finished);
+    free(workers->threads);
+    memset(workers, 0, sizeof(*workers));
+}
+
+void FreeTerrain()
+{
+    StopTerrainWorkers();
+    free(terrain.texels);
+    terrain = Terrain {};
+}
+
+// colorPath may be NULL.
+bool LoadTerrain(const char *heightPath, const char *colorPath)
+{
+    int width, height, compsPerPixel;
+    Uint8 *heights = stbi_load(heightPath, &width, &height, &compsPerPixel, 1);
+    if (!heights)
+    {
+        return false;
+    }
+    if (!IsPowerOfTwo(width) || !IsPowerOfTwo(height))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Terrain load fail : %dx%d is not a power of two\n", width, height);
+        stbi_image_free(heights);
+        return false;
+    }
+
+    Uint32 *colors = NULL;
+    if (colorPath)
+    {
+        int colorWidth, colorHeight;
+        colors = (Uint32 *) stbi_load(colorPath, &colorWidth, &colorHeight, &compsPerPixel, STBI_rgb_alpha);
+        if (!colors || colorWidth != width || colorHeight != height)
+        {
+            stbi_image_free(colors);
+            stbi_image_free(heights);
+            return false;
+        }
+    }
+
+    FreeTerrain();
+    terrain.width = width;
+    terrain.height = height;
+    terrain.texels = (Uint32 *) malloc((size_t)width * height * sizeof(Uint32));
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            size_t i = (size_t)x + (size_t)y * width;
+            Uint32 color = colors ? colors[i] & 0x00FFFFFF : GetTerrainColor(heights, width, x, y);
+            terrain.texels[i] = color | ((Uint32)heights[i] << 24);
+        }
+    }
+
+    stbi_image_free(colors);
+    stbi_image_free(heights);
+    return true;
+}
+
+// Integer texels of the player wrapped onto the terrain, the fraction stays
+// in the offset.
+inline int GetTerrainOriginX()
+{
+    return TileOriginPixelX(player.position) & (terrain.width - 1);
+}
+
+inline int GetTerrainOriginY()
+{
+    return TileOriginPixelY(player.position) & (terrain.height - 1);
+}
+
+void DrawTerrain(ScreenBuffer buffer)
+{
+    TerrainWorkers *workers = &terrainWorkers;
+    if (!workers->threadCount)
+    {
+        StartTerrainWorkers(terrainThreadCount);
+    }
+
+    TerrainView *view = &workers->view;
+    view->buffer = buffer;
+    view->cameraX = GetTerrainOriginX() + player.position.offset.x;
+    view->cameraY = GetTerrainOriginY() + player.position.offset.y;
+    int groundX = FloorToInt(view->cameraX) & (terrain.width - 1);
+    int groundY = FloorToInt(view->cameraY) & (terrain.height - 1);
+    view->cameraHeight = (float)(terrain.texels[groundX + groundY * terrain.width] >> 24) + TerrainEyeHeight;
+    view->focal = buffer.viewWidth * 0.5f / tanf(player.fov * 0.5f * AngleToRadian);
+    view->horizon = GetHorizonRow(buffer);
+    SDL_AtomicSet(&view->nextBand, 0);
+
+    for (int i = 1; i < workers->threadCount; ++i)
+    {
+        if (workers->threads[i])
+        {
+            SDL_SemPost(workers->start);
+        }
+    }
+    DrawTerrainBands(view);
+    for (int i = 1; i < workers->threadCount; ++i)
+    {
+        if (workers->threads[i])
+        {
+            SDL_SemWait(workers->finished);
+        }
+    }
+}
+
+// The colormap around the player at a texel per pixel.
+void DrawTerrainMap(ScreenBuffer buffer)
+{
+    int width = (int)MapDimsInPixels.x;
+    int height = SDL_min((int)MapDimsInPixels.y, buffer.height);
+    int pitch = buffer.pitch / buffer.bytesPerPixel;
+    int originX = GetTerrainOriginX() + (int)player.position.offset.x - width / 2;
+    int originY = GetTerrainOriginY() + (int)player.position.offset.y - height / 2;
+    Uint32 *pixels = (Uint32 *)(buffer.memory);
+    for (int y = 0; y < height; ++y)
+    {
+        const Uint32 *row = terrain.texels + ((originY + y) & (terrain.height - 1)) * terrain.width;
+        for (int x = 0; x < width; ++x)
+        {
+            pixels[x + y * pitch] = row[(originX + x) & (terrain.width - 1)] | 0xFF000000;
+        }
+    }
+
+    Vec2 centre(width / 2, height / 2);
+    DrawRect(buffer, centre - player.dimensions * 0.5f, player.dimensions, Black);
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef TILELAYOUT_H
+#define TILELAYOUT_H
+
+// Tile storage layouts.
+//
+// Row major maps put vertically adjacent tiles a whole row apart, so a ray
+// travelling north or south touches a new cache line on every tile once the
+// map is wider than a line. Bricked maps store 8x8 tile bricks of one 64 byte
+// cache line each, bricks in row major order, so a ray at any angle stays in
+// a line for several tiles. The last brick row and column are padded with
+// walls. Every reader of TileMap::tiles goes through TileIndex.
+
+const int TileBrickShift = 3;
+const int TileBrickSize = 1 << TileBrickShift;
+const int TileBrickMask = TileBrickSize - 1;
+const int TileBrickBytes = TileBrickSize * TileBrickSize * sizeof(TileType);
+
+inline int BrickCount(int tiles)
+{
+    return (tiles + TileBrickMask) >> TileBrickShift;
+}
+
+inline size_t BrickedTileIndex(int tileX, int tileY, int width)
+{
+    size_t brick = (size_t)(tileX >> TileBrickShift) + (size_t)(tileY >> TileBrickShift) * BrickCount(width);
+    return (brick << (2 * TileBrickShift)) + ((tileY & TileBrickMask) << TileBrickShift) + (tileX & TileBrickMask);
+}
+
+// Position of an in bounds tile in map.tiles.
+inline size_t TileIndex(TileMap map, int tileX, int tileY)
+{
+    if (map.layout == TileLayout_Bricked)
+    {
+        return BrickedTileIndex(tileX, tileY, map.width);
+    }
+    return (size_t)tileX + (size_t)tileY * map.width;
+}
+
+// TileIndex as shifts and masks for the SIMD gathers. Row major is the
+// bricked formula with one tile bricks.
+struct TileIndexing
+{
+    int brickShift;
+    int brickMask;
+    int brickStride;
+};
+
+inline TileIndexing GetTileIndexing(TileMap map)
+{
+    if (map.layout == TileLayout_Bricked)
+    {
+        return TileIndexing { TileBrickShift, TileBrickMask, BrickCount(map.width) };
+    }
+    return TileIndexing { 0, 0, map.width };
+}
+
+inline size_t TileStorageCount(int width, int height, TileLayout layout)
+{
+    if (layout == TileLayout_Bricked)
+    {
+        return (size_t)BrickCount(width) * BrickCount(height) * TileBrickSize * TileBrickSize;
+    }
+    return (size_t)width * height;
+}
+
+// Tile storage aligned to a cache line, so every brick is exactly one line.
+TileType *AllocateTiles(size_t count)
+{
+    size_t bytes = (count * sizeof(TileType) + TileBrickBytes - 1) & ~(size_t)(TileBrickBytes - 1);
+#ifdef _WIN32
+    return (TileType *) _aligned_malloc(bytes, TileBrickBytes);
+#else
+    void *tiles = NULL;
+    return posix_memalign(&tiles, TileBrickBytes, bytes) == 0 ? (TileType *) tiles : NULL;
+#endif
+}
+
+void FreeTiles(TileType *tiles)
+{
+#ifdef _WIN32
+    _aligned_free(tiles);
+#else
+    free(tiles);
+#endif
+}
+
+// Copy of source stored in layout, tiles from AllocateTiles.
+TileMap ConvertTileLayout(TileMap source, TileLayout layout)
+{
+    TileMap result = { source.width, source.height, NULL, layout };
+    size_t count = TileStorageCount(source.width, source.height, layout);
+    result.tiles = AllocateTiles(count);
+    memset(result.tiles, A, count * sizeof(TileType));
+
+    for (int y = 0; y < source.height; ++y)
+    {
+        for (int x = 0; x < source.width; ++x)
+        {
+            result.tiles[TileIndex(result, x, y)] = source.tiles[TileIndex(source, x, y)];
+        }
+    }
+    return result;
+}
+
+bool ParseTileLayout(const char *name, TileLayout *result)
+{
+    if (strcmp(name, "rowmajor") == 0)
+    {
+        *result = TileLayout_RowMajor;
+        return true;
+    }
+    if (strcmp(name, "bricked") == 0)
+    {
+        *result = TileLayout_Bricked;
+        return true;
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,582 @@
+#ifndef WALLS_H
+#define WALLS_H
+
+#include <stdio.h>
+
+// Line segment walls.
+//
+// Walls that do not fill a whole tile: angled walls, thin walls, pillars made
+// of a few segments. They live next to the tile map rather than in it. After
+// a ray caster has filled the hits from the tiles, CastWalls traces every
+// column against the segments up to its tile hit and replaces the hit where
+// a segment is nearer, so DrawFpsView draws both without knowing the
+// difference.
+//
+// The segments are kept in a bounding volume hierarchy, a binary tree of
+// boxes stored depth first in one array: the first child of an inner node
+// is the node right after it, the second one is stored by index. A leaf is a
+// packet of up to WallLanes segments laid out one array per coordinate, so
+// the kernels table tests a whole packet with one vector comparison. Rays
+// visit the nearer child first and skip boxes behind the nearest hit so far.
+//
+// Segments are in absolute pixels. Like any float position they are exact to
+// a fraction of a pixel only up to a few thousand tiles from the origin, see
+// worldpos.h.
+
+const int WallLanes = 8;
+const int WallBins = 16;
+// Below this the tree splits by count instead of by cost, so its depth and
+// the traversal stack stay bounded for any input.
+const int MaxWallCostDepth = 32;
+const int WallStackSize = 64;
+
+struct WallSegment
+{
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+    TileType tile;
+};
+
+// One leaf's segments, as start points and start to end vectors. Unused
+// lanes are zero length and never hit.
+struct WallPacket
+{
+    float x0[WallLanes];
+    float y0[WallLanes];
+    float dx[WallLanes];
+    float dy[WallLanes];
+    TileType tile[WallLanes];
+};
+
+struct WallNode
+{
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    // Leaves: the packet. Inner nodes: the second child.
+    Uint32 index;
+    // Segments in the leaf, zero for inner nodes.
+    Uint16 count;
+    // Axis inner nodes are split across, 0 for x.
+    Uint16 axis;
+};
+
+struct WallSet
+{
+    int segmentCount;
+    int nodeCount;
+    int packetCount;
+    WallNode *nodes;
+    WallPacket *packets;
+};
+
+WallSet walls;
+
+// Tests a ray against every lane of the packet. Returns the lane of the
+// nearest segment crossed in (0, *nearest) and lowers *nearest to it, or -1.
+// Equal distances go to the lower lane, at every SIMD level alike.
+int IntersectWallsScalar(const WallPacket *packet, float eyeX, float eyeY, float dirX, float dirY, float *nearest)
+{
+    int hitLane = -1;
+    for (int lane = 0; lane < WallLanes; ++lane)
+    {
+        float wx = packet->x0[lane] - eyeX;
+        float wy = packet->y0[lane] - eyeY;
+        float denom = dirX * packet->dy[lane] - dirY * packet->dx[lane];
+        float t = (wx * packet->dy[lane] - wy * packet->dx[lane]) / denom;
+        float s = (wx * dirY - wy * dirX) / denom;
+        if (t > 0 && t < *nearest && s >= 0 && s <= 1)
+        {
+            *nearest = t;
+            hitLane = lane;
+        }
+    }
+    return hitLane;
+}
+
+#ifdef RAYCASTER_X86
+
+// Distances of the lanes in mask, settled in lane order like the scalar loop.
+inline int PickWallLane(const float *t, int mask, int baseLane, float *nearest, int hitLane)
+{
+    for (; mask; mask &= mask - 1)
+    {
+        int lane = __builtin_ctz(mask);
+        if (t[lane] < *nearest)
+        {
+            *nearest = t[lane];
+            hitLane = baseLane + lane;
+        }
+    }
+    return hitLane;
+}
+
+__attribute__((target("sse2")))
+int IntersectWallsSSE2(const WallPacket *packet, float eyeX, float eyeY, float dirX, float dirY, float *nearest)
+{
+    __m128 eyeXs = _mm_set1_ps(eyeX);
+    __m128 eyeYs = _mm_set1_ps(eyeY);
+    __m128 dirXs = _mm_set1_ps(dirX);
+    __m128 dirYs = _mm_set1_ps(dirY);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+
+    int hitLane = -1;
+    for (int base = 0; base < WallLanes; base += 4)
+    {
+        __m128 dx = _mm_loadu_ps(packet->dx + base);
+        __m128 dy = _mm_loadu_ps(packet->dy + base);
+        __m128 wx = _mm_sub_ps(_mm_loadu_ps(packet->x0 + base), eyeXs);
+        __m128 wy = _mm_sub_ps(_mm_loadu_ps(packet->y0 + base), eyeYs);
+        __m128 denom = _mm_sub_ps(_mm_mul_ps(dirXs, dy), _mm_mul_ps(dirYs, dx));
+        __m128 t = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(wx, dy), _mm_mul_ps(wy, dx)), denom);
+        __m128 s = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(wx, dirYs), _mm_mul_ps(wy, dirXs)), denom);
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(*nearest))),
+                                   _mm_and_ps(_mm_cmpge_ps(s, zero), _mm_cmple_ps(s, one)));
+        int mask = _mm_movemask_ps(inside);
+        if (mask)
+        {
+            float distances[4];
+            _mm_storeu_ps(distances, t);
+            hitLane = PickWallLane(distances, mask, base, nearest, hitLane);
+        }
+    }
+    return hitLane;
+}
+
+// Also used at the AVX-512 level, a packet is only eight lanes wide.
+__attribute__((target("avx2")))
+int IntersectWallsAVX2(const WallPacket *packet, float eyeX, float eyeY, float dirX, float dirY, float *nearest)
+{
+    __m256 dirXs = _mm256_set1_ps(dirX);
+    __m256 dirYs = _mm256_set1_ps(dirY);
+    __m256 dx = _mm256_loadu_ps(packet->dx);
+    __m256 dy = _mm256_loadu_ps(packet->dy);
+    __m256 wx = _mm256_sub_ps(_mm256_loadu_ps(packet->x0), _mm256_set1_ps(eyeX));
+    __m256 wy = _mm256_sub_ps(_mm256_loadu_ps(packet->y0), _mm256_set1_ps(eyeY));
+    __m256 denom = _mm256_sub_ps(_mm256_mul_ps(dirXs, dy), _mm256_mul_ps(dirYs, dx));
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(wx, dy), _mm256_mul_ps(wy, dx)), denom);
+    __m256 s = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(wx, dirYs), _mm256_mul_ps(wy, dirXs)), denom);
+
+    __m256 zero = _mm256_setzero_ps();
+    __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(*nearest), _CMP_LT_OQ)),
+                                  _mm256_and_ps(_mm256_cmp_ps(s, zero, _CMP_GE_OQ), _mm256_cmp_ps(s, _mm256_set1_ps(1.0f), _CMP_LE_OQ)));
+    int mask = _mm256_movemask_ps(inside);
+    if (!mask)
+    {
+        return -1;
+    }
+    float distances[WallLanes];
+    _mm256_storeu_ps(distances, t);
+    return PickWallLane(distances, mask, 0, nearest, -1);
+}
+
+#endif
+
+struct WallBuilder
+{
+    WallSegment *segments;
+    WallNode *nodes;
+    WallPacket *packets;
+    int nodeCount;
+    int packetCount;
+};
+
+inline float WallCentre(const WallSegment *segment, int axis)
+{
+    return axis == 0 ? (segment->x0 + segment->x1) * 0.5f : (segment->y0 + segment->y1) * 0.5f;
+}
+
+// Box around the segments in [first, first + count).
+void GetWallBounds(const WallSegment *segments, int count, float *minX, float *minY, float *maxX, float *maxY)
+{
+    *minX = *minY = INFINITY;
+    *maxX = *maxY = -INFINITY;
+    for (int i = 0; i < count; ++i)
+    {
+        *minX = SDL_min(*minX, SDL_min(segments[i].x0, segments[i].x1));
+        *minY = SDL_min(*minY, SDL_min(segments[i].y0, segments[i].y1));
+        *maxX = SDL_max(*maxX, SDL_max(segments[i].x0, segments[i].x1));
+        *maxY = SDL_max(*maxY, SDL_max(segments[i].y0, segments[i].y1));
+    }
+}
+
+// Moves the segments whose centre is in a bin below splitBin to the front,
+// returns how many there are.
+int PartitionWalls(WallSegment *segments, int count, int axis, float binMin, float binScale, int splitBin)
+{
+    int left = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        int bin = SDL_min(WallBins - 1, (int)((WallCentre(&segments[i], axis) - binMin) * binScale));
+        if (bin < splitBin)
+        {
+            WallSegment swap = segments[left];
+            segments[left] = segments[i];
+            segments[i] = swap;
+            ++left;
+        }
+    }
+    return left;
+}
+
+// Number of segments the first child gets: the cheapest of the bin borders
+// along the longer axis of the centres, by half perimeter times segments.
+int SplitWalls(WallSegment *segments, int count, int *axisOut)
+{
+    float centreMinX = INFINITY, centreMinY = INFINITY;
+    float centreMaxX = -INFINITY, centreMaxY = -INFINITY;
+    for (int i = 0; i < count; ++i)
+    {
+        float x = WallCentre(&segments[i], 0);
+        float y = WallCentre(&segments[i], 1);
+        centreMinX = SDL_min(centreMinX, x);
+        centreMinY = SDL_min(centreMinY, y);
+        centreMaxX = SDL_max(centreMaxX, x);
+        centreMaxY = SDL_max(centreMaxY, y);
+    }
+    int axis = (centreMaxX - centreMinX) >= (centreMaxY - centreMinY) ? 0 : 1;
+    *axisOut = axis;
+    float binMin = axis == 0 ? centreMinX : centreMinY;
+    float extent = (axis == 0 ? centreMaxX : centreMaxY) - binMin;
+    if (!(extent > 0))
+    {
+        return count / 2;
+    }
+    float binScale = WallBins / extent;
+
+    int binCount[WallBins] = {};
+    float binBounds[WallBins][4];
+    for (int bin = 0; bin < WallBins; ++bin)
+    {
+        binBounds[bin][0] = binBounds[bin][1] = INFINITY;
+        binBounds[bin][2] = binBounds[bin][3] = -INFINITY;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        const WallSegment *segment = &segments[i];
+        int bin = SDL_min(WallBins - 1, (int)((WallCentre(segment, axis) - binMin) * binScale));
+        ++binCount[bin];
+        binBounds[bin][0] = SDL_min(binBounds[bin][0], SDL_min(segment->x0, segment->x1));
+        binBounds[bin][1] = SDL_min(binBounds[bin][1], SDL_min(segment->y0, segment->y1));
+        binBounds[bin][2] = SDL_max(binBounds[bin][2], SDL_max(segment->x0, segment->x1));
+        binBounds[bin][3] = SDL_max(binBounds[bin][3], SDL_max(segment->y0, segment->y1));
+    }
+
+    // Cost of everything right of each border, swept from the right.
+    float rightCost[WallBins];
+    float bounds[4] = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+    int seen = 0;
+    for (int bin = WallBins - 1; bin > 0; --bin)
+    {
+        seen += binCount[bin];
+        bounds[0] = SDL_min(bounds[0], binBounds[bin][0]);
+        bounds[1] = SDL_min(bounds[1], binBounds[bin][1]);
+        bounds[2] = SDL_max(bounds[2], binBounds[bin][2]);
+        bounds[3] = SDL_max(bounds[3], binBounds[bin][3]);
+        rightCost[bin] = seen ? seen * ((bounds[2] - bounds[0]) + (bounds[3] - bounds[1])) : 0.0f;
+    }
+
+    int bestBin = 0;
+    float bestCost = INFINITY;
+    bounds[0] = bounds[1] = INFINITY;
+    bounds[2] = bounds[3] = -INFINITY;
+    seen = 0;
+    for (int bin = 1; bin < WallBins; ++bin)
+    {
+        seen += binCount[bin - 1];
+        bounds[0] = SDL_min(bounds[0], binBounds[bin - 1][0]);
+        bounds[1] = SDL_min(bounds[1], binBounds[bin - 1][1]);
+        bounds[2] = SDL_max(bounds[2], binBounds[bin - 1][2]);
+        bounds[3] = SDL_max(bounds[3], binBounds[bin - 1][3]);
+        float cost = (seen ? seen * ((bounds[2] - bounds[0]) + (bounds[3] - bounds[1])) : 0.0f) + rightCost[bin];
+        if (seen > 0 && seen < count && cost < bestCost)
+        {
+            bestCost = cost;
+            bestBin = bin;
+        }
+    }
+    if (bestBin == 0)
+    {
+        return count / 2;
+    }
+    return PartitionWalls(segments, count, axis, binMin, binScale, bestBin);
+}
+
+int BuildWallNode(WallBuilder *builder, int first, int count, int depth)
+{
+    int nodeIndex = builder->nodeCount++;
+    WallNode *node = &builder->nodes[nodeIndex];
+    WallSegment *segments = builder->segments + first;
+    GetWallBounds(segments, count, &node->minX, &node->minY, &node->maxX, &node->maxY);
+
+    if (count <= WallLanes)
+    {
+        WallPacket *packet = &builder->packets[builder->packetCount];
+        *packet = WallPacket {};
+        for (int lane = 0; lane < count; ++lane)
+        {
+            packet->x0[lane] = segments[lane].x0;
+            packet->y0[lane] = segments[lane].y0;
+            packet->dx[lane] = segments[lane].x1 - segments[lane].x0;
+            packet->dy[lane] = segments[lane].y1 - segments[lane].y0;
+            packet->tile[lane] = segments[lane].tile;
+        }
+        node->index = builder->packetCount++;
+        node->count = (Uint16)count;
+        node->axis = 0;
+        return nodeIndex;
+    }
+
+    int axis = 0;
+    int firstCount = depth < MaxWallCostDepth ? SplitWalls(segments, count, &axis) : count / 2;
+    node->count = 0;
+    node->axis = (Uint16)axis;
+    BuildWallNode(builder, first, firstCount, depth + 1);
+    node->index = (Uint32)BuildWallNode(builder, first + firstCount, count - firstCount, depth + 1);
+    return nodeIndex;
+}
+
+void FreeWalls()
+{
+    free(walls.nodes);
+    free(walls.packets);
+    walls = WallSet {};
+}
+
+// Replaces the walls with the given segments.
+void BuildWalls(const WallSegment *segments, int count)
+{
+    FreeWalls();
+    if (count <= 0)
+    {
+        return;
+    }
+
+    // At most one leaf per segment, and a full binary tree has one inner
+    // node less than it has leaves.
+    WallBuilder builder = {0};
+    builder.segments = (WallSegment *) malloc((size_t)count * sizeof(WallSegment));
+    memcpy(builder.segments, segments, (size_t)count * sizeof(WallSegment));
+    builder.nodes = (WallNode *) malloc((size_t)(2 * count) * sizeof(WallNode));
+    builder.packets = (WallPacket *) malloc((size_t)count * sizeof(WallPacket));
+    BuildWallNode(&builder, 0, count, 0);
+    free(builder.segments);
+
+    walls.segmentCount = count;
+    walls.nodeCount = builder.nodeCount;
+    walls.packetCount = builder.packetCount;
+    walls.nodes = (WallNode *) realloc(builder.nodes, (size_t)builder.nodeCount * sizeof(WallNode));
+    walls.packets = (WallPacket *) realloc(builder.packets, (size_t)builder.packetCount * sizeof(WallPacket));
+}
+
+void AppendWallSegment(WallSegment **segments, int *count, int *capacity, WallSegment segment)
+{
+    if (*count == *capacity)
+    {
+        *capacity = SDL_max(64, *capacity * 2);
+        *segments = (WallSegment *) realloc(*segments, *capacity * sizeof(WallSegment));
+    }
+    (*segments)[(*count)++] = segment;
+}
+
+// One segment per line as "x0 y0 x1 y1 tile", end points in tiles and the
+// tile type whose colour the wall gets. Lines starting with # are skipped.
+// Appends the segments in pixels.
+bool ReadWallSegments(const char *path, WallSegment **segments, int *count, int *capacity)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+
+    bool valid = true;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        WallSegment segment;
+        int tile;
+        char *start = line + strspn(line, " \t\r\n");
+        if (*start == '\0' || *start == '#')
+        {
+            continue;
+        }
+        if (sscanf(start, "%f %f %f %f %d", &segment.x0, &segment.y0, &segment.x1, &segment.y1, &tile) != 5 ||
+            tile <= _ || tile > C)
+        {
+            valid = false;
+            break;
+        }
+
+        segment.x0 *= TileDimsInPixels.x;
+        segment.y0 *= TileDimsInPixels.y;
+        segment.x1 *= TileDimsInPixels.x;
+        segment.y1 *= TileDimsInPixels.y;
+        segment.tile = (TileType)tile;
+        AppendWallSegment(segments, count, capacity, segment);
+    }
+    fclose(file);
+    return valid;
+}
+
+bool LoadWalls(const char *path)
+{
+    WallSegment *segments = NULL;
+    int count = 0;
+    int capacity = 0;
+    bool valid = ReadWallSegments(path, &segments, &count, &capacity);
+    if (valid)
+    {
+        BuildWalls(segments, count);
+    }
+    free(segments);
+    return valid;
+}
+
+// Where the ray enters the node's box, false when it misses it or only
+// reaches it past nearest.
+inline bool RayEntersWallNode(const WallNode *node, float eyeX, float eyeY, float inverseX, float inverseY, float nearest)
+{
+    float x0 = (node->minX - eyeX) * inverseX;
+    float x1 = (node->maxX - eyeX) * inverseX;
+    float y0 = (node->minY - eyeY) * inverseY;
+    float y1 = (node->maxY - eyeY) * inverseY;
+    float enter = SDL_max(SDL_min(x0, x1), SDL_min(y0, y1));
+    float exit = SDL_min(SDL_max(x0, x1), SDL_max(y0, y1));
+    return exit >= SDL_max(enter, 0.0f) && enter < nearest;
+}
+
+// Nearest segment the ray crosses before *nearest, which it lowers.
+bool TraceWalls(float eyeX, float eyeY, float dirX, float dirY, float *nearest, TileType *tile)
+{
+    // Large rather than infinite, so a ray along a box edge gets 0 and not NaN.
+    float inverseX = dirX != 0 ? 1.0f / dirX : 1e30f;
+    float inverseY = dirY != 0 ? 1.0f / dirY : 1e30f;
+
+    bool hit = false;
+    Uint32 stack[WallStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        Uint32 nodeIndex = stack[--top];
+        const WallNode *node = &walls.nodes[nodeIndex];
+        if (!RayEntersWallNode(node, eyeX, eyeY, inverseX, inverseY, *nearest))
+        {
+            continue;
+        }
+
+        if (node->count)
+        {
+            const WallPacket *packet = &walls.packets[node->index];
+            int lane = kernels.intersectWalls(packet, eyeX, eyeY, dirX, dirY, nearest);
+            if (lane >= 0)
+            {
+                *tile = packet->tile[lane];
+                hit = true;
+            }
+            continue;
+        }
+
+        // The child on the side the ray comes from goes on top.
+        Uint32 nearChild = nodeIndex + 1;
+        Uint32 farChild = node->index;
+        if ((node->axis == 0 ? dirX : dirY) < 0)
+        {
+            nearChild = node->index;
+            farChild = nodeIndex + 1;
+        }
+        stack[top++] = farChild;
+        stack[top++] = nearChild;
+    }
+    return hit;
+}
+
+// Minimap pixels of one segment, the minimap showing width by height pixels
+// of the world from minX, minY.
+void DrawMinimapSegment(ScreenBuffer buffer, float minX, float minY, float width, float height,
+                        float x0, float y0, float dx, float dy, Uint32 color)
+{
+    int steps = (int)ceilf(SDL_max(fabsf(dx), fabsf(dy)));
+    for (int i = 0; i <= steps; ++i)
+    {
+        float along = steps ? (float)i / steps : 0.0f;
+        int x = FloorToInt(x0 + dx * along - minX);
+        int y = FloorToInt(y0 + dy * along - minY);
+        if (x >= 0 && y >= 0 && x < width && y < height)
+        {
+            SetPixelColor(buffer, x, y, color);
+        }
+    }
+}
+
+// Minimap pixels of the segments that cross it.
+void DrawWallsOnMinimap(ScreenBuffer buffer, Texture texture)
+{
+    Vec2 minimapOrigin = TileToPixelPosition(GetMinimapOriginTile(buffer), TileDimsInPixels);
+    Vec2 minimapDims = TileToPixelPosition(GetMinimapDimsInTiles(buffer), TileDimsInPixels);
+    float minX = minimapOrigin.x;
+    float minY = minimapOrigin.y;
+    float maxX = minimapOrigin.x + minimapDims.x;
+    float maxY = minimapOrigin.y + minimapDims.y;
+
+    Uint32 stack[WallStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        Uint32 nodeIndex = stack[--top];
+        const WallNode *node = &walls.nodes[nodeIndex];
+        if (node->maxX < minX || node->minX >= maxX || node->maxY < minY || node->minY >= maxY)
+        {
+            continue;
+        }
+        if (!node->count)
+        {
+            stack[top++] = node->index;
+            stack[top++] = nodeIndex + 1;
+            continue;
+        }
+
+        const WallPacket *packet = &walls.packets[node->index];
+        for (int lane = 0; lane < node->count; ++lane)
+        {
+            DrawMinimapSegment(buffer, minX, minY, minimapDims.x, minimapDims.y,
+                               packet->x0[lane], packet->y0[lane], packet->dx[lane], packet->dy[lane],
+                               GetTileColor(packet->tile[lane], texture));
+        }
+    }
+}
+
+// Draws the walls on the minimap and lets them cover the tile hits of the
+// columns they are in front of.
+void CastWalls(ScreenBuffer buffer, Texture texture, RayHits *hits)
+{
+    if (!walls.nodeCount)
+    {
+        return;
+    }
+    DrawWallsOnMinimap(buffer, texture);
+
+    float eyeX = (float)TileOriginPixelX(player.position) + player.position.offset.x;
+    float eyeY = (float)TileOriginPixelY(player.position) + player.position.offset.y;
+    for (int column = 0; column < hits->count; ++column)
+    {
+        float angle, cos, sin;
+        GetColumnRay(column, hits->count, &angle, &cos, &sin);
+        const RayHits::Data *hit = &hits->data[column];
+        float nearest = hit->wasHit ? hit->distanceFromPlayer / cosf(angle * AngleToRadian) : viewDistance;
+
+        TileType tile;
+        if (TraceWalls(eyeX, eyeY, cos, sin, &nearest, &tile))
+        {
+            SetRayHit(hits, column, angle, nearest, tile, texture);
+        }
+    }
+}
+
+#endif
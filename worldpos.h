@@ -0,0 +1,88 @@
+#ifndef WORLDPOS_H
+#define WORLDPOS_H
+
+// Tile local world coordinates.
+//
+// A float holds 24 bits, so absolute pixel positions lose their fraction past
+// 2^23 pixels and rays start to jitter well before that. A WorldPosition keeps
+// the whole tiles as integers and only the offset into the tile as a float,
+// which has the same precision anywhere on the map. The ray casters trace
+// rays as offsets from the player's tile origin and add the integer tile back
+// when they look tiles up, so no absolute pixel position is ever a float.
+
+// Rays start inside the player's tile, so their samples go negative too and
+// need flooring rather than truncating. floorf is a library call without
+// SSE4.1.
+inline int FloorToInt(float value)
+{
+    int truncated = (int)value;
+    return truncated - (value < truncated);
+}
+
+// Carries whole tiles out of the offset, leaving it in [0, tile size).
+inline WorldPosition NormalizeWorldPosition(WorldPosition position)
+{
+    float carryX = floorf(position.offset.x / TileDimsInPixels.x);
+    float carryY = floorf(position.offset.y / TileDimsInPixels.y);
+    position.tileX += (int)carryX;
+    position.tileY += (int)carryY;
+    position.offset.x -= carryX * TileDimsInPixels.x;
+    position.offset.y -= carryY * TileDimsInPixels.y;
+
+    // A tiny negative offset rounds up to a whole tile.
+    if (position.offset.x >= TileDimsInPixels.x)
+    {
+        position.offset.x -= TileDimsInPixels.x;
+        ++position.tileX;
+    }
+    if (position.offset.y >= TileDimsInPixels.y)
+    {
+        position.offset.y -= TileDimsInPixels.y;
+        ++position.tileY;
+    }
+    return position;
+}
+
+inline WorldPosition MakeWorldPosition(int tileX, int tileY, Vec2 offset)
+{
+    return NormalizeWorldPosition(WorldPosition { tileX, tileY, offset });
+}
+
+// From absolute pixels, only exact where those still are.
+inline WorldPosition PixelsToWorldPosition(Vec2 pixels)
+{
+    return MakeWorldPosition(0, 0, pixels);
+}
+
+inline WorldPosition MoveWorldPosition(WorldPosition position, Vec2 pixels)
+{
+    position.offset += pixels;
+    return NormalizeWorldPosition(position);
+}
+
+// First pixel of the position's tile. Integer pixels cover 2^31 of them.
+inline int TileOriginPixelX(WorldPosition position)
+{
+    return position.tileX * (int)TileDimsInPixels.x;
+}
+
+inline int TileOriginPixelY(WorldPosition position)
+{
+    return position.tileY * (int)TileDimsInPixels.y;
+}
+
+// Absolute pixels, for drawing and coarse decisions only: loses precision
+// on huge maps like any float position.
+inline Vec2 WorldPositionToPixels(WorldPosition position)
+{
+    return Vec2(TileOriginPixelX(position) + position.offset.x, TileOriginPixelY(position) + position.offset.y);
+}
+
+// to - from in pixels, exact as long as the two are near each other.
+inline Vec2 WorldPositionDelta(WorldPosition from, WorldPosition to)
+{
+    return Vec2((to.tileX - from.tileX) * TileDimsInPixels.x + (to.offset.x - from.offset.x),
+                (to.tileY - from.tileY) * TileDimsInPixels.y + (to.offset.y - from.offset.y));
+}
+
+#endif